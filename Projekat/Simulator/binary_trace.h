@@ -0,0 +1,701 @@
+#pragma once
+/**
+ * @file
+ * @brief Compact binary form of Lackey branch and memory traces
+ *
+ * @details
+ * Every line of a Lackey trace becomes one record: a branch
+ * (`B  04c72425 T`), an instruction fetch (`I  04c72425,3`), a load, store
+ * or modify (` L 1ffefff8c8,8`, ` S ...`, ` M ...`), or, for anything else
+ * (banners, and record lines that are not written exactly the way Lackey
+ * writes them), the text of the line itself. Converting back gives the
+ * original file byte for byte.
+ *
+ * Records are grouped in blocks of up to `block_records`. A block holds
+ * separate streams, so each one compresses well:
+ *  - the record kinds, run-length coded;
+ *  - the addresses as zig-zag varint deltas, instruction/branch addresses
+ *    against the previous instruction/branch address and data addresses
+ *    against the previous data address;
+ *  - the access sizes as varints;
+ *  - the branch outcomes as a bitmap;
+ *  - the text lines, length and bytes.
+ * The deltas start from 0 in every block, so any block can be decoded on its
+ * own; the index at the end of the file gives the offset and first record
+ * of every block, so blocks can be replayed in parallel.
+ *
+ * Layout (little-endian):
+ *
+ *     header:  "AOR2TRC1", u32 version, u32 flags, u64 index offset,
+ *              u64 number of records
+ *     blocks:  varint records, varint runs, (u8 kind, varint length) * runs,
+ *              then per stream (addresses, sizes, outcomes, text)
+ *              varint bytes followed by the bytes
+ *     index:   u64 blocks, (u64 offset, u64 bytes, u64 first record,
+ *              u64 records) * blocks
+ *
+ * Flag 1 means the last line of the text has no newline.
+ *
+ * `reader::open` checks the header and the index, and every block is
+ * checked when it is decoded: its runs have to add up to its records and
+ * every stream has to end inside it. A block that does not is reported
+ * and not decoded.
+ */
+
+#include <cstdint>  /// for uint64_t
+#include <cstdio>   /// for snprintf
+#include <cstdlib>  /// for strtoull
+#include <cstring>  /// for memcmp, memcpy
+#include <fstream>  /// for std::ofstream
+#include <iostream> /// for error messages
+#include <string>   /// for std::string
+#include <vector>   /// for std::vector
+
+#include "lackey.h"
+#include "mapped_file.h"
+
+namespace simulator {
+    namespace binary {
+        /** Kind of a record, in the order of the Lackey letters. */
+        enum class kind : uint8_t { branch, instr, load, store, modify, text };
+
+        /**
+         * One decoded line.
+         */
+        struct record {
+            kind type;
+            bool taken;        /// outcome (branch only)
+            uint32_t size;     /// access size, or length of the text
+            uint64_t address;  /// address, or offset of the text in the block
+        };
+
+        constexpr char magic[8] = {'A', 'O', 'R', '2', 'T', 'R', 'C', '1'};
+        constexpr uint32_t version = 1;
+        constexpr size_t header_bytes = 32;
+        constexpr size_t default_block_records = size_t(1) << 16;
+
+        namespace detail {
+            inline void put_varint(std::string& out, uint64_t v) {
+                while (v >= 0x80) {
+                    out.push_back(static_cast<char>(v | 0x80));
+                    v >>= 7;
+                }
+                out.push_back(static_cast<char>(v));
+            }
+
+            /**
+             * Varints of one stream of a block, never read past `end`. A
+             * varint that does not end before it sets `bad` and reads as 0.
+             */
+            struct stream {
+                const unsigned char* p;
+                const unsigned char* end;
+                bool bad;
+
+                uint64_t varint() {
+                    uint64_t v = 0;
+                    for (int shift = 0; p < end && shift < 64; shift += 7) {
+                        const unsigned char b = *p++;
+                        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+                        if (b < 0x80)
+                            return v;
+                    }
+                    bad = true;
+                    p = end;
+                    return 0;
+                }
+
+                /** Skips `n` bytes; false, and `bad`, if there are fewer. */
+                bool skip(uint64_t n) {
+                    if (n > static_cast<uint64_t>(end - p)) {
+                        bad = true;
+                        p = end;
+                        return false;
+                    }
+                    p += n;
+                    return true;
+                }
+            };
+
+            inline uint64_t zigzag(int64_t v) {
+                return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+            }
+
+            inline int64_t unzigzag(uint64_t v) {
+                return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+            }
+
+            inline void put_u32(std::string& out, uint32_t v) {
+                for (int i = 0; i < 4; ++i)
+                    out.push_back(static_cast<char>(v >> (8 * i)));
+            }
+
+            inline uint32_t get_u32(const unsigned char* p) {
+                uint32_t v = 0;
+                for (int i = 3; i >= 0; --i)
+                    v = v << 8 | p[i];
+                return v;
+            }
+
+            inline void put_u64(std::string& out, uint64_t v) {
+                for (int i = 0; i < 8; ++i)
+                    out.push_back(static_cast<char>(v >> (8 * i)));
+            }
+
+            inline uint64_t get_u64(const unsigned char* p) {
+                uint64_t v = 0;
+                for (int i = 7; i >= 0; --i)
+                    v = v << 8 | p[i];
+                return v;
+            }
+
+            /**
+             * Writes record `r` as Lackey does.
+             * @returns number of characters, without a newline
+             */
+            inline int render(const record& r, char* buf, size_t n) {
+                const unsigned long long a = r.address;
+                switch (r.type) {
+                case kind::branch:
+                    return snprintf(buf, n, "B  %08llx %c", a, r.taken ? 'T' : 'N');
+                case kind::instr:
+                    return snprintf(buf, n, "I  %08llx,%u", a, r.size);
+                case kind::load:
+                    return snprintf(buf, n, " L %08llx,%u", a, r.size);
+                case kind::store:
+                    return snprintf(buf, n, " S %08llx,%u", a, r.size);
+                case kind::modify:
+                    return snprintf(buf, n, " M %08llx,%u", a, r.size);
+                default:
+                    return 0;
+                }
+            }
+
+            /**
+             * Record of line `[b, e)` (no newline). Lines that would not be
+             * written back identically become text records.
+             */
+            inline record parse_line(const char* b, const char* e) {
+                record r{kind::text, false, static_cast<uint32_t>(e - b), 0};
+                const size_t len = static_cast<size_t>(e - b);
+                if (len < 5 || len > 48)
+                    return r;
+                // terminated copy for strtoull, the mapped line is not
+                char line[52];
+                memcpy(line, b, len);
+                line[len] = '\0';
+                b = line;
+                e = line + len;
+                record c{kind::text, false, 0, 0};
+                const char* p;
+                if (b[0] == 'B' && b[1] == ' ' && b[2] == ' ')
+                    c.type = kind::branch;
+                else if (b[0] == 'I' && b[1] == ' ' && b[2] == ' ')
+                    c.type = kind::instr;
+                else if (b[0] == ' ' && b[2] == ' ' &&
+                    (b[1] == 'L' || b[1] == 'S' || b[1] == 'M'))
+                    c.type = b[1] == 'L' ? kind::load : b[1] == 'S' ? kind::store : kind::modify;
+                else
+                    return r;
+                char* end;
+                c.address = strtoull(b + 3, &end, 16);
+                p = end;
+                if (c.type == kind::branch) {
+                    if (p + 2 != e || p[0] != ' ' || (p[1] != 'T' && p[1] != 'N'))
+                        return r;
+                    c.taken = p[1] == 'T';
+                }
+                else {
+                    if (p >= e || *p != ',')
+                        return r;
+                    const unsigned long size = strtoul(p + 1, &end, 10);
+                    if (end != e || size > 0xffffffffUL)
+                        return r;
+                    c.size = static_cast<uint32_t>(size);
+                }
+                char buf[64];
+                const int n = render(c, buf, sizeof(buf));
+                if (n != static_cast<int>(len) || memcmp(buf, b, len) != 0)
+                    return r;
+                return c;
+            }
+        }  // namespace detail
+
+        /**
+         * Encodes the records of one block.
+         */
+        class block_encoder {
+         public:
+            void add(const record& r, const char* text = nullptr) {
+                if (runs_.empty() || runs_.back().first != r.type)
+                    runs_.push_back({r.type, 0});
+                runs_.back().second++;
+                records_++;
+                switch (r.type) {
+                case kind::branch:
+                case kind::instr:
+                    detail::put_varint(addresses_, detail::zigzag(
+                        static_cast<int64_t>(r.address - last_code_)));
+                    last_code_ = r.address;
+                    break;
+                case kind::text:
+                    detail::put_varint(text_, r.size);
+                    text_.append(text, r.size);
+                    return;
+                default:
+                    detail::put_varint(addresses_, detail::zigzag(
+                        static_cast<int64_t>(r.address - last_data_)));
+                    last_data_ = r.address;
+                    break;
+                }
+                if (r.type == kind::branch) {
+                    if (branches_ % 8 == 0)
+                        outcomes_.push_back(0);
+                    if (r.taken)
+                        outcomes_.back() = static_cast<char>(
+                            outcomes_.back() | (1 << (branches_ % 8)));
+                    branches_++;
+                }
+                else
+                    detail::put_varint(sizes_, r.size);
+            }
+
+            size_t records() const { return records_; }
+
+            /** Appends the encoded block to `out` and starts a new one. */
+            void finish(std::string& out) {
+                detail::put_varint(out, records_);
+                detail::put_varint(out, runs_.size());
+                for (const auto& run : runs_) {
+                    out.push_back(static_cast<char>(run.first));
+                    detail::put_varint(out, run.second);
+                }
+                for (const std::string* s : {&addresses_, &sizes_, &outcomes_, &text_}) {
+                    detail::put_varint(out, s->size());
+                    out += *s;
+                }
+                *this = block_encoder();
+            }
+
+         private:
+            std::vector<std::pair<kind, uint64_t>> runs_;
+            std::string addresses_, sizes_, outcomes_, text_;
+            size_t records_ = 0;
+            uint64_t branches_ = 0;
+            uint64_t last_code_ = 0, last_data_ = 0;
+        };
+
+        /**
+         * Writes a binary trace one record at a time: blocks are encoded and
+         * written as they fill up, the index and the header on `close`.
+         */
+        class writer {
+         public:
+            ~writer() {
+                if (out_.is_open())
+                    close();
+            }
+
+            /**
+             * Creates `path`. Errors are printed to `std::cerr`.
+             * @returns true on success
+             */
+            bool open(const std::string& path, size_t block_records = default_block_records) {
+                path_ = path;
+                block_records_ = block_records;
+                out_.open(path, std::ios::binary);
+                if (!out_) {
+                    std::cerr << path << ": can not create\n";
+                    return false;
+                }
+                out_.write(std::string(header_bytes, '\0').data(), header_bytes);
+                return true;
+            }
+
+            /** Appends `r`; `text` holds the line of a text record. */
+            void add(const record& r, const char* text = nullptr) {
+                enc_.add(r, text);
+                records_++;
+                if (enc_.records() == block_records_)
+                    flush();
+            }
+
+            /** Marks the text as ending without a newline. */
+            void set_no_final_newline() { flags_ |= 1; }
+
+            uint64_t records() const { return records_; }
+
+            /**
+             * Writes the last block, the index and the header.
+             * @returns true if everything was written
+             */
+            bool close() {
+                if (enc_.records() > 0)
+                    flush();
+                std::string tail;
+                detail::put_u64(tail, blocks_);
+                out_.write(tail.data(), 8);
+                out_.write(index_.data(), static_cast<std::streamsize>(index_.size()));
+
+                std::string header(magic, sizeof(magic));
+                detail::put_u32(header, version);
+                detail::put_u32(header, flags_);
+                detail::put_u64(header, offset_);
+                detail::put_u64(header, records_);
+                out_.seekp(0);
+                out_.write(header.data(), header_bytes);
+                out_.close();
+                if (!out_) {
+                    std::cerr << path_ << ": write error\n";
+                    return false;
+                }
+                return true;
+            }
+
+         private:
+            void flush() {
+                block_.clear();
+                const uint64_t n = enc_.records();
+                enc_.finish(block_);
+                out_.write(block_.data(), static_cast<std::streamsize>(block_.size()));
+                detail::put_u64(index_, offset_);
+                detail::put_u64(index_, block_.size());
+                detail::put_u64(index_, first_);
+                detail::put_u64(index_, n);
+                offset_ += block_.size();
+                first_ += n;
+                blocks_++;
+            }
+
+            std::string path_;
+            std::ofstream out_;
+            size_t block_records_ = default_block_records;
+            block_encoder enc_;
+            std::string block_, index_;
+            uint64_t offset_ = header_bytes, records_ = 0, first_ = 0, blocks_ = 0;
+            uint32_t flags_ = 0;
+        };
+
+        /**
+         * Converts the Lackey text `[begin, end)` to the binary file `path`.
+         * Errors are printed to `std::cerr`.
+         * @returns true on success
+         */
+        inline bool convert(const char* begin, const char* end, const std::string& path,
+            size_t block_records = default_block_records) {
+            writer out;
+            if (!out.open(path, block_records))
+                return false;
+            for (const char* p = begin; p < end;) {
+                const void* nl = memchr(p, '\n', static_cast<size_t>(end - p));
+                const char* e = nl ? static_cast<const char*>(nl) : end;
+                if (!nl)
+                    out.set_no_final_newline();
+                out.add(detail::parse_line(p, e), p);
+                p = nl ? e + 1 : end;
+            }
+            return out.close();
+        }
+
+        /**
+         * Binary trace mapped for reading. After `open` all members are
+         * const, so blocks may be decoded from many threads at once.
+         */
+        class reader {
+         public:
+            struct block_info {
+                uint64_t offset, bytes, first, records;
+            };
+
+            /**
+             * @returns true if `file` starts with the binary trace magic
+             */
+            static bool is_binary(const mapped_file& file) {
+                return file.size() >= header_bytes &&
+                    memcmp(file.begin(), magic, sizeof(magic)) == 0;
+            }
+
+            /**
+             * Maps `path` and reads the index. Errors go to `std::cerr`.
+             */
+            bool open(const std::string& path) {
+                if (!file_.open(path))
+                    return false;
+                path_ = path;
+                const unsigned char* p = data();
+                if (!is_binary(file_) || detail::get_u32(p + 8) != version) {
+                    std::cerr << path << ": not a binary trace\n";
+                    return false;
+                }
+                flags_ = detail::get_u32(p + 12);
+                const uint64_t index = detail::get_u64(p + 16);
+                records_ = detail::get_u64(p + 24);
+                if (index + 8 > file_.size()) {
+                    std::cerr << path << ": truncated\n";
+                    return false;
+                }
+                const uint64_t n = detail::get_u64(p + index);
+                if ((file_.size() - index - 8) / 32 < n) {
+                    std::cerr << path << ": truncated\n";
+                    return false;
+                }
+                blocks_.resize(n);
+                for (uint64_t k = 0; k < n; ++k) {
+                    const unsigned char* e = p + index + 8 + 32 * k;
+                    blocks_[k] = {detail::get_u64(e), detail::get_u64(e + 8),
+                        detail::get_u64(e + 16), detail::get_u64(e + 24)};
+                    if (blocks_[k].offset < header_bytes || blocks_[k].offset > index ||
+                        blocks_[k].bytes > index - blocks_[k].offset) {
+                        std::cerr << path << ": bad index\n";
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            const std::vector<block_info>& blocks() const { return blocks_; }
+            uint64_t records() const { return records_; }
+
+            /** The text ended without a newline. */
+            bool no_final_newline() const { return flags_ & 1; }
+
+            /**
+             * Decodes block `k` into `out` (replacing its contents). Text
+             * records point into `text`.
+             * @returns false, with `out` empty, for a bad block
+             */
+            bool decode(size_t k, std::vector<record>& out, std::string& text) const {
+                block_streams b;
+                text.clear();
+                if (!open_block(k, b)) {
+                    out.clear();
+                    return false;
+                }
+                out.resize(b.records);
+
+                uint64_t last_code = 0, last_data = 0, branches = 0;
+                size_t i = 0;
+                for (uint64_t r = 0; r < b.runs; ++r) {
+                    const kind type = static_cast<kind>(*b.kinds.p++);
+                    const uint64_t len = b.kinds.varint();
+                    for (uint64_t j = 0; j < len; ++j, ++i) {
+                        record& rec = out[i];
+                        rec.type = type;
+                        rec.taken = false;
+                        switch (type) {
+                        case kind::branch:
+                            rec.address = last_code += static_cast<uint64_t>(
+                                detail::unzigzag(b.addr.varint()));
+                            rec.taken = (b.bits[branches / 8] >> (branches % 8)) & 1;
+                            rec.size = 0;
+                            branches++;
+                            break;
+                        case kind::instr:
+                            rec.address = last_code += static_cast<uint64_t>(
+                                detail::unzigzag(b.addr.varint()));
+                            rec.size = static_cast<uint32_t>(b.size.varint());
+                            break;
+                        case kind::text: {
+                            const uint64_t bytes = b.text.varint();
+                            const char* line = reinterpret_cast<const char*>(b.text.p);
+                            rec.size = b.text.skip(bytes) ? static_cast<uint32_t>(bytes) : 0;
+                            rec.address = text.size();
+                            text.append(line, rec.size);
+                            break;
+                        }
+                        default:
+                            rec.address = last_data += static_cast<uint64_t>(
+                                detail::unzigzag(b.addr.varint()));
+                            rec.size = static_cast<uint32_t>(b.size.varint());
+                            break;
+                        }
+                    }
+                }
+                if (b.addr.bad || b.size.bad || b.text.bad) {
+                    out.clear();
+                    text.clear();
+                    return bad_block(k);
+                }
+                return true;
+            }
+
+            /**
+             * Only the branches of block `k`, for the predictor simulator.
+             * Same walk as `decode`, but other records are only skipped.
+             * @returns false, with `out` empty, for a bad block
+             */
+            bool branches(size_t k, std::vector<lackey::branch>& out) const {
+                block_streams b;
+                if (!open_block(k, b)) {
+                    out.clear();
+                    return false;
+                }
+                out.resize(b.records);
+
+                uint64_t last_code = 0, branches = 0;
+                size_t n = 0;
+                for (uint64_t r = 0; r < b.runs; ++r) {
+                    const kind type = static_cast<kind>(*b.kinds.p++);
+                    const uint64_t len = b.kinds.varint();
+                    if (type == kind::branch) {
+                        for (uint64_t j = 0; j < len; ++j, ++branches) {
+                            last_code += static_cast<uint64_t>(
+                                detail::unzigzag(b.addr.varint()));
+                            out[n].pc = last_code;
+                            out[n].taken = (b.bits[branches / 8] >> (branches % 8)) & 1;
+                            n++;
+                        }
+                    }
+                    else if (type == kind::instr) {
+                        for (uint64_t j = 0; j < len; ++j)
+                            last_code += static_cast<uint64_t>(
+                                detail::unzigzag(b.addr.varint()));
+                    }
+                    else if (type == kind::text) {
+                        // a branch line written differently from
+                        // Lackey is kept as text, but still counts
+                        for (uint64_t j = 0; j < len; ++j) {
+                            const uint64_t bytes = b.text.varint();
+                            const char* line = reinterpret_cast<const char*>(b.text.p);
+                            if (!b.text.skip(bytes))
+                                break;
+                            lackey::branch_scanner scan(line, line + bytes);
+                            n += scan.read(&out[n], 1);
+                        }
+                    }
+                    else {
+                        for (uint64_t j = 0; j < len; ++j)
+                            b.addr.varint();
+                    }
+                }
+                if (b.addr.bad || b.text.bad) {
+                    out.clear();
+                    return bad_block(k);
+                }
+                out.resize(n);
+                return true;
+            }
+
+            /**
+             * Only the memory accesses of block `k`, for the cache
+             * simulator.
+             * @returns false, with `out` empty, for a bad block
+             */
+            bool accesses(size_t k, std::vector<lackey::access>& out) const {
+                static const char letter[] = {'B', 'I', 'L', 'S', 'M'};
+                std::vector<record> recs;
+                std::string text;
+                out.clear();
+                if (!decode(k, recs, text))
+                    return false;
+                for (const record& r : recs) {
+                    if (r.type == kind::text) {
+                        lackey::access a;
+                        lackey::access_scanner scan(text.data() + r.address,
+                            text.data() + r.address + r.size);
+                        if (scan.read(&a, 1))
+                            out.push_back(a);
+                    }
+                    else if (r.type != kind::branch)
+                        out.push_back({r.address, r.size,
+                            letter[static_cast<int>(r.type)], 0});
+                }
+                return true;
+            }
+
+            /**
+             * Appends the Lackey text of decoded records to `out`; `last`
+             * tells whether this is the last block of the file.
+             */
+            void render(const std::vector<record>& recs, const std::string& text,
+                bool last, std::string& out) const {
+                char buf[64];
+                for (const record& r : recs) {
+                    if (r.type == kind::text)
+                        out.append(text, r.address, r.size);
+                    else
+                        out.append(buf, static_cast<size_t>(detail::render(r, buf, sizeof(buf))));
+                    out.push_back('\n');
+                }
+                if (last && no_final_newline() && !recs.empty())
+                    out.pop_back();
+            }
+
+         private:
+            /** The streams of one block, see the layout above. */
+            struct block_streams {
+                uint64_t records, runs;
+                detail::stream kinds, addr, size, text;
+                const unsigned char* bits;
+            };
+
+            const unsigned char* data() const {
+                return reinterpret_cast<const unsigned char*>(file_.begin());
+            }
+
+            bool bad_block(size_t k) const {
+                std::cerr << path_ << ": bad block " << k << '\n';
+                return false;
+            }
+
+            /**
+             * Finds the streams of block `k`. The block has to hold the
+             * records the index gives it, in runs of known kinds that add up
+             * to them, with every stream inside the block and enough
+             * outcome bits for its branches.
+             * @returns false, with the error printed, for a bad block
+             */
+            bool open_block(size_t k, block_streams& b) const {
+                const unsigned char* begin = data() + blocks_[k].offset;
+                detail::stream h = {begin, begin + blocks_[k].bytes, false};
+                b.records = h.varint();
+                b.runs = h.varint();
+                b.kinds = {h.p, h.end, false};
+                uint64_t total = 0, branches = 0;
+                for (uint64_t r = 0; r < b.runs && h.skip(1); ++r) {
+                    const unsigned char type = h.p[-1];
+                    const uint64_t len = h.varint();
+                    if (type > static_cast<unsigned char>(kind::text) ||
+                        len > b.records - total) {
+                        h.bad = true;
+                        break;
+                    }
+                    total += len;
+                    if (type == static_cast<unsigned char>(kind::branch))
+                        branches += len;
+                }
+                b.kinds.end = h.p;
+                detail::stream* streams[4] = {&b.addr, &b.size, nullptr, &b.text};
+                const unsigned char* bits = nullptr;
+                uint64_t bits_bytes = 0;
+                for (int i = 0; i < 4 && !h.bad; ++i) {
+                    const uint64_t bytes = h.varint();
+                    const unsigned char* p = h.p;
+                    if (!h.skip(bytes))
+                        break;
+                    if (streams[i])
+                        *streams[i] = {p, h.p, false};
+                    else {
+                        bits = p;
+                        bits_bytes = bytes;
+                    }
+                }
+                b.bits = bits;
+                // every record takes at least one byte of the address or
+                // the text stream
+                if (h.bad || b.records != blocks_[k].records || total != b.records ||
+                    bits_bytes < (branches + 7) / 8 ||
+                    b.records > static_cast<uint64_t>(b.addr.end - b.addr.p) +
+                        static_cast<uint64_t>(b.text.end - b.text.p))
+                    return bad_block(k);
+                return true;
+            }
+
+            std::string path_;
+            mapped_file file_;
+            std::vector<block_info> blocks_;
+            uint64_t records_ = 0;
+            uint32_t flags_ = 0;
+        };
+    }  // namespace binary
+}  // namespace simulator
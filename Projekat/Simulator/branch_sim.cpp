@@ -0,0 +1,214 @@
+/**
+ * @file
+ * @brief Trace-driven branch predictor simulator
+ *
+ * @details
+ * Runs any number of predictor configurations over one Lackey branch trace
+ * (`HelloTrace.txt` format, or its binary form from `trace_convert`) in a
+ * single pass:
+ *
+ *     g++ -O3 -march=native -std=c++14 branch_sim.cpp -o branch_sim
+ *     ./branch_sim HelloTrace.txt bimodal:12 gshare:14:12 egskew:12:10 2bcgskew:12:10
+ *
+ * The trace is mapped and decoded in chunks of `chunk` branches; every
+ * predictor consumes the whole chunk before the next one is decoded, so the
+ * chunk stays in cache and each predictor runs a tight loop. Without
+ * configurations a default set of all four kinds is simulated.
+ *
+ * Output is one line per configuration (size, branches, mispredictions,
+ * accuracy) and the decoding throughput on `std::cerr`.
+ *
+ * `--profile hot.csv` (or `hot.json`) also writes one row per static branch:
+ * executions, taken rate, and mispredictions and aliased table accesses for
+ * every configuration, ranked by the sum of the mispredictions; `--top N`
+ * keeps the first N rows. The aliasing of every table is printed after the
+ * summary. `--symbols` and `--load-address` name the branches, see
+ * `profile.h`.
+ */
+
+#include <chrono>    /// for std::chrono::steady_clock
+#include <cstdlib>   /// for strtoull
+#include <iomanip>   /// for std::setw
+#include <iostream>  /// for io operations
+#include <memory>    /// for std::unique_ptr
+#include <string>    /// for std::string
+#include <vector>    /// for std::vector
+
+#include "binary_trace.h"
+#include "lackey.h"
+#include "mapped_file.h"
+#include "predictors.h"
+#include "profile.h"
+
+namespace {
+    constexpr size_t chunk = 1 << 16;  /// branches decoded at once
+
+    const char* const default_configs[] = {
+        "bimodal:12", "gshare:12:12", "egskew:12:10", "2bcgskew:12:10",
+    };
+
+    /**
+     * Per-branch report of `predictors`: `sites` are the branch addresses.
+     */
+    simulator::profile::report branch_report(
+        const std::vector<std::unique_ptr<simulator::predictors::predictor>>& predictors,
+        const simulator::profile::sites& sites, const std::vector<uint64_t>& executions,
+        const std::vector<uint64_t>& taken) {
+        std::vector<std::string> columns = {"executions", "taken_rate"};
+        for (const auto& p : predictors) {
+            columns.push_back(p->name() + " mispredictions");
+            columns.push_back(p->name() + " aliased");
+        }
+        simulator::profile::report r(columns);
+        for (size_t id = 0; id < sites.size(); ++id) {
+            std::vector<double> values = {static_cast<double>(executions[id]),
+                static_cast<double>(taken[id]) / executions[id]};
+            double total = 0;
+            for (const auto& p : predictors) {
+                const uint64_t wrong = p->site_mispredictions[id];
+                values.push_back(static_cast<double>(wrong));
+                values.push_back(static_cast<double>(p->site_aliased[id]));
+                total += wrong;
+            }
+            r.add(sites.address(id), values, total);
+        }
+        return r;
+    }
+}  // namespace
+
+/** Driver Code */
+int main(int argc, char* argv[]) {
+    std::vector<std::string> configs;
+    std::string profile_path, symbol_path;
+    uint64_t load_address = 0;
+    size_t top = 0;
+    bool usage = argc < 2;
+    for (int i = 2; i < argc && !usage; ++i) {
+        const std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0)
+            configs.push_back(arg);
+        else if (i + 1 == argc)
+            usage = true;
+        else if (arg == "--profile")
+            profile_path = argv[++i];
+        else if (arg == "--symbols")
+            symbol_path = argv[++i];
+        else if (arg == "--load-address")
+            load_address = strtoull(argv[++i], nullptr, 16);
+        else if (arg == "--top")
+            top = strtoull(argv[++i], nullptr, 10);
+        else
+            usage = true;
+    }
+    if (usage) {
+        std::cerr << "Usage: " << argv[0] << " <trace> [kind:log_size[:history] ...]"
+            << " [--profile out.csv|out.json]\n       [--top N] [--symbols nm.txt]"
+            << " [--load-address hex]\n"
+            << "kinds: bimodal, gshare, egskew, 2bcgskew\n";
+        return 2;
+    }
+    simulator::profile::symbols symbols;
+    if (!symbol_path.empty() && !symbols.load(symbol_path, load_address))
+        return 1;
+
+    std::vector<std::unique_ptr<simulator::predictors::predictor>> predictors;
+    if (configs.empty())
+        configs.assign(std::begin(default_configs), std::end(default_configs));
+    for (const std::string& c : configs) {
+        predictors.push_back(simulator::predictors::make(c));
+        if (!predictors.back()) {
+            std::cerr << "Invalid configuration: " << c << '\n';
+            return 2;
+        }
+    }
+
+    simulator::mapped_file trace;
+    if (!trace.open(argv[1]))
+        return 1;
+    const size_t bytes = trace.size();
+    uint64_t skipped = 0;
+
+    // per static branch, only with --profile
+    const bool profiling = !profile_path.empty();
+    simulator::profile::sites sites;
+    std::vector<uint32_t> ids(chunk);
+    std::vector<uint64_t> executions, taken;
+    auto simulate = [&](const std::vector<simulator::lackey::branch>& b, size_t n) {
+        if (!profiling) {
+            for (auto& p : predictors)
+                p->run(b.data(), n);
+            return;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            ids[i] = sites.id(b[i].pc);
+            if (ids[i] == executions.size()) {
+                executions.push_back(0);
+                taken.push_back(0);
+            }
+            executions[ids[i]]++;
+            taken[ids[i]] += b[i].taken;
+        }
+        for (auto& p : predictors)
+            p->run_profiled(b.data(), ids.data(), n);
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<simulator::lackey::branch> buffer(chunk);
+    if (simulator::binary::reader::is_binary(trace)) {
+        trace.close();
+        simulator::binary::reader in;
+        if (!in.open(argv[1]))
+            return 1;
+        for (size_t k = 0; k < in.blocks().size(); ++k) {
+            if (!in.branches(k, buffer))
+                return 1;
+            if (ids.size() < buffer.size())
+                ids.resize(buffer.size());
+            simulate(buffer, buffer.size());
+        }
+    }
+    else {
+        simulator::lackey::branch_scanner scanner(trace.begin(), trace.end());
+        size_t n;
+        while ((n = scanner.read(buffer.data(), chunk)) > 0)
+            simulate(buffer, n);
+        skipped = scanner.skipped();
+    }
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::cout << std::left << std::setw(20) << "predictor" << std::right
+        << std::setw(10) << "KiB" << std::setw(14) << "branches"
+        << std::setw(14) << "mispredicted" << std::setw(10) << "accuracy" << '\n';
+    for (const auto& p : predictors) {
+        const double accuracy = p->branches
+            ? 100.0 * (p->branches - p->mispredictions) / p->branches : 0;
+        std::cout << std::left << std::setw(20) << p->name() << std::right
+            << std::fixed << std::setprecision(2) << std::setw(10)
+            << p->storage_bits() / 8192.0 << std::setw(14) << p->branches
+            << std::setw(14) << p->mispredictions << std::setw(9)
+            << accuracy << "%\n";
+    }
+    if (profiling) {
+        std::cout << '\n' << std::left << std::setw(20) << "predictor" << std::setw(8)
+            << "table" << std::right << std::setw(14) << "accesses" << std::setw(14)
+            << "aliased" << std::setw(14) << "destructive" << '\n';
+        for (const auto& p : predictors) {
+            p->site_mispredictions.resize(sites.size());
+            p->site_aliased.resize(sites.size());
+            for (const simulator::predictors::bank_stats& s : p->banks)
+                std::cout << std::left << std::setw(20) << p->name() << std::setw(8)
+                    << s.name << std::right << std::setw(14) << s.accesses
+                    << std::setw(14) << s.aliased << std::setw(14) << s.destructive << '\n';
+        }
+        if (!branch_report(predictors, sites, executions, taken).write(profile_path, symbols, top))
+            return 1;
+    }
+    std::cerr << bytes / 1e6 << " MB in " << seconds << " s ("
+        << bytes / 1e6 / seconds << " MB/s, "
+        << predictors.size() << " configurations)";
+    if (skipped)
+        std::cerr << ", " << skipped << " lines skipped";
+    std::cerr << '\n';
+    return 0;
+}
@@ -0,0 +1,441 @@
+#pragma once
+/**
+ * @file
+ * @brief Set-associative caches with LRU, FIFO, random and SLRU replacement
+ *
+ * @details
+ * Native counterpart of the cache simulator used with
+ * `SLRUReplacementPolicy` in `Zadatak 1/deo 1`. A cache is write-back and
+ * write-allocate; an access that crosses a block boundary touches every
+ * block it covers, and a modify (`M`) is a load followed by a store.
+ *
+ * The tags of a set are stored next to each other (8 ways of 64-bit tags
+ * fill one cache line of the host), followed in a separate array by the
+ * replacement state of the set: the ways in recency order (one byte each)
+ * for LRU and SLRU, the next way for FIFO. A lookup is one linear scan over
+ * the tags of one set.
+ *
+ * SLRU is the policy of `SLRUReplacementPolicy`: the ways of a set are
+ * split into a protected segment of `0.8 * ways` and a probationary one.
+ * New blocks enter at the front of the probationary segment, a hit there
+ * moves the block to the front of the protected segment (pushing its last
+ * block back to the front of the probationary one), and the victim is the
+ * last block of the probationary segment. The recency order array holds
+ * both segments, protected first, so all of this is one rotation.
+ *
+ * Every policy is a separate instantiation of `cache_impl`, so the loop over
+ * a chunk of accesses has no virtual calls and no policy switch.
+ */
+
+#include <algorithm>  /// for std::rotate
+#include <cstdint>    /// for uint64_t
+#include <cstdlib>    /// for strtoull
+#include <memory>     /// for std::unique_ptr
+#include <string>     /// for std::string
+#include <vector>     /// for std::vector
+
+#include "lackey.h"
+
+namespace simulator {
+    namespace cache {
+        /** Replacement policies. */
+        enum class policy { lru, fifo, random, slru };
+
+        /** Which accesses a cache sees. */
+        enum class scope { unified, data, instr };
+
+        /**
+         * Geometry and policy of one cache.
+         */
+        struct config {
+            uint64_t size = 32 << 10;  /// bytes
+            unsigned ways = 8;         /// associativity
+            unsigned block = 64;       /// bytes per block
+            policy replacement = policy::lru;
+            scope sees = scope::unified;
+
+            uint64_t sets() const { return size / (uint64_t(ways) * block); }
+
+            /** Textual form, as accepted by `parse`. */
+            std::string name() const {
+                static const char* const policies[] = {"lru", "fifo", "random", "slru"};
+                static const char* const scopes[] = {"", ":d", ":i"};
+                std::string s = size % (1 << 20) == 0 ? std::to_string(size >> 20) + "M"
+                    : size % (1 << 10) == 0 ? std::to_string(size >> 10) + "K"
+                    : std::to_string(size);
+                return s + ":" + std::to_string(ways) + ":" + std::to_string(block) +
+                    ":" + policies[static_cast<int>(replacement)] +
+                    scopes[static_cast<int>(sees)];
+            }
+        };
+
+        /**
+         * Parses `size:ways:block:policy[:scope]`, e.g. `32K:8:64:slru:d`.
+         * Size takes a K or M suffix, policy is `lru`, `fifo`, `random` or
+         * `slru`, scope is `u` (default), `d` (loads/stores only) or `i`
+         * (instruction fetches only). The number of sets has to be a power
+         * of two and `ways` at most 64.
+         * @returns false if the text is not a valid configuration
+         */
+        inline bool parse(const std::string& text, config& c) {
+            std::vector<std::string> f;
+            size_t start = 0, colon;
+            while ((colon = text.find(':', start)) != std::string::npos) {
+                f.push_back(text.substr(start, colon - start));
+                start = colon + 1;
+            }
+            f.push_back(text.substr(start));
+            if (f.size() < 4 || f.size() > 5)
+                return false;
+
+            char* end;
+            c.size = strtoull(f[0].c_str(), &end, 10);
+            if (*end == 'K' || *end == 'k')
+                c.size <<= 10, end++;
+            else if (*end == 'M' || *end == 'm')
+                c.size <<= 20, end++;
+            if (*end)
+                return false;
+            c.ways = static_cast<unsigned>(strtoul(f[1].c_str(), &end, 10));
+            if (*end)
+                return false;
+            c.block = static_cast<unsigned>(strtoul(f[2].c_str(), &end, 10));
+            if (*end)
+                return false;
+
+            if (f[3] == "lru")
+                c.replacement = policy::lru;
+            else if (f[3] == "fifo")
+                c.replacement = policy::fifo;
+            else if (f[3] == "random")
+                c.replacement = policy::random;
+            else if (f[3] == "slru")
+                c.replacement = policy::slru;
+            else
+                return false;
+
+            c.sees = scope::unified;
+            if (f.size() == 5) {
+                if (f[4] == "d")
+                    c.sees = scope::data;
+                else if (f[4] == "i")
+                    c.sees = scope::instr;
+                else if (f[4] != "u")
+                    return false;
+            }
+
+            const uint64_t sets = c.ways && c.block ? c.sets() : 0;
+            return c.ways >= 1 && c.ways <= 64 && c.block >= 1 &&
+                (c.block & (c.block - 1)) == 0 && sets >= 1 &&
+                (sets & (sets - 1)) == 0 && sets * c.ways * c.block == c.size;
+        }
+
+        /**
+         * Hit and miss counts of one cache.
+         */
+        struct statistics {
+            uint64_t accesses[3] = {};  /// instruction fetches, loads, stores
+            uint64_t misses[3] = {};
+            uint64_t writebacks = 0;    /// dirty blocks evicted
+
+            uint64_t total_accesses() const { return accesses[0] + accesses[1] + accesses[2]; }
+            uint64_t total_misses() const { return misses[0] + misses[1] + misses[2]; }
+        };
+
+        /** Block number that marks a free way. */
+        constexpr uint64_t invalid = ~uint64_t(0);
+
+        /**
+         * Common interface of all caches: whole-trace simulation with
+         * statistics (`run`), and the block operations a cache hierarchy is
+         * built from. A block is named by its block number
+         * (`address >> log2(block)`); a way is the position of a block in
+         * the cache, `set * ways + way_in_set`.
+         */
+        class cache {
+         public:
+            explicit cache(const config& c) : config_(c) {}
+            virtual ~cache() = default;
+
+            /** Simulates the accesses `a[0..n)`. */
+            virtual void run(const lackey::access* a, size_t n) = 0;
+
+            /**
+             * `run` that also counts the accesses and misses of every access
+             * site: `site[i]` is the id of the instruction making `a[i]`.
+             */
+            virtual void run_profiled(const lackey::access* a, const uint32_t* site, size_t n) = 0;
+
+            /**
+             * Way of `line`, or -1 if it is not cached. With `touch` the
+             * replacement state is updated as for a hit.
+             */
+            virtual long find(uint64_t line, bool touch) = 0;
+
+            /**
+             * Puts `line`, which is not cached, in the way the policy
+             * chooses. `victim` gets the block that was there (`invalid` if
+             * the way was free) and `victim_dirty` its dirty bit.
+             * @returns the way
+             */
+            virtual long fill(uint64_t line, uint64_t& victim, bool& victim_dirty) = 0;
+
+            /**
+             * Removes `line` if it is cached.
+             * @returns true if it was cached and dirty
+             */
+            virtual bool invalidate(uint64_t line) = 0;
+
+            /** Marks the block in `way` as modified. */
+            virtual void mark_dirty(long way) = 0;
+
+            const config& configuration() const { return config_; }
+            const statistics& stats() const { return stats_; }
+
+            std::vector<uint64_t> site_accesses;  /// per site id
+            std::vector<uint64_t> site_misses;
+
+         protected:
+            config config_;
+            statistics stats_;
+        };
+
+        /**
+         * Cache with replacement policy `P`.
+         */
+        template <policy P>
+        class cache_impl final : public cache {
+         public:
+            explicit cache_impl(const config& c)
+                : cache(c), ways_(c.ways), set_mask_(c.sets() - 1),
+                  tags_(c.sets() * c.ways, invalid), order_(c.sets() * c.ways),
+                  dirty_(c.sets()), front_(c.sets()),
+                  protected_ways_(static_cast<unsigned>(0.8 * c.ways)) {
+                while ((1u << block_bits_) < c.block)
+                    block_bits_++;
+                for (size_t i = 0; i < order_.size(); ++i)
+                    order_[i] = static_cast<uint8_t>(i % ways_);
+            }
+
+            void run(const lackey::access* a, size_t n) override {
+                simulate<false>(a, nullptr, n);
+            }
+
+            void run_profiled(const lackey::access* a, const uint32_t* site, size_t n) override {
+                simulate<true>(a, site, n);
+            }
+
+            long find(uint64_t line, bool touch) override {
+                const uint64_t set = line & set_mask_;
+                const unsigned way = lookup(set, line);
+                if (way == ways_)
+                    return -1;
+                if (touch)
+                    hit(set, &order_[set * ways_], way);
+                return static_cast<long>(set * ways_ + way);
+            }
+
+            long fill(uint64_t line, uint64_t& victim, bool& victim_dirty) override {
+                const uint64_t set = line & set_mask_;
+                const unsigned way = replace(set, line, victim, victim_dirty);
+                return static_cast<long>(set * ways_ + way);
+            }
+
+            bool invalidate(uint64_t line) override {
+                const uint64_t set = line & set_mask_;
+                const unsigned way = lookup(set, line);
+                if (way == ways_)
+                    return false;
+                const bool was_dirty = dirty_[set] >> way & 1;
+                tags_[set * ways_ + way] = invalid;
+                dirty_[set] &= ~(uint64_t(1) << way);
+                if (P == policy::lru || P == policy::slru) {
+                    // free ways are kept at the end of the order
+                    uint8_t* order = &order_[set * ways_];
+                    const unsigned i = position(order, way);
+                    std::rotate(order + i, order + i + 1, order + ways_);
+                    if (P == policy::slru && i < front_[set])
+                        front_[set]--;
+                }
+                return was_dirty;
+            }
+
+            void mark_dirty(long way) override {
+                dirty_[static_cast<uint64_t>(way) / ways_] |=
+                    uint64_t(1) << (static_cast<uint64_t>(way) % ways_);
+            }
+
+         private:
+            template <bool Profiled>
+            void simulate(const lackey::access* a, const uint32_t* site, size_t n) {
+                const bool want_instr = config_.sees != scope::data;
+                const bool want_data = config_.sees != scope::instr;
+                for (size_t i = 0; i < n; ++i) {
+                    const lackey::access& x = a[i];
+                    if (x.type == 'P' || (x.type == 'I' ? !want_instr : !want_data))
+                        continue;
+                    const uint64_t first = x.address >> block_bits_;
+                    const uint64_t last = (x.address + (x.size ? x.size - 1 : 0)) >> block_bits_;
+                    unsigned accesses = 0, misses = 0;
+                    for (uint64_t line = first; line <= last; ++line) {
+                        switch (x.type) {
+                        case 'I':
+                            misses += access(line, 0, false);
+                            break;
+                        case 'L':
+                            misses += access(line, 1, false);
+                            break;
+                        case 'S':
+                            misses += access(line, 2, true);
+                            break;
+                        default:
+                            misses += access(line, 1, false);
+                            misses += access(line, 2, true);
+                            accesses++;
+                            break;
+                        }
+                        accesses++;
+                    }
+                    if (Profiled) {
+                        if (site[i] >= site_accesses.size()) {
+                            site_accesses.resize(site[i] + 1);
+                            site_misses.resize(site[i] + 1);
+                        }
+                        site_accesses[site[i]] += accesses;
+                        site_misses[site[i]] += misses;
+                    }
+                }
+            }
+
+            unsigned lookup(uint64_t set, uint64_t line) const {
+                const uint64_t* tags = &tags_[set * ways_];
+                unsigned way = 0;
+                while (way < ways_ && tags[way] != line)
+                    way++;
+                return way;
+            }
+
+            /**
+             * One access to block number `line`; `type` indexes the
+             * statistics.
+             * @returns true on a miss
+             */
+            bool access(uint64_t line, int type, bool write) {
+                const uint64_t set = line & set_mask_;
+                stats_.accesses[type]++;
+
+                unsigned way = lookup(set, line);
+                const bool miss = way == ways_;
+                if (!miss) {
+                    hit(set, &order_[set * ways_], way);
+                }
+                else {
+                    stats_.misses[type]++;
+                    uint64_t victim;
+                    bool victim_dirty;
+                    way = replace(set, line, victim, victim_dirty);
+                    if (victim_dirty)
+                        stats_.writebacks++;
+                }
+                if (write)
+                    dirty_[set] |= uint64_t(1) << way;
+                return miss;
+            }
+
+            /** Chooses a way of `set` for `line` and puts it there. */
+            unsigned replace(uint64_t set, uint64_t line, uint64_t& victim, bool& victim_dirty) {
+                const unsigned way = choose(set, &tags_[set * ways_], &order_[set * ways_]);
+                uint64_t& tag = tags_[set * ways_ + way];
+                victim = tag;
+                victim_dirty = tag != invalid && (dirty_[set] >> way & 1);
+                dirty_[set] &= ~(uint64_t(1) << way);
+                tag = line;
+                return way;
+            }
+
+            /** Position of `way` in the recency order of a set. */
+            unsigned position(const uint8_t* order, unsigned way) const {
+                unsigned i = 0;
+                while (order[i] != way)
+                    i++;
+                return i;
+            }
+
+            void hit(uint64_t set, uint8_t* order, unsigned way) {
+                if (P == policy::lru) {
+                    const unsigned i = position(order, way);
+                    std::rotate(order, order + i, order + i + 1);
+                }
+                else if (P == policy::slru) {
+                    // to the front of the protected segment; if it was in
+                    // the probationary one and the protected segment is
+                    // full, the last protected block becomes the first
+                    // probationary one
+                    const unsigned i = position(order, way);
+                    std::rotate(order, order + i, order + i + 1);
+                    if (i >= front_[set] && front_[set] < protected_ways_)
+                        front_[set]++;
+                }
+            }
+
+            unsigned choose(uint64_t set, const uint64_t* tags, uint8_t* order) {
+                if (P == policy::lru) {
+                    // invalid blocks are never moved forward, they are
+                    // the last ones in the order
+                    const unsigned way = order[ways_ - 1];
+                    std::rotate(order, order + ways_ - 1, order + ways_);
+                    return way;
+                }
+                if (P == policy::slru) {
+                    // last probationary block, re-inserted at the front of
+                    // the probationary segment
+                    const unsigned p = front_[set];
+                    const unsigned way = order[ways_ - 1];
+                    std::rotate(order + p, order + ways_ - 1, order + ways_);
+                    return way;
+                }
+                // a way freed by invalidate() is used first; without
+                // invalidations FIFO fills the free ways in this order
+                // anyway
+                for (unsigned w = 0; w < ways_; ++w)
+                    if (tags[w] == invalid)
+                        return w;
+                if (P == policy::fifo) {
+                    const unsigned way = front_[set];
+                    front_[set] = (way + 1) % ways_;
+                    return way;
+                }
+                random_ ^= random_ << 13;
+                random_ ^= random_ >> 7;
+                random_ ^= random_ << 17;
+                return static_cast<unsigned>(random_ % ways_);
+            }
+
+            unsigned ways_;
+            unsigned block_bits_ = 0;
+            uint64_t set_mask_;
+            std::vector<uint64_t> tags_;     /// block number per way, set by set
+            std::vector<uint8_t> order_;     /// recency order per set (LRU, SLRU)
+            std::vector<uint64_t> dirty_;    /// dirty bit per way
+            std::vector<unsigned> front_;    /// SLRU: protected ways, FIFO: next way
+            unsigned protected_ways_;        /// SLRU protected segment size
+            uint64_t random_ = 0x9E3779B97F4A7C15ULL;
+        };
+
+        /**
+         * Builds the cache of configuration `c`.
+         */
+        inline std::unique_ptr<cache> make(const config& c) {
+            switch (c.replacement) {
+            case policy::lru:
+                return std::unique_ptr<cache>(new cache_impl<policy::lru>(c));
+            case policy::fifo:
+                return std::unique_ptr<cache>(new cache_impl<policy::fifo>(c));
+            case policy::random:
+                return std::unique_ptr<cache>(new cache_impl<policy::random>(c));
+            default:
+                return std::unique_ptr<cache>(new cache_impl<policy::slru>(c));
+            }
+        }
+    }  // namespace cache
+}  // namespace simulator
@@ -0,0 +1,199 @@
+/**
+ * @file
+ * @brief Trace-driven multi-configuration cache simulator
+ *
+ * @details
+ * Runs any number of cache configurations over one Lackey memory trace
+ * (`valgrind --tool=lackey --trace-mem=yes`, as text or converted with
+ * `trace_convert`) in a single pass:
+ *
+ *     g++ -O3 -march=native -std=c++14 cache_sim.cpp -o cache_sim
+ *     ./cache_sim trace.txt 32K:8:64:lru 32K:8:64:slru 256K:16:64:slru:d
+ *
+ * Configurations are `size:ways:block:policy[:scope]`, see
+ * `simulator::cache::parse`. The trace is decoded once, in chunks, and
+ * every cache consumes the whole chunk before the next one is decoded.
+ * Without configurations all four policies are simulated for a 32 KiB,
+ * 8-way cache with 64-byte blocks.
+ *
+ * `--profile sites.csv` (or `.json`) also writes one row per access site,
+ * the instruction making the access (the last `I` record before a data
+ * access): its accesses and the misses in every configuration, ranked by
+ * the sum of the misses. `--top`, `--symbols` and `--load-address` are as
+ * in `branch_sim`.
+ */
+
+#include <chrono>    /// for std::chrono::steady_clock
+#include <cstdlib>   /// for strtoull
+#include <iomanip>   /// for std::setw
+#include <iostream>  /// for io operations
+#include <memory>    /// for std::unique_ptr
+#include <string>    /// for std::string
+#include <vector>    /// for std::vector
+
+#include "binary_trace.h"
+#include "cache.h"
+#include "lackey.h"
+#include "mapped_file.h"
+#include "profile.h"
+
+namespace {
+    constexpr size_t chunk = 1 << 16;  /// accesses decoded at once
+
+    const char* const default_configs[] = {
+        "32K:8:64:lru", "32K:8:64:fifo", "32K:8:64:random", "32K:8:64:slru",
+    };
+
+    double rate(uint64_t misses, uint64_t accesses) {
+        return accesses ? 100.0 * misses / accesses : 0;
+    }
+
+    /**
+     * Per-site report of `caches`: `sites` are the instruction addresses.
+     */
+    simulator::profile::report site_report(
+        const std::vector<std::unique_ptr<simulator::cache::cache>>& caches,
+        const simulator::profile::sites& sites) {
+        std::vector<std::string> columns;
+        for (const auto& c : caches) {
+            columns.push_back(c->configuration().name() + " accesses");
+            columns.push_back(c->configuration().name() + " misses");
+        }
+        simulator::profile::report r(columns);
+        for (size_t id = 0; id < sites.size(); ++id) {
+            std::vector<double> values;
+            double total = 0;
+            for (const auto& c : caches) {
+                const uint64_t misses = id < c->site_misses.size() ? c->site_misses[id] : 0;
+                values.push_back(static_cast<double>(
+                    id < c->site_accesses.size() ? c->site_accesses[id] : 0));
+                values.push_back(static_cast<double>(misses));
+                total += misses;
+            }
+            r.add(sites.address(id), values, total);
+        }
+        return r;
+    }
+}  // namespace
+
+/** Driver Code */
+int main(int argc, char* argv[]) {
+    std::vector<std::string> configs;
+    std::string profile_path, symbol_path;
+    uint64_t load_address = 0;
+    size_t top = 0;
+    bool usage = argc < 2;
+    for (int i = 2; i < argc && !usage; ++i) {
+        const std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0)
+            configs.push_back(arg);
+        else if (i + 1 == argc)
+            usage = true;
+        else if (arg == "--profile")
+            profile_path = argv[++i];
+        else if (arg == "--symbols")
+            symbol_path = argv[++i];
+        else if (arg == "--load-address")
+            load_address = strtoull(argv[++i], nullptr, 16);
+        else if (arg == "--top")
+            top = strtoull(argv[++i], nullptr, 10);
+        else
+            usage = true;
+    }
+    if (usage) {
+        std::cerr << "Usage: " << argv[0] << " <trace> [size:ways:block:policy[:scope] ...]"
+            << " [--profile out.csv|out.json]\n       [--top N] [--symbols nm.txt]"
+            << " [--load-address hex]\n"
+            << "policies: lru, fifo, random, slru; scopes: u, d, i\n";
+        return 2;
+    }
+    simulator::profile::symbols symbols;
+    if (!symbol_path.empty() && !symbols.load(symbol_path, load_address))
+        return 1;
+
+    std::vector<std::unique_ptr<simulator::cache::cache>> caches;
+    if (configs.empty())
+        configs.assign(std::begin(default_configs), std::end(default_configs));
+    for (const std::string& text : configs) {
+        simulator::cache::config c;
+        if (!simulator::cache::parse(text, c)) {
+            std::cerr << "Invalid configuration: " << text << '\n';
+            return 2;
+        }
+        caches.push_back(simulator::cache::make(c));
+    }
+
+    simulator::mapped_file trace;
+    if (!trace.open(argv[1]))
+        return 1;
+    const size_t bytes = trace.size();
+    uint64_t skipped = 0;
+
+    // per access site, only with --profile
+    const bool profiling = !profile_path.empty();
+    simulator::profile::sites sites;
+    std::vector<uint32_t> ids(chunk);
+    uint64_t pc = 0;
+    auto simulate = [&](const std::vector<simulator::lackey::access>& a, size_t n) {
+        if (!profiling) {
+            for (auto& c : caches)
+                c->run(a.data(), n);
+            return;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            if (a[i].type == 'I')
+                pc = a[i].address;
+            ids[i] = sites.id(pc);
+        }
+        for (auto& c : caches)
+            c->run_profiled(a.data(), ids.data(), n);
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<simulator::lackey::access> buffer(chunk);
+    if (simulator::binary::reader::is_binary(trace)) {
+        trace.close();
+        simulator::binary::reader in;
+        if (!in.open(argv[1]))
+            return 1;
+        for (size_t k = 0; k < in.blocks().size(); ++k) {
+            if (!in.accesses(k, buffer))
+                return 1;
+            if (ids.size() < buffer.size())
+                ids.resize(buffer.size());
+            simulate(buffer, buffer.size());
+        }
+    }
+    else {
+        simulator::lackey::access_scanner scanner(trace.begin(), trace.end());
+        size_t n;
+        while ((n = scanner.read(buffer.data(), chunk)) > 0)
+            simulate(buffer, n);
+        skipped = scanner.skipped();
+    }
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::cout << std::left << std::setw(22) << "cache" << std::right
+        << std::setw(14) << "accesses" << std::setw(12) << "misses"
+        << std::setw(9) << "miss %" << std::setw(9) << "I %" << std::setw(9)
+        << "L %" << std::setw(9) << "S %" << std::setw(12) << "writebacks" << '\n';
+    for (const auto& c : caches) {
+        const simulator::cache::statistics& s = c->stats();
+        std::cout << std::left << std::setw(22) << c->configuration().name()
+            << std::right << std::setw(14) << s.total_accesses() << std::setw(12)
+            << s.total_misses() << std::fixed << std::setprecision(2)
+            << std::setw(9) << rate(s.total_misses(), s.total_accesses());
+        for (int t = 0; t < 3; ++t)
+            std::cout << std::setw(9) << rate(s.misses[t], s.accesses[t]);
+        std::cout << std::setw(12) << s.writebacks << '\n';
+    }
+    if (profiling && !site_report(caches, sites).write(profile_path, symbols, top))
+        return 1;
+    std::cerr << bytes / 1e6 << " MB in " << seconds << " s ("
+        << bytes / 1e6 / seconds << " MB/s, " << caches.size() << " configurations)";
+    if (skipped)
+        std::cerr << ", " << skipped << " lines skipped";
+    std::cerr << '\n';
+    return 0;
+}
@@ -0,0 +1,368 @@
+#pragma once
+/**
+ * @file
+ * @brief L1/L2/LLC cache hierarchy with software and hardware prefetching
+ *
+ * @details
+ * Three `cache::cache` levels with the same block size, either
+ *  - inclusive: the LLC holds every block of L1 and L2 (L1 and L2 do not
+ *    include each other, as in most Intel parts); an LLC eviction removes
+ *    the block from L1 and L2 too; or
+ *  - exclusive: a block is in at most one level; L1 victims move to L2,
+ *    L2 victims to the LLC, and a hit in L2 or the LLC moves the block up
+ *    to L1.
+ *
+ * Software prefetches come from the `P0/P1/P2/PN` records of the trace
+ * (`PREFETCHT0/T1/T2/NTA`): T0 fills L1, T1 fills L2, T2 fills the LLC (and
+ * the levels below them in inclusive mode); NTA fills L1 only (and the LLC
+ * in inclusive mode), bypassing L2. Hardware prefetchers watch the demand
+ * accesses and fill `hw_level`:
+ *  - next-line: on an L1 miss of block b, blocks b+1 .. b+degree;
+ *  - stride: a 64-entry table indexed by the address of the last `I`
+ *    record (the instruction making the access); after the same stride is
+ *    seen twice in a row, blocks b+s .. b+degree*s.
+ *
+ * Time is counted in trace records. A prefetch that brings a block from
+ * level k (or memory) is complete `latency[k]` records later. The first
+ * demand access to a prefetched block counts the prefetch as useful, or as
+ * late if it is not complete yet; a prefetched block that leaves the level
+ * it was prefetched to (or is still there at the end) without a demand
+ * access counts as useless; a prefetch of a block that is already in the
+ * target level (or above it) is redundant and does nothing.
+ */
+
+#include <cstdint>  /// for uint64_t
+#include <memory>   /// for std::unique_ptr
+#include <vector>   /// for std::vector
+
+#include "cache.h"
+#include "lackey.h"
+
+namespace simulator {
+    namespace hierarchy {
+        constexpr int levels = 3;  /// L1, L2, LLC
+
+        /** Where a block came from; all but `demand` are prefetches. */
+        enum source : uint8_t { demand, sw_t0, sw_t1, sw_t2, sw_nta, next_line, stride, sources };
+
+        inline const char* source_name(int s) {
+            static const char* const names[] = {"demand", "PREFETCHT0", "PREFETCHT1",
+                "PREFETCHT2", "PREFETCHNTA", "next-line", "stride"};
+            return names[s];
+        }
+
+        /**
+         * Configuration of the hierarchy and its prefetchers.
+         */
+        struct options {
+            cache::config level[levels];     /// L1, L2, LLC
+            bool exclusive = false;          /// exclusive instead of inclusive
+            bool instr = false;              /// instruction fetches go through L1 too
+            unsigned next_line = 0;          /// next-line degree, 0 = off
+            unsigned stride = 0;             /// stride prefetcher degree, 0 = off
+            int hw_level = 0;                /// level filled by hardware prefetches
+            uint64_t latency[levels + 1] = {4, 12, 40, 200};  /// L1, L2, LLC, memory
+
+            options() {
+                level[0].size = 32 << 10;
+                level[0].ways = 8;
+                level[1].size = 256 << 10;
+                level[1].ways = 8;
+                level[2].size = 8 << 20;
+                level[2].ways = 16;
+            }
+        };
+
+        /** Demand traffic of one level. */
+        struct level_stats {
+            uint64_t accesses = 0;  /// demand accesses that reached the level
+            uint64_t hits = 0;
+        };
+
+        /** Outcome of the prefetches of one source. */
+        struct prefetch_stats {
+            uint64_t issued = 0;     /// prefetches seen
+            uint64_t redundant = 0;  /// block was already there
+            uint64_t useful = 0;     /// used after it was complete
+            uint64_t late = 0;       /// used before it was complete
+            uint64_t useless = 0;    /// evicted or left unused
+        };
+
+        /**
+         * The simulated hierarchy.
+         */
+        class hierarchy {
+         public:
+            explicit hierarchy(const options& o) : opt_(o), strides_(64) {
+                block_bits_ = 0;
+                while ((1u << block_bits_) < o.level[0].block)
+                    block_bits_++;
+                for (int k = 0; k < levels; ++k) {
+                    cache_[k] = cache::make(o.level[k]);
+                    meta_[k].resize(o.level[k].sets() * o.level[k].ways);
+                }
+            }
+
+            /** Simulates the accesses `a[0..n)`. */
+            void run(const lackey::access* a, size_t n) {
+                for (size_t i = 0; i < n; ++i) {
+                    const lackey::access& x = a[i];
+                    now_++;
+                    if (x.type == 'I') {
+                        pc_ = x.address;
+                        if (!opt_.instr)
+                            continue;
+                    }
+                    const uint64_t first = x.address >> block_bits_;
+                    const uint64_t last = (x.address + (x.size ? x.size - 1 : 0)) >> block_bits_;
+                    for (uint64_t line = first; line <= last; ++line) {
+                        if (x.type == 'P') {
+                            const source s = x.hint == '0' ? sw_t0 : x.hint == '1' ? sw_t1
+                                : x.hint == '2' ? sw_t2 : sw_nta;
+                            prefetch(line, s);
+                            continue;
+                        }
+                        const bool l1_miss = demand_access(line, x.type == 'S' || x.type == 'M');
+                        if (x.type == 'I')
+                            continue;
+                        if (l1_miss)
+                            for (unsigned d = 1; d <= opt_.next_line; ++d)
+                                prefetch(line + d, next_line);
+                        if (opt_.stride && line == first)
+                            train_stride(line);
+                    }
+                }
+            }
+
+            /** Counts the prefetched blocks that were never used. */
+            void finish() {
+                for (int k = 0; k < levels; ++k)
+                    for (meta& m : meta_[k])
+                        if (m.from != demand) {
+                            prefetches_[m.from].useless++;
+                            m.from = demand;
+                        }
+            }
+
+            const level_stats& level(int k) const { return levels_[k]; }
+            const prefetch_stats& prefetches(int s) const { return prefetches_[s]; }
+            uint64_t memory_reads() const { return memory_reads_; }
+            uint64_t memory_writes() const { return memory_writes_; }
+
+         private:
+            /** Prefetch state of a cached block. */
+            struct meta {
+                source from = demand;  /// prefetch that brought it, until first use
+                uint64_t ready = 0;    /// time the prefetch completes
+            };
+
+            struct stride_entry {
+                uint64_t pc = 0, last = 0;
+                int64_t stride = 0;
+                unsigned confidence = 0;
+            };
+
+            /**
+             * Demand access of block `line`.
+             * @returns true if it missed in L1
+             */
+            bool demand_access(uint64_t line, bool write) {
+                int k = 0;
+                long way = -1;
+                for (; k < levels; ++k) {
+                    levels_[k].accesses++;
+                    way = cache_[k]->find(line, true);
+                    if (way >= 0) {
+                        levels_[k].hits++;
+                        break;
+                    }
+                }
+                if (k < levels)
+                    use(k, way);
+                else
+                    memory_reads_++;
+
+                long l1_way;
+                if (opt_.exclusive) {
+                    if (k == 0)
+                        l1_way = way;
+                    else {
+                        meta m;
+                        bool dirty = false;
+                        if (k < levels) {
+                            m = meta_[k][way];
+                            dirty = cache_[k]->invalidate(line);
+                        }
+                        l1_way = insert_exclusive(0, line, m, dirty);
+                    }
+                }
+                else {
+                    l1_way = way;
+                    for (int j = k - 1; j >= 0; --j) {
+                        const long w = insert_inclusive(j, line, meta());
+                        if (j == 0)
+                            l1_way = w;
+                    }
+                }
+                if (write)
+                    cache_[0]->mark_dirty(l1_way);
+                return k > 0;
+            }
+
+            /** First demand use of the block in `way` of level `k`. */
+            void use(int k, long way) {
+                meta& m = meta_[k][way];
+                if (m.from != demand) {
+                    if (now_ < m.ready)
+                        prefetches_[m.from].late++;
+                    else
+                        prefetches_[m.from].useful++;
+                    m.from = demand;
+                }
+            }
+
+            void prefetch(uint64_t line, source s) {
+                prefetch_stats& st = prefetches_[s];
+                st.issued++;
+                const int target = s == sw_t0 || s == sw_nta ? 0 : s == sw_t1 ? 1
+                    : s == sw_t2 ? 2 : opt_.hw_level;
+
+                int k = 0;
+                long way = -1;
+                for (; k < levels; ++k)
+                    if ((way = cache_[k]->find(line, false)) >= 0)
+                        break;
+                if (k <= target) {
+                    st.redundant++;
+                    return;
+                }
+                if (k == levels)
+                    memory_reads_++;
+                meta m;
+                m.from = s;
+                m.ready = now_ + opt_.latency[k];
+
+                if (opt_.exclusive) {
+                    bool dirty = false;
+                    if (k < levels) {
+                        // an unused earlier prefetch is superseded by this one
+                        drop(meta_[k][way]);
+                        dirty = cache_[k]->invalidate(line);
+                    }
+                    insert_exclusive(target, line, m, dirty);
+                }
+                else {
+                    for (int j = k - 1; j >= target; --j) {
+                        if (s == sw_nta && j == 1)
+                            continue;
+                        insert_inclusive(j, line, j == target ? m : meta());
+                    }
+                }
+            }
+
+            void train_stride(uint64_t line) {
+                stride_entry& e = strides_[(pc_ ^ (pc_ >> 6)) % strides_.size()];
+                if (e.pc != pc_) {
+                    e = stride_entry();
+                    e.pc = pc_;
+                    e.last = line;
+                    return;
+                }
+                const int64_t s = static_cast<int64_t>(line - e.last);
+                if (s != 0 && s == e.stride) {
+                    if (e.confidence < 3)
+                        e.confidence++;
+                }
+                else {
+                    e.stride = s;
+                    e.confidence = 0;
+                }
+                e.last = line;
+                if (e.confidence >= 2)
+                    for (unsigned d = 1; d <= opt_.stride; ++d)
+                        prefetch(line + static_cast<uint64_t>(e.stride * static_cast<int64_t>(d)), stride);
+            }
+
+            /** The prefetched block `m` leaves the hierarchy or its level. */
+            void drop(meta& m) {
+                if (m.from != demand)
+                    prefetches_[m.from].useless++;
+                m = meta();
+            }
+
+            /**
+             * Puts `line` in level `k` of the inclusive hierarchy.
+             * @returns its way
+             */
+            long insert_inclusive(int k, uint64_t line, const meta& m) {
+                uint64_t victim;
+                bool dirty;
+                const long way = cache_[k]->fill(line, victim, dirty);
+                if (victim != cache::invalid) {
+                    drop(meta_[k][way]);
+                    if (k == levels - 1) {
+                        // keep the upper levels inside the LLC
+                        for (int j = 0; j < k; ++j) {
+                            const long w = cache_[j]->find(victim, false);
+                            if (w >= 0) {
+                                drop(meta_[j][w]);
+                                dirty |= cache_[j]->invalidate(victim);
+                            }
+                        }
+                        if (dirty)
+                            memory_writes_++;
+                    }
+                    else if (dirty) {
+                        // written back into the next level that has it
+                        for (int j = k + 1; j < levels; ++j) {
+                            const long w = cache_[j]->find(victim, false);
+                            if (w >= 0) {
+                                cache_[j]->mark_dirty(w);
+                                break;
+                            }
+                        }
+                    }
+                }
+                meta_[k][way] = m;
+                return way;
+            }
+
+            /**
+             * Puts `line` in level `k` of the exclusive hierarchy, moving
+             * victims down.
+             * @returns its way
+             */
+            long insert_exclusive(int k, uint64_t line, const meta& m, bool dirty) {
+                uint64_t victim;
+                bool victim_dirty;
+                const long way = cache_[k]->fill(line, victim, victim_dirty);
+                const meta victim_meta = meta_[k][way];
+                meta_[k][way] = m;
+                if (dirty)
+                    cache_[k]->mark_dirty(way);
+                if (victim != cache::invalid) {
+                    if (k + 1 < levels)
+                        insert_exclusive(k + 1, victim, victim_meta, victim_dirty);
+                    else {
+                        meta gone = victim_meta;
+                        drop(gone);
+                        if (victim_dirty)
+                            memory_writes_++;
+                    }
+                }
+                return way;
+            }
+
+            options opt_;
+            unsigned block_bits_;
+            std::unique_ptr<cache::cache> cache_[levels];
+            std::vector<meta> meta_[levels];  /// per way of every level
+            std::vector<stride_entry> strides_;
+            level_stats levels_[levels];
+            prefetch_stats prefetches_[sources];
+            uint64_t memory_reads_ = 0, memory_writes_ = 0;
+            uint64_t now_ = 0;  /// trace records so far
+            uint64_t pc_ = 0;   /// address of the last instruction fetch
+        };
+    }  // namespace hierarchy
+}  // namespace simulator
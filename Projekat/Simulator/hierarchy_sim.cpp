@@ -0,0 +1,168 @@
+/**
+ * @file
+ * @brief Trace-driven L1/L2/LLC hierarchy simulator with prefetching
+ *
+ * @details
+ *     g++ -O3 -march=native -std=c++14 hierarchy_sim.cpp -o hierarchy_sim
+ *     ./hierarchy_sim trace.txt --l1 32K:8:64:lru --llc 8M:16:64:slru \
+ *         --next-line 1 --stride 4 --hw-level 2
+ *
+ * The trace is a Lackey memory trace (text or `trace_convert` output);
+ * software prefetches are `P0/P1/P2/PN addr,size` records, written by the
+ * tracing code in place of the `PREFETCHT0/T1/T2/NTA` instructions, which
+ * Lackey does not report. See `simulator::hierarchy` for the model.
+ *
+ * Options:
+ *  - `--l1/--l2/--llc size:ways:block:policy`: the levels (default 32K:8,
+ *    256K:8 and 8M:16, 64-byte blocks, LRU);
+ *  - `--exclusive`: exclusive instead of inclusive hierarchy;
+ *  - `--instr`: instruction fetches go through the hierarchy too;
+ *  - `--next-line N`, `--stride N`: hardware prefetchers and their degree;
+ *  - `--hw-level 1|2`: level the hardware prefetchers fill (default 1);
+ *  - `--latency L2,LLC,MEM`: prefetch latencies in trace records.
+ */
+
+#include <cstdio>    /// for sscanf
+#include <cstdlib>   /// for atoi
+#include <cstring>   /// for strcmp
+#include <iomanip>   /// for std::setw
+#include <iostream>  /// for io operations
+#include <string>    /// for std::string
+#include <vector>    /// for std::vector
+
+#include "binary_trace.h"
+#include "cache.h"
+#include "hierarchy.h"
+#include "lackey.h"
+#include "mapped_file.h"
+
+namespace {
+    constexpr size_t chunk = 1 << 16;  /// accesses decoded at once
+
+    const char* const level_names[] = {"L1", "L2", "LLC"};
+
+    double rate(uint64_t part, uint64_t whole) {
+        return whole ? 100.0 * part / whole : 0;
+    }
+
+    /**
+     * Parses the command line into `o`.
+     * @returns false (after printing why) on invalid options
+     */
+    bool parse_options(int argc, char* argv[], simulator::hierarchy::options& o) {
+        for (int i = 2; i < argc; ++i) {
+            const std::string arg = argv[i];
+            const bool has_value = i + 1 < argc;
+            int k = arg == "--l1" ? 0 : arg == "--l2" ? 1 : arg == "--llc" ? 2 : -1;
+            if (k >= 0 && has_value) {
+                if (!simulator::cache::parse(argv[++i], o.level[k])) {
+                    std::cerr << "Invalid configuration: " << argv[i] << '\n';
+                    return false;
+                }
+            }
+            else if (arg == "--exclusive")
+                o.exclusive = true;
+            else if (arg == "--instr")
+                o.instr = true;
+            else if (arg == "--next-line" && has_value)
+                o.next_line = static_cast<unsigned>(atoi(argv[++i]));
+            else if (arg == "--stride" && has_value)
+                o.stride = static_cast<unsigned>(atoi(argv[++i]));
+            else if (arg == "--hw-level" && has_value) {
+                o.hw_level = atoi(argv[++i]) - 1;
+                if (o.hw_level < 0 || o.hw_level > 1) {
+                    std::cerr << "Invalid hardware prefetch level: " << argv[i] << '\n';
+                    return false;
+                }
+            }
+            else if (arg == "--latency" && has_value) {
+                unsigned long long l2, llc, mem;
+                if (sscanf(argv[++i], "%llu,%llu,%llu", &l2, &llc, &mem) != 3) {
+                    std::cerr << "Invalid latencies: " << argv[i] << '\n';
+                    return false;
+                }
+                o.latency[1] = l2;
+                o.latency[2] = llc;
+                o.latency[3] = mem;
+            }
+            else {
+                std::cerr << "Invalid option: " << arg << '\n';
+                return false;
+            }
+        }
+        for (int k = 1; k < simulator::hierarchy::levels; ++k)
+            if (o.level[k].block != o.level[0].block) {
+                std::cerr << "All levels must have the same block size\n";
+                return false;
+            }
+        return true;
+    }
+}  // namespace
+
+/** Driver Code */
+int main(int argc, char* argv[]) {
+    simulator::hierarchy::options o;
+    if (argc < 2 || !parse_options(argc, argv, o)) {
+        std::cerr << "Usage: " << argv[0] << " <trace> [--l1 cfg] [--l2 cfg] [--llc cfg]"
+            << " [--exclusive] [--instr]\n       [--next-line N] [--stride N]"
+            << " [--hw-level 1|2] [--latency L2,LLC,MEM]\n";
+        return 2;
+    }
+
+    simulator::mapped_file trace;
+    if (!trace.open(argv[1]))
+        return 1;
+    simulator::hierarchy::hierarchy h(o);
+    std::vector<simulator::lackey::access> buffer(chunk);
+    uint64_t skipped = 0;
+    if (simulator::binary::reader::is_binary(trace)) {
+        trace.close();
+        simulator::binary::reader in;
+        if (!in.open(argv[1]))
+            return 1;
+        for (size_t k = 0; k < in.blocks().size(); ++k) {
+            if (!in.accesses(k, buffer))
+                return 1;
+            h.run(buffer.data(), buffer.size());
+        }
+    }
+    else {
+        simulator::lackey::access_scanner scanner(trace.begin(), trace.end());
+        size_t n;
+        while ((n = scanner.read(buffer.data(), chunk)) > 0)
+            h.run(buffer.data(), n);
+        skipped = scanner.skipped();
+    }
+    h.finish();
+
+    std::cout << (o.exclusive ? "exclusive" : "inclusive") << " hierarchy\n"
+        << std::left << std::setw(6) << "level" << std::setw(22) << "cache" << std::right
+        << std::setw(14) << "accesses" << std::setw(14) << "misses" << std::setw(9)
+        << "miss %" << '\n';
+    for (int k = 0; k < simulator::hierarchy::levels; ++k) {
+        const simulator::hierarchy::level_stats& s = h.level(k);
+        std::cout << std::left << std::setw(6) << level_names[k] << std::setw(22)
+            << o.level[k].name() << std::right << std::setw(14) << s.accesses
+            << std::setw(14) << s.accesses - s.hits << std::fixed << std::setprecision(2)
+            << std::setw(9) << rate(s.accesses - s.hits, s.accesses) << '\n';
+    }
+    std::cout << "memory reads " << h.memory_reads() << ", writes " << h.memory_writes() << "\n\n";
+
+    std::cout << std::left << std::setw(13) << "prefetch" << std::right << std::setw(12)
+        << "issued" << std::setw(12) << "redundant" << std::setw(12) << "useful"
+        << std::setw(12) << "late" << std::setw(12) << "useless" << std::setw(11)
+        << "accuracy" << '\n';
+    for (int s = simulator::hierarchy::sw_t0; s < simulator::hierarchy::sources; ++s) {
+        const simulator::hierarchy::prefetch_stats& p = h.prefetches(s);
+        if (p.issued == 0)
+            continue;
+        std::cout << std::left << std::setw(13) << simulator::hierarchy::source_name(s)
+            << std::right << std::setw(12) << p.issued << std::setw(12) << p.redundant
+            << std::setw(12) << p.useful << std::setw(12) << p.late << std::setw(12)
+            << p.useless << std::setw(10)
+            << rate(p.useful + p.late, p.useful + p.late + p.useless) << "%\n";
+    }
+    if (skipped)
+        std::cerr << skipped << " lines skipped\n";
+    return 0;
+}
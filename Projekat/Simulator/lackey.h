@@ -0,0 +1,253 @@
+#pragma once
+/**
+ * @file
+ * @brief Scanners of Valgrind Lackey branch and memory traces
+ *
+ * @details
+ * A branch record is one line `B  04c72425 T` (address in hex, `T` taken,
+ * `N` not taken), as in `HelloTrace.txt`. Lines starting with `==pid==` are
+ * Valgrind banners and are skipped, as is anything else that is not a
+ * branch record.
+ *
+ * The scanner works on the raw bytes of a mapped file. A line in the exact
+ * layout Lackey writes (8 digits, 14 bytes with the newline) is checked at
+ * fixed offsets and decoded by an unrolled table lookup per digit, without
+ * looking for the end of the line. Other branch lines (wider addresses,
+ * extra spaces, CRLF) take a general path that finds the end of the line
+ * with `memchr`, which the C library implements with SIMD compares, as do
+ * banner lines.
+ *
+ * Memory traces (`--trace-mem=yes`) have one line per access, see `access`;
+ * `access_scanner` reads them the same way.
+ */
+
+#include <cstddef>  /// for size_t
+#include <cstdint>  /// for uint64_t
+#include <cstring>  /// for memchr
+
+namespace simulator {
+    namespace lackey {
+        /**
+         * One conditional branch of the trace.
+         */
+        struct branch {
+            uint64_t pc;  /// address of the branch instruction
+            bool taken;   /// outcome
+        };
+
+        namespace detail {
+            /**
+             * Value of every hex digit, -1 for other characters.
+             */
+            struct hex_table {
+                signed char value[256];
+                hex_table() {
+                    for (int c = 0; c < 256; ++c)
+                        value[c] = -1;
+                    for (int c = '0'; c <= '9'; ++c)
+                        value[c] = static_cast<signed char>(c - '0');
+                    for (int c = 'a'; c <= 'f'; ++c)
+                        value[c] = static_cast<signed char>(c - 'a' + 10);
+                    for (int c = 'A'; c <= 'F'; ++c)
+                        value[c] = static_cast<signed char>(c - 'A' + 10);
+                }
+            };
+
+            inline const hex_table& hex() {
+                static const hex_table table;
+                return table;
+            }
+
+            /**
+             * Start of the line after the one `p` is in.
+             */
+            inline const char* next_line(const char* p, const char* end) {
+                const void* nl = memchr(p, '\n', static_cast<size_t>(end - p));
+                return nl ? static_cast<const char*>(nl) + 1 : end;
+            }
+        }  // namespace detail
+
+        /**
+         * Resumable scanner over the branch records of `[begin, end)`.
+         */
+        class branch_scanner {
+         public:
+            branch_scanner(const char* begin, const char* end)
+                : p_(begin), begin_(begin), end_(end) {}
+
+            /**
+             * Decodes up to `max` branches into `out`.
+             * @returns number of branches decoded, 0 at the end of the trace
+             */
+            size_t read(branch* out, size_t max) {
+                const signed char* hex = detail::hex().value;
+                const char* p = p_;
+                const char* const end = end_;
+                size_t n = 0;
+                while (n < max && p < end) {
+                    if (*p != 'B') {
+                        // banner or anything else
+                        if (*p != '=' && *p != '\n')
+                            skipped_++;
+                        p = detail::next_line(p, end);
+                        continue;
+                    }
+                    // fast path: the fixed layout "B  xxxxxxxx T\n"
+                    // that Lackey writes for 32-bit addresses, with
+                    // one unrolled, branch-free digit loop
+                    if (end - p >= 14 && p[1] == ' ' && p[2] == ' ' &&
+                        p[11] == ' ' && (p[12] == 'T' || p[12] == 'N') &&
+                        p[13] == '\n') {
+                        uint64_t pc = 0;
+                        int bad = 0;
+                        for (int k = 3; k < 11; ++k) {
+                            const signed char d = hex[static_cast<unsigned char>(p[k])];
+                            bad |= d;
+                            pc = pc << 4 | static_cast<uint64_t>(d & 15);
+                        }
+                        if (bad >= 0) {
+                            out[n].pc = pc;
+                            out[n].taken = p[12] == 'T';
+                            n++;
+                            p += 14;
+                            continue;
+                        }
+                    }
+                    const char* q = p + 1;
+                    while (q < end && *q == ' ')
+                        q++;
+                    uint64_t pc = 0;
+                    int digits = 0;
+                    signed char d;
+                    while (q < end && (d = hex[static_cast<unsigned char>(*q)]) >= 0) {
+                        pc = pc << 4 | static_cast<uint64_t>(d);
+                        q++;
+                        digits++;
+                    }
+                    if (q + 1 < end && *q == ' ' && (q[1] == 'T' || q[1] == 'N') &&
+                        (q + 2 == end || q[2] == '\n' || q[2] == '\r') &&
+                        digits > 0 && digits <= 16) {
+                        out[n].pc = pc;
+                        out[n].taken = q[1] == 'T';
+                        n++;
+                        q += 2;
+                        p = q < end && *q == '\n' ? q + 1 : detail::next_line(q, end);
+                    }
+                    else {
+                        skipped_++;
+                        p = detail::next_line(p, end);
+                    }
+                }
+                p_ = p;
+                return n;
+            }
+
+            /** Number of non-empty lines that were neither branches nor banners. */
+            uint64_t skipped() const { return skipped_; }
+
+            /** Bytes consumed so far. */
+            size_t position() const { return static_cast<size_t>(p_ - begin_); }
+
+         private:
+            const char* p_;
+            const char* begin_;
+            const char* end_;
+            uint64_t skipped_ = 0;
+        };
+
+        /**
+         * One memory access of a Lackey memory trace: `I  0023c790,2`
+         * (instruction fetch), ` L 1ffefff8c8,8` (load), ` S ...` (store) or
+         * ` M ...` (modify, a load and a store of the same data).
+         *
+         * Lackey drops prefetch instructions, so traces that should keep them
+         * (written by hand or by an instrumented program) use the extra
+         * records `P0`, `P1`, `P2` and `PN` in the same layout, e.g.
+         * `P0 1ffefff8c0,64`, for `PREFETCHT0/T1/T2/NTA`.
+         */
+        struct access {
+            uint64_t address;
+            uint32_t size;
+            char type;  /// 'I', 'L', 'S', 'M', or 'P' for a software prefetch
+            char hint;  /// prefetch hint '0', '1', '2' or 'N', 0 otherwise
+        };
+
+        /**
+         * Resumable scanner over the memory accesses of `[begin, end)`.
+         * Branch records, banners and other lines are skipped.
+         */
+        class access_scanner {
+         public:
+            access_scanner(const char* begin, const char* end)
+                : p_(begin), begin_(begin), end_(end) {}
+
+            /**
+             * Decodes up to `max` accesses into `out`.
+             * @returns number of accesses decoded, 0 at the end of the trace
+             */
+            size_t read(access* out, size_t max) {
+                const signed char* hex = detail::hex().value;
+                const char* p = p_;
+                const char* const end = end_;
+                size_t n = 0;
+                while (n < max && p < end) {
+                    char type = 0, hint = 0;
+                    if (end - p >= 3) {
+                        if (p[0] == 'I' && p[1] == ' ' && p[2] == ' ')
+                            type = 'I';
+                        else if (p[0] == 'P' && p[2] == ' ' &&
+                            (p[1] == '0' || p[1] == '1' || p[1] == '2' || p[1] == 'N')) {
+                            type = 'P';
+                            hint = p[1];
+                        }
+                        else if (p[0] == ' ' && p[2] == ' ' &&
+                            (p[1] == 'L' || p[1] == 'S' || p[1] == 'M'))
+                            type = p[1];
+                    }
+                    if (!type) {
+                        p = detail::next_line(p, end);
+                        continue;
+                    }
+                    const char* q = p + 3;
+                    while (q < end && *q == ' ')
+                        q++;
+                    uint64_t address = 0;
+                    signed char d;
+                    const char* digits = q;
+                    while (q < end && (d = hex[static_cast<unsigned char>(*q)]) >= 0) {
+                        address = address << 4 | static_cast<uint64_t>(d);
+                        q++;
+                    }
+                    if (q == digits || q - digits > 16 || q >= end || *q != ',') {
+                        skipped_++;
+                        p = detail::next_line(p, end);
+                        continue;
+                    }
+                    uint32_t size = 0;
+                    for (q++; q < end && *q >= '0' && *q <= '9'; ++q)
+                        size = size * 10 + static_cast<uint32_t>(*q - '0');
+                    out[n].address = address;
+                    out[n].size = size;
+                    out[n].type = type;
+                    out[n].hint = hint;
+                    n++;
+                    p = q < end && *q == '\n' ? q + 1 : detail::next_line(q, end);
+                }
+                p_ = p;
+                return n;
+            }
+
+            /** Number of access lines that could not be decoded. */
+            uint64_t skipped() const { return skipped_; }
+
+            /** Bytes consumed so far. */
+            size_t position() const { return static_cast<size_t>(p_ - begin_); }
+
+         private:
+            const char* p_;
+            const char* begin_;
+            const char* end_;
+            uint64_t skipped_ = 0;
+        };
+    }  // namespace lackey
+}  // namespace simulator
@@ -0,0 +1,95 @@
+#pragma once
+/**
+ * @file
+ * @brief Read-only memory mapped file
+ *
+ * @details
+ * Traces are read through `mmap` instead of streams: the scanners walk the
+ * bytes in place, without copies or per-line allocations, and the kernel
+ * reads ahead (`MADV_SEQUENTIAL`). POSIX only.
+ */
+
+#include <fcntl.h>     /// for open
+#include <limits.h>    /// for PATH_MAX
+#include <sys/mman.h>  /// for mmap, madvise
+#include <sys/stat.h>  /// for fstat
+#include <unistd.h>    /// for close
+
+#include <cstddef>   /// for size_t
+#include <cstdlib>   /// for realpath
+#include <cstring>   /// for strerror
+#include <cerrno>    /// for errno
+#include <iostream>  /// for error messages
+#include <string>    /// for std::string
+
+namespace simulator {
+    /**
+     * Whole file mapped read-only for its lifetime.
+     */
+    class mapped_file {
+     public:
+        mapped_file() = default;
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+        ~mapped_file() { close(); }
+
+        /**
+         * Maps `path`. On failure prints the reason to `std::cerr`.
+         * @returns true if the file is mapped (an empty file is, with size 0)
+         */
+        bool open(const std::string& path) {
+            close();
+            int fd = ::open(path.c_str(), O_RDONLY);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0) {
+                std::cerr << path << ": " << strerror(errno) << '\n';
+                if (fd >= 0)
+                    ::close(fd);
+                return false;
+            }
+            size_ = static_cast<size_t>(st.st_size);
+            if (size_ > 0) {
+                void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p == MAP_FAILED) {
+                    std::cerr << path << ": " << strerror(errno) << '\n';
+                    ::close(fd);
+                    size_ = 0;
+                    return false;
+                }
+                madvise(p, size_, MADV_SEQUENTIAL);
+                data_ = static_cast<const char*>(p);
+            }
+            ::close(fd);
+            return true;
+        }
+
+        void close() {
+            if (data_)
+                munmap(const_cast<char*>(data_), size_);
+            data_ = nullptr;
+            size_ = 0;
+        }
+
+        const char* begin() const { return data_; }
+        const char* end() const { return data_ + size_; }
+        size_t size() const { return size_; }
+
+     private:
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    /**
+     * "<bytes> <mtime ns> <absolute path>" of `path` as it is now, to tell
+     * whether results saved for a trace still belong to it; "" if the file
+     * can not be read.
+     */
+    inline std::string file_identity(const std::string& path) {
+        struct stat st;
+        char full[PATH_MAX];
+        if (stat(path.c_str(), &st) != 0 || !realpath(path.c_str(), full))
+            return "";
+        return std::to_string(st.st_size) + ' ' +
+            std::to_string(st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec) + ' ' + full;
+    }
+}  // namespace simulator
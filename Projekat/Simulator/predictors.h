@@ -0,0 +1,437 @@
+#pragma once
+/**
+ * @file
+ * @brief Bimodal, gshare, e-gskew and 2bc-gskew branch predictors
+ *
+ * @details
+ * Native versions of the predictors of `Zadatak 2/deo 1`. All tables are
+ * 2-bit saturating counters packed 32 to a 64-bit word, so a 64K-entry
+ * table takes 16 KiB. The banks of e-gskew and 2bc-gskew are indexed like
+ * in `EGskew.java`: the bimodal bank by the address, bank 1 by
+ * `address ^ history` and bank 2 (and the meta table) by
+ * `address ^ (history >> 2)`.
+ *
+ * Update policies follow the published predictors (Michaud, Seznec and
+ * Uhlig; Seznec et al. for the EV8 2bc-gskew):
+ *  - e-gskew predicts the majority of its three banks; on a misprediction
+ *    all banks are updated, on a correct one only the banks that agreed
+ *    with the majority (partial update).
+ *  - 2bc-gskew chooses between the bimodal bank and the e-gskew majority
+ *    with the meta table, which is updated only when the two disagree.
+ *    On a correct prediction only the banks that took part in it are
+ *    strengthened, on a misprediction all three banks are updated.
+ *
+ * Every predictor is a `predictor`, but the loop over a chunk of branches
+ * is instantiated per type (`predictor_impl`), so there is one virtual call
+ * per chunk and none per branch. `make` builds a predictor from a textual
+ * configuration such as `gshare:14:12`.
+ *
+ * `run_profiled` also counts mispredictions per static branch and, per
+ * table (bank), the accesses to an entry last used by another branch
+ * (aliasing) and those of them where the entry predicted wrong
+ * (destructive aliasing). The predictors report every table they read to
+ * a probe; `run` passes one that does nothing, so it is compiled away.
+ */
+
+#include <cstddef>  /// for size_t
+#include <cstdint>  /// for uint64_t
+#include <cstdlib>  /// for strtoul
+#include <memory>   /// for std::unique_ptr
+#include <string>   /// for std::string
+#include <vector>   /// for std::vector
+
+#include "lackey.h"
+
+namespace simulator {
+    namespace predictors {
+        /**
+         * Table of `2^log_size` 2-bit saturating counters, bit-packed.
+         * Values 0 and 1 predict not taken, 2 and 3 taken.
+         */
+        class counter_table {
+         public:
+            /**
+             * @param log_size log2 of the number of counters
+             * @param init initial value of every counter (default weakly
+             * not taken)
+             */
+            explicit counter_table(unsigned log_size, unsigned init = 1)
+                : mask_((uint64_t(1) << log_size) - 1),
+                  words_(((uint64_t(1) << log_size) + 31) / 32,
+                      (init & 3) * 0x5555555555555555ULL) {}
+
+            unsigned get(uint64_t i) const {
+                i &= mask_;
+                return static_cast<unsigned>(words_[i >> 5] >> ((i & 31) * 2)) & 3;
+            }
+
+            bool taken(uint64_t i) const { return get(i) >= 2; }
+
+            /**
+             * Moves counter `i` one step towards `taken` if `enable`. The
+             * partial update policies are data dependent and hard to
+             * predict, so they are applied without branches.
+             */
+            void update(uint64_t i, bool taken, bool enable = true) {
+                i &= mask_;
+                uint64_t& w = words_[i >> 5];
+                const unsigned shift = static_cast<unsigned>(i & 31) * 2;
+                const unsigned c = static_cast<unsigned>(w >> shift) & 3;
+                const unsigned n = c + (taken & (c != 3)) - (!taken & (c != 0));
+                w ^= static_cast<uint64_t>((c ^ n) & (0u - enable)) << shift;
+            }
+
+            uint64_t mask() const { return mask_; }
+            size_t bits() const { return (mask_ + 1) * 2; }
+
+         private:
+            uint64_t mask_;
+            std::vector<uint64_t> words_;
+        };
+
+        /**
+         * Global history of the last `bits` outcomes, newest in bit 0.
+         */
+        class history {
+         public:
+            explicit history(unsigned bits)
+                : mask_(bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1) {}
+
+            void push(bool taken) { value_ = ((value_ << 1) | taken) & mask_; }
+            uint64_t value() const { return value_; }
+
+         private:
+            uint64_t mask_;
+            uint64_t value_ = 0;
+        };
+
+        /** Aliasing in one table of a predictor. */
+        struct bank_stats {
+            const char* name;
+            uint64_t accesses = 0;
+            uint64_t aliased = 0;      /// entry last used by another branch
+            uint64_t destructive = 0;  /// aliased and predicting wrong
+        };
+
+        /**
+         * Probe of `run`: ignores the tables.
+         */
+        struct no_probe {
+            void bank(int, uint64_t, bool, bool) {}
+        };
+
+        /**
+         * Common interface: name, size and statistics of a predictor that is
+         * fed a chunk of branches at a time.
+         */
+        class predictor {
+         public:
+            virtual ~predictor() = default;
+
+            /** Configuration, as accepted by `make`. */
+            virtual std::string name() const = 0;
+
+            /** Bits of state (counters and history). */
+            virtual size_t storage_bits() const = 0;
+
+            /** Predicts and then updates with every branch of `b[0..n)`. */
+            virtual void run(const lackey::branch* b, size_t n) = 0;
+
+            /**
+             * `run` that also fills `site_mispredictions` and `site_aliased`
+             * (indexed by `site[i]`, the id of the address of `b[i]`) and
+             * `banks`.
+             */
+            virtual void run_profiled(const lackey::branch* b, const uint32_t* site, size_t n) = 0;
+
+            uint64_t branches = 0;        /// branches seen
+            uint64_t mispredictions = 0;  /// wrong predictions
+
+            std::vector<uint64_t> site_mispredictions;
+            std::vector<uint64_t> site_aliased;  /// aliased table accesses
+            std::vector<bank_stats> banks;
+        };
+
+        /**
+         * `run` for predictor type `P`, which provides
+         * `bool access(uint64_t pc, bool taken)`: returns the prediction and
+         * updates the state with the outcome.
+         */
+        template <class P>
+        class predictor_impl : public predictor {
+         public:
+            void run(const lackey::branch* b, size_t n) override {
+                P& self = static_cast<P&>(*this);
+                no_probe none;
+                uint64_t wrong = 0;
+                for (size_t i = 0; i < n; ++i)
+                    wrong += self.access(b[i].pc, b[i].taken, none) != b[i].taken;
+                branches += n;
+                mispredictions += wrong;
+            }
+
+            void run_profiled(const lackey::branch* b, const uint32_t* site, size_t n) override {
+                P& self = static_cast<P&>(*this);
+                if (owners_.empty()) {
+                    const char* const* names = self.bank_names();
+                    for (int k = 0; k < P::tables; ++k)
+                        banks.push_back(bank_stats{names[k]});
+                    owners_.assign(size_t(P::tables) << self.log_size(), ~uint64_t(0));
+                }
+                alias_probe probe{this, 0, 0, (uint64_t(1) << self.log_size()) - 1};
+                for (size_t i = 0; i < n; ++i) {
+                    if (site[i] >= site_mispredictions.size()) {
+                        site_mispredictions.resize(site[i] + 1);
+                        site_aliased.resize(site[i] + 1);
+                    }
+                    probe.pc = b[i].pc;
+                    probe.site = site[i];
+                    const bool wrong = self.access(b[i].pc, b[i].taken, probe) != b[i].taken;
+                    site_mispredictions[site[i]] += wrong;
+                    mispredictions += wrong;
+                }
+                branches += n;
+            }
+
+         private:
+            /**
+             * Remembers the last branch to use every entry and counts the
+             * accesses to entries of other branches.
+             */
+            struct alias_probe {
+                predictor_impl* self;
+                uint64_t pc;
+                uint32_t site;
+                uint64_t mask;
+
+                void bank(int k, uint64_t index, bool prediction, bool taken) {
+                    bank_stats& s = self->banks[k];
+                    uint64_t& owner = self->owners_[uint64_t(k) * (mask + 1) + (index & mask)];
+                    s.accesses++;
+                    if (owner != pc && owner != ~uint64_t(0)) {
+                        s.aliased++;
+                        s.destructive += prediction != taken;
+                        self->site_aliased[site]++;
+                    }
+                    owner = pc;
+                }
+            };
+
+            std::vector<uint64_t> owners_;  /// last branch per entry, table by table
+        };
+
+        /**
+         * Counters indexed by the branch address.
+         */
+        class bimodal : public predictor_impl<bimodal> {
+         public:
+            static constexpr int tables = 1;
+
+            explicit bimodal(unsigned log_size) : log_size_(log_size), table_(log_size) {}
+
+            template <class Probe>
+            bool access(uint64_t pc, bool taken, Probe& probe) {
+                const bool p = table_.taken(pc);
+                probe.bank(0, pc, p, taken);
+                table_.update(pc, taken);
+                return p;
+            }
+
+            const char* const* bank_names() const {
+                static const char* const names[] = {"table"};
+                return names;
+            }
+            unsigned log_size() const { return log_size_; }
+
+            std::string name() const override {
+                return "bimodal:" + std::to_string(log_size_);
+            }
+            size_t storage_bits() const override { return table_.bits(); }
+
+         private:
+            unsigned log_size_;
+            counter_table table_;
+        };
+
+        /**
+         * Counters indexed by the address xor the global history.
+         */
+        class gshare : public predictor_impl<gshare> {
+         public:
+            static constexpr int tables = 1;
+
+            gshare(unsigned log_size, unsigned history_bits)
+                : log_size_(log_size), history_bits_(history_bits),
+                  table_(log_size), history_(history_bits) {}
+
+            template <class Probe>
+            bool access(uint64_t pc, bool taken, Probe& probe) {
+                const uint64_t i = pc ^ history_.value();
+                const bool p = table_.taken(i);
+                probe.bank(0, i, p, taken);
+                table_.update(i, taken);
+                history_.push(taken);
+                return p;
+            }
+
+            const char* const* bank_names() const {
+                static const char* const names[] = {"table"};
+                return names;
+            }
+            unsigned log_size() const { return log_size_; }
+
+            std::string name() const override {
+                return "gshare:" + std::to_string(log_size_) + ":" +
+                    std::to_string(history_bits_);
+            }
+            size_t storage_bits() const override {
+                return table_.bits() + history_bits_;
+            }
+
+         private:
+            unsigned log_size_, history_bits_;
+            counter_table table_;
+            history history_;
+        };
+
+        /**
+         * Enhanced skewed predictor: majority of a bimodal bank and two
+         * history-indexed banks, with partial update.
+         */
+        class egskew : public predictor_impl<egskew> {
+         public:
+            static constexpr int tables = 3;
+
+            egskew(unsigned log_size, unsigned history_bits)
+                : log_size_(log_size), history_bits_(history_bits),
+                  bim_(log_size), g1_(log_size), g2_(log_size),
+                  history_(history_bits) {}
+
+            template <class Probe>
+            bool access(uint64_t pc, bool taken, Probe& probe) {
+                const uint64_t h = history_.value();
+                const uint64_t i1 = pc ^ h, i2 = pc ^ (h >> 2);
+                const bool b = bim_.taken(pc), p1 = g1_.taken(i1), p2 = g2_.taken(i2);
+                const bool p = (b + p1 + p2) >= 2;
+                probe.bank(0, pc, b, taken);
+                probe.bank(1, i1, p1, taken);
+                probe.bank(2, i2, p2, taken);
+                const bool wrong = p != taken;
+                bim_.update(pc, taken, wrong | (b == p));
+                g1_.update(i1, taken, wrong | (p1 == p));
+                g2_.update(i2, taken, wrong | (p2 == p));
+                history_.push(taken);
+                return p;
+            }
+
+            const char* const* bank_names() const {
+                static const char* const names[] = {"bim", "g0", "g1"};
+                return names;
+            }
+            unsigned log_size() const { return log_size_; }
+
+            std::string name() const override {
+                return "egskew:" + std::to_string(log_size_) + ":" +
+                    std::to_string(history_bits_);
+            }
+            size_t storage_bits() const override {
+                return 3 * bim_.bits() + history_bits_;
+            }
+
+         private:
+            unsigned log_size_, history_bits_;
+            counter_table bim_, g1_, g2_;
+            history history_;
+        };
+
+        /**
+         * 2bc-gskew: a meta predictor chooses between the bimodal bank and
+         * the e-gskew majority.
+         */
+        class bc2gskew : public predictor_impl<bc2gskew> {
+         public:
+            static constexpr int tables = 4;
+
+            bc2gskew(unsigned log_size, unsigned history_bits)
+                : log_size_(log_size), history_bits_(history_bits),
+                  bim_(log_size), g1_(log_size), g2_(log_size), meta_(log_size),
+                  history_(history_bits) {}
+
+            template <class Probe>
+            bool access(uint64_t pc, bool taken, Probe& probe) {
+                const uint64_t h = history_.value();
+                const uint64_t i1 = pc ^ h, i2 = pc ^ (h >> 2);
+                const bool b = bim_.taken(pc), p1 = g1_.taken(i1), p2 = g2_.taken(i2);
+                const bool skew = (b + p1 + p2) >= 2;
+                const bool use_bim = meta_.taken(i2);
+                const bool p = use_bim ? b : skew;
+                probe.bank(0, pc, b, taken);
+                probe.bank(1, i1, p1, taken);
+                probe.bank(2, i2, p2, taken);
+                // the meta entry predicts "the bimodal bank is right"
+                probe.bank(3, i2, use_bim, b == taken);
+
+                // a wrong prediction updates all banks, a correct one
+                // strengthens only what made it
+                const bool wrong = p != taken;
+                bim_.update(pc, taken, wrong | use_bim | (b == p));
+                g1_.update(i1, taken, wrong | (!use_bim & (p1 == p)));
+                g2_.update(i2, taken, wrong | (!use_bim & (p2 == p)));
+                meta_.update(i2, b == taken, b != skew);
+                history_.push(taken);
+                return p;
+            }
+
+            const char* const* bank_names() const {
+                static const char* const names[] = {"bim", "g0", "g1", "meta"};
+                return names;
+            }
+            unsigned log_size() const { return log_size_; }
+
+            std::string name() const override {
+                return "2bcgskew:" + std::to_string(log_size_) + ":" +
+                    std::to_string(history_bits_);
+            }
+            size_t storage_bits() const override {
+                return 4 * bim_.bits() + history_bits_;
+            }
+
+         private:
+            unsigned log_size_, history_bits_;
+            counter_table bim_, g1_, g2_, meta_;
+            history history_;
+        };
+
+        /**
+         * Builds a predictor from `kind:log_size[:history_bits]`, kind one of
+         * `bimodal`, `gshare`, `egskew`, `2bcgskew`. History defaults to
+         * `log_size` bits.
+         * @returns nullptr if the configuration is not valid
+         */
+        inline std::unique_ptr<predictor> make(const std::string& config) {
+            const size_t c1 = config.find(':');
+            if (c1 == std::string::npos)
+                return nullptr;
+            const std::string kind = config.substr(0, c1);
+            char* rest;
+            const unsigned long log_size = strtoul(config.c_str() + c1 + 1, &rest, 10);
+            unsigned long hist = log_size;
+            if (*rest == ':')
+                hist = strtoul(rest + 1, &rest, 10);
+            if (*rest != '\0' || log_size < 1 || log_size > 30 || hist > 64)
+                return nullptr;
+
+            const unsigned n = static_cast<unsigned>(log_size);
+            const unsigned h = static_cast<unsigned>(hist);
+            if (kind == "bimodal")
+                return std::unique_ptr<predictor>(new bimodal(n));
+            if (kind == "gshare")
+                return std::unique_ptr<predictor>(new gshare(n, h));
+            if (kind == "egskew")
+                return std::unique_ptr<predictor>(new egskew(n, h));
+            if (kind == "2bcgskew")
+                return std::unique_ptr<predictor>(new bc2gskew(n, h));
+            return nullptr;
+        }
+    }  // namespace predictors
+}  // namespace simulator
@@ -0,0 +1,230 @@
+#pragma once
+/**
+ * @file
+ * @brief Per-address (per static branch or access site) reports
+ *
+ * @details
+ * `sites` numbers the distinct addresses of a trace so the simulators can
+ * keep their per-site counters in plain vectors. A `report` is a table with
+ * one row per site, ranked by one value, written as CSV or JSON (chosen by
+ * the file extension). With a `symbols` table from `nm -nS` output the rows
+ * also name the function and offset of the address:
+ *
+ *     nm -nS Hello > Hello.sym
+ *     ./branch_sim HelloTrace.txt --profile hot.csv --symbols Hello.sym
+ *
+ * Valgrind loads position-independent executables at 0x108000, so the
+ * symbols of such a program need `--load-address 108000`.
+ */
+
+#include <algorithm>      /// for std::sort
+#include <cmath>          /// for std::floor
+#include <cstdint>        /// for uint64_t
+#include <cstdio>         /// for snprintf
+#include <cstdlib>        /// for strtoull
+#include <fstream>        /// for std::ifstream, std::ofstream
+#include <iostream>       /// for error messages
+#include <string>         /// for std::string
+#include <unordered_map>  /// for std::unordered_map
+#include <vector>         /// for std::vector
+
+namespace simulator {
+    namespace profile {
+        /**
+         * Dense ids for addresses, in order of first appearance.
+         */
+        class sites {
+         public:
+            uint32_t id(uint64_t address) {
+                const auto it = ids_.emplace(address, static_cast<uint32_t>(addresses_.size()));
+                if (it.second)
+                    addresses_.push_back(address);
+                return it.first->second;
+            }
+
+            size_t size() const { return addresses_.size(); }
+            uint64_t address(size_t id) const { return addresses_[id]; }
+
+         private:
+            std::unordered_map<uint64_t, uint32_t> ids_;
+            std::vector<uint64_t> addresses_;
+        };
+
+        /**
+         * Function symbols of a program, from `nm` output. Without sizes
+         * (`nm -n`) a function ends where the next one starts, and a last
+         * function without a size is left out, as nothing bounds it.
+         */
+        class symbols {
+         public:
+            /**
+             * Reads the text symbols (`t`, `T`, and `W` with a size) of `path`
+             * and adds `load_address` to them. Weak symbols without a size
+             * are left out: `w` ones are undefined, and `W` ones may be data
+             * such as `data_start`. Errors are printed to `std::cerr`.
+             * @returns true on success
+             */
+            bool load(const std::string& path, uint64_t load_address = 0) {
+                std::ifstream in(path);
+                if (!in) {
+                    std::cerr << path << ": can not open\n";
+                    return false;
+                }
+                std::string line;
+                while (std::getline(in, line)) {
+                    // "address [size] type name"
+                    const char* p = line.c_str();
+                    char* end;
+                    const uint64_t a = strtoull(p, &end, 16);
+                    if (end == p || *end != ' ')
+                        continue;
+                    uint64_t size = 0;
+                    p = end + 1;
+                    const uint64_t s = strtoull(p, &end, 16);
+                    if (end > p + 1 && *end == ' ') {
+                        size = s;
+                        p = end + 1;
+                    }
+                    if (p[0] == '\0' || p[1] != ' ')
+                        continue;
+                    if (p[0] == 't' || p[0] == 'T' || (p[0] == 'W' && size))
+                        table_.push_back({a + load_address, size, std::string(p + 2)});
+                }
+                std::sort(table_.begin(), table_.end(),
+                    [](const symbol& x, const symbol& y) { return x.start < y.start; });
+                for (size_t i = 0; i + 1 < table_.size(); ++i)
+                    if (table_[i].size == 0)
+                        table_[i].size = table_[i + 1].start - table_[i].start;
+                while (!table_.empty() && table_.back().size == 0)
+                    table_.pop_back();
+                return true;
+            }
+
+            bool empty() const { return table_.empty(); }
+
+            /** `function+0xoffset` of `address`, or "" if it is in no function. */
+            std::string name(uint64_t address) const {
+                auto it = std::upper_bound(table_.begin(), table_.end(), address,
+                    [](uint64_t a, const symbol& x) { return a < x.start; });
+                if (it == table_.begin())
+                    return "";
+                --it;
+                if (address - it->start >= it->size)
+                    return "";
+                char offset[24];
+                snprintf(offset, sizeof(offset), "+0x%llx",
+                    static_cast<unsigned long long>(address - it->start));
+                return it->name + offset;
+            }
+
+         private:
+            struct symbol {
+                uint64_t start, size;
+                std::string name;
+            };
+
+            std::vector<symbol> table_;
+        };
+
+        /**
+         * Rows of values per site, ranked by `rank` (largest first).
+         */
+        class report {
+         public:
+            explicit report(std::vector<std::string> columns) : columns_(std::move(columns)) {}
+
+            void add(uint64_t address, std::vector<double> values, double rank) {
+                rows_.push_back({address, std::move(values), rank});
+            }
+
+            /**
+             * Writes the ranked rows to `path`: JSON if it ends in `.json`,
+             * CSV otherwise. `limit` rows at most, 0 for all.
+             * @returns true on success
+             */
+            bool write(const std::string& path, const symbols& sym, size_t limit = 0) {
+                std::stable_sort(rows_.begin(), rows_.end(),
+                    [](const row& a, const row& b) { return a.rank > b.rank; });
+                const size_t n = limit && limit < rows_.size() ? limit : rows_.size();
+                const bool json = path.size() >= 5 &&
+                    path.compare(path.size() - 5, 5, ".json") == 0;
+
+                std::ofstream out(path);
+                if (!out) {
+                    std::cerr << path << ": can not create\n";
+                    return false;
+                }
+                if (json)
+                    out << "[\n";
+                else {
+                    out << "address,symbol";
+                    for (const std::string& c : columns_)
+                        out << ',' << c;
+                    out << '\n';
+                }
+                for (size_t r = 0; r < n; ++r) {
+                    const row& x = rows_[r];
+                    char address[24];
+                    snprintf(address, sizeof(address), "%llx",
+                        static_cast<unsigned long long>(x.address));
+                    const std::string name = sym.empty() ? "" : sym.name(x.address);
+                    if (json) {
+                        out << "  {\"address\": \"" << address << "\", \"symbol\": \"";
+                        escape(out, name);
+                        out << '"';
+                        for (size_t c = 0; c < columns_.size(); ++c) {
+                            out << ", \"" << columns_[c] << "\": ";
+                            number(out, x.values[c]);
+                        }
+                        out << (r + 1 < n ? "},\n" : "}\n");
+                    }
+                    else {
+                        out << address << ',' << name;
+                        for (double v : x.values) {
+                            out << ',';
+                            number(out, v);
+                        }
+                        out << '\n';
+                    }
+                }
+                if (json)
+                    out << "]\n";
+                out.close();
+                if (!out) {
+                    std::cerr << path << ": write error\n";
+                    return false;
+                }
+                return true;
+            }
+
+         private:
+            struct row {
+                uint64_t address;
+                std::vector<double> values;
+                double rank;
+            };
+
+            /** Counts as integers, rates with 4 decimals. */
+            static void number(std::ostream& out, double v) {
+                if (v == std::floor(v) && v < 9007199254740992.0)
+                    out << static_cast<unsigned long long>(v);
+                else {
+                    char buf[32];
+                    snprintf(buf, sizeof(buf), "%.4f", v);
+                    out << buf;
+                }
+            }
+
+            static void escape(std::ostream& out, const std::string& s) {
+                for (char c : s) {
+                    if (c == '"' || c == '\\')
+                        out << '\\';
+                    out << c;
+                }
+            }
+
+            std::vector<std::string> columns_;
+            std::vector<row> rows_;
+        };
+    }  // namespace profile
+}  // namespace simulator
@@ -0,0 +1,470 @@
+/**
+ * @file
+ * @brief Sampled (SimPoint) simulation of branch predictors or caches
+ *
+ * @details
+ *     g++ -O3 -march=native -std=c++14 sample_sim.cpp -o sample_sim
+ *     ./sample_sim big.trc gshare:14:12 2bcgskew:12:10 --interval 100000 --validate
+ *     ./sample_sim mem.txt 32K:8:64:lru 32K:8:64:slru --warmup 2 --plan mem.plan
+ *
+ * Configurations are those of `branch_sim` or of `cache_sim` (all of the
+ * same kind). One pass over the trace computes the signature of every
+ * interval of `--interval` events (branches, or memory access records);
+ * the intervals are clustered (at most `--max-k` phases) and only
+ * `--per-cluster` intervals of each phase are simulated, each after
+ * `--warmup` intervals that only warm the predictor or cache up, and once
+ * more after half as many to estimate the bias the warm-up leaves. See
+ * `sampling.h`.
+ *
+ * `--plan file` saves the intervals and the chosen samples; a later run
+ * over the same, unchanged trace with the same `--interval`, `--max-k`
+ * and `--per-cluster` reads them and skips the signature pass.
+ *
+ * The output is the extrapolated rate of every configuration with its
+ * error: the 95% sampling interval plus the warm-up term. `--validate`
+ * also simulates the whole trace and prints the real error and the
+ * speed-up, end to end (profile or plan included) and of the simulation
+ * alone.
+ */
+
+#include <chrono>    /// for std::chrono::steady_clock
+#include <cmath>     /// for std::isnan, std::fabs
+#include <cstdlib>   /// for strtoul
+#include <fstream>   /// for std::ifstream, std::ofstream
+#include <iomanip>   /// for std::setw
+#include <iostream>  /// for io operations
+#include <memory>    /// for std::unique_ptr
+#include <sstream>   /// for std::ostringstream
+#include <string>    /// for std::string
+#include <vector>    /// for std::vector
+
+#include "binary_trace.h"
+#include "cache.h"
+#include "lackey.h"
+#include "mapped_file.h"
+#include "predictors.h"
+#include "sampling.h"
+
+namespace {
+    namespace sim = simulator;
+
+    constexpr size_t chunk = 1 << 16;  /// events of a full run at once
+
+    /** What sampling needs of predictors and their branches. */
+    struct branch_kind {
+        using event = sim::lackey::branch;
+        using scanner = sim::lackey::branch_scanner;
+        using model = sim::predictors::predictor;
+        static constexpr const char* counted = "mispredictions";
+
+        static bool block(const sim::binary::reader& in, size_t k, std::vector<event>& out) {
+            return in.branches(k, out);
+        }
+        static std::unique_ptr<model> make(const std::string& text) {
+            return sim::predictors::make(text);
+        }
+        static std::string name(const model& m) { return m.name(); }
+        static uint64_t events(const model& m) { return m.branches; }
+        static uint64_t misses(const model& m) { return m.mispredictions; }
+
+        /** Code address of a branch: the branch. */
+        struct code {
+            uint64_t operator()(const event& e) { return e.pc; }
+        };
+    };
+
+    /** What sampling needs of caches and memory accesses. */
+    struct access_kind {
+        using event = sim::lackey::access;
+        using scanner = sim::lackey::access_scanner;
+        using model = sim::cache::cache;
+        static constexpr const char* counted = "misses";
+
+        static bool block(const sim::binary::reader& in, size_t k, std::vector<event>& out) {
+            return in.accesses(k, out);
+        }
+        static std::unique_ptr<model> make(const std::string& text) {
+            sim::cache::config c;
+            return sim::cache::parse(text, c) ? sim::cache::make(c) : nullptr;
+        }
+        static std::string name(const model& m) { return m.configuration().name(); }
+        static uint64_t events(const model& m) { return m.stats().total_accesses(); }
+        static uint64_t misses(const model& m) { return m.stats().total_misses(); }
+
+        /**
+         * Code address of an access: the instruction making it, or the
+         * page for traces without instruction records.
+         */
+        struct code {
+            uint64_t pc = 0;
+            bool have_pc = false;
+
+            uint64_t operator()(const event& e) {
+                if (e.type == 'I') {
+                    pc = e.address;
+                    have_pc = true;
+                }
+                return have_pc ? pc : e.address >> 12;
+            }
+        };
+    };
+
+    /** Block and event in it (binary), or byte offset (text). */
+    struct cursor {
+        size_t block, index;
+    };
+
+    /**
+     * Sequential reader of the events of a text or binary trace that can
+     * return to a position it has been at.
+     */
+    template <class Kind>
+    class event_reader {
+     public:
+        using event = typename Kind::event;
+
+        bool open(const std::string& path) {
+            if (!file_.open(path))
+                return false;
+            binary_ = sim::binary::reader::is_binary(file_);
+            if (binary_) {
+                file_.close();
+                if (!in_.open(path))
+                    return false;
+                if (!in_.blocks().empty() && !Kind::block(in_, 0, buffer_))
+                    return false;
+            }
+            else
+                scanner_.reset(new typename Kind::scanner(file_.begin(), file_.end()));
+            return true;
+        }
+
+        cursor tell() const {
+            if (binary_)
+                return {block_, index_};
+            return {base_ + scanner_->position(), 0};
+        }
+
+        void seek(const cursor& c) {
+            if (binary_) {
+                if (c.block != block_) {
+                    block_ = c.block;
+                    failed_ = failed_ || !Kind::block(in_, block_, buffer_);
+                }
+                index_ = c.index;
+                return;
+            }
+            base_ = c.block;
+            scanner_.reset(new typename Kind::scanner(file_.begin() + base_, file_.end()));
+        }
+
+        /** A block could not be decoded; it reads as empty. */
+        bool failed() const { return failed_; }
+
+        /** Reads up to `max` events. @returns how many, 0 at the end */
+        size_t read(event* out, size_t max) {
+            if (!binary_)
+                return scanner_->read(out, max);
+            size_t n = 0;
+            while (n < max) {
+                if (index_ == buffer_.size()) {
+                    if (block_ + 1 >= in_.blocks().size())
+                        break;
+                    failed_ = failed_ || !Kind::block(in_, ++block_, buffer_);
+                    index_ = 0;
+                    continue;
+                }
+                const size_t m = std::min(max - n, buffer_.size() - index_);
+                std::copy(buffer_.begin() + index_, buffer_.begin() + index_ + m, out + n);
+                index_ += m;
+                n += m;
+            }
+            return n;
+        }
+
+     private:
+        sim::mapped_file file_;
+        bool binary_ = false, failed_ = false;
+        sim::binary::reader in_;
+        std::vector<event> buffer_;
+        size_t block_ = 0, index_ = 0;
+        std::unique_ptr<typename Kind::scanner> scanner_;
+        size_t base_ = 0;
+    };
+
+    struct options {
+        size_t interval = 10000;
+        unsigned max_k = 10;
+        unsigned per_cluster = 3;
+        unsigned warmup = 2;
+        bool validate = false;
+        std::string plan_path;
+    };
+
+    double seconds_since(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /** The intervals of a trace and the samples chosen among them. */
+    struct profile {
+        std::vector<cursor> cursors;    /// start of every interval
+        std::vector<uint64_t> lengths;  /// events of every interval
+        unsigned phases = 0;
+        sim::sampling::plan plan;
+    };
+
+    /**
+     * First lines of a plan file: what it was made from. A plan is reused
+     * only if they are the same.
+     */
+    std::string plan_key(const std::string& trace, const options& o) {
+        std::ostringstream key;
+        key << "sample_sim plan 1\ntrace " << sim::file_identity(trace) << "\ninterval "
+            << o.interval << " max-k " << o.max_k << " per-cluster " << o.per_cluster << '\n';
+        return key.str();
+    }
+
+    /**
+     * Reads the plan file `path` if it starts with `key`.
+     * @returns true if `p` was read
+     */
+    bool read_plan(const std::string& path, const std::string& key, profile& p) {
+        std::ifstream in(path);
+        std::string head(key.size(), '\0');
+        if (!in.read(&head[0], static_cast<std::streamsize>(key.size())) || head != key)
+            return false;
+        size_t n, samples;
+        std::string word;
+        if (!(in >> word >> n >> word >> p.phases >> word >> samples) || n == 0)
+            return false;
+        p.cursors.resize(n);
+        p.lengths.resize(n);
+        for (size_t i = 0; i < n; ++i)
+            in >> p.cursors[i].block >> p.cursors[i].index >> p.lengths[i];
+        p.plan.weight.resize(p.phases);
+        p.plan.members.resize(p.phases);
+        for (unsigned j = 0; j < p.phases; ++j)
+            in >> p.plan.weight[j] >> p.plan.members[j];
+        p.plan.intervals.resize(samples);
+        p.plan.cluster.resize(samples);
+        for (size_t s = 0; s < samples; ++s)
+            if (!(in >> p.plan.intervals[s] >> p.plan.cluster[s]) ||
+                p.plan.intervals[s] >= n || p.plan.cluster[s] >= p.phases)
+                return false;
+        return static_cast<bool>(in);
+    }
+
+    /** Saves `p` to `path`; a failure is only reported. */
+    void write_plan(const std::string& path, const std::string& key, const profile& p) {
+        std::ofstream out(path);
+        out << key << "intervals " << p.cursors.size() << " phases " << p.phases
+            << " samples " << p.plan.intervals.size() << '\n';
+        for (size_t i = 0; i < p.cursors.size(); ++i)
+            out << p.cursors[i].block << ' ' << p.cursors[i].index << ' ' << p.lengths[i] << '\n';
+        out << std::setprecision(17);
+        for (unsigned j = 0; j < p.phases; ++j)
+            out << p.plan.weight[j] << ' ' << p.plan.members[j] << '\n';
+        for (size_t s = 0; s < p.plan.intervals.size(); ++s)
+            out << p.plan.intervals[s] << ' ' << p.plan.cluster[s] << '\n';
+        out.close();
+        if (!out)
+            std::cerr << path << ": can not write the plan\n";
+    }
+
+    /**
+     * Samples `configs` over `path`.
+     * @returns the exit code of the program
+     */
+    template <class Kind>
+    int run(const std::string& path, const std::vector<std::string>& configs, const options& o) {
+        using event = typename Kind::event;
+        event_reader<Kind> reader;
+        if (!reader.open(path))
+            return 1;
+
+        // the warm-up of the bias estimate is the last half of the real one
+        const size_t short_warmup = o.warmup / 2;
+        std::vector<event> buffer(o.interval * (o.warmup + 1));
+
+        // 1. signatures of the intervals, unless a saved plan fits
+        auto start = std::chrono::steady_clock::now();
+        profile prof;
+        const std::string key = plan_key(path, o);
+        const bool reused = !o.plan_path.empty() && read_plan(o.plan_path, key, prof);
+        if (!reused) {
+            std::vector<sim::sampling::vector> points;
+            sim::sampling::signature signature;
+            typename Kind::code code;
+            for (;;) {
+                const cursor at = reader.tell();
+                const size_t n = reader.read(buffer.data(), o.interval);
+                if (n == 0)
+                    break;
+                for (size_t i = 0; i < n; ++i)
+                    signature.add(code(buffer[i]));
+                prof.cursors.push_back(at);
+                points.push_back(signature.finish());
+                prof.lengths.push_back(n);
+            }
+            if (reader.failed())
+                return 1;
+            if (points.empty()) {
+                std::cerr << path << ": no events\n";
+                return 1;
+            }
+
+            // 2. phases and 3. the intervals to simulate
+            const sim::sampling::clustering phases = sim::sampling::cluster(points, o.max_k);
+            prof.phases = phases.k;
+            prof.plan = sim::sampling::choose(points, phases, prof.lengths, o.per_cluster);
+            if (!o.plan_path.empty())
+                write_plan(o.plan_path, key, prof);
+        }
+        const std::vector<cursor>& cursors = prof.cursors;
+        const std::vector<uint64_t>& lengths = prof.lengths;
+        const sim::sampling::plan& plan = prof.plan;
+        const double profile_seconds = seconds_since(start);
+
+        // every sampled interval after each warm-up, with fresh models
+        start = std::chrono::steady_clock::now();
+        std::vector<std::vector<uint64_t>> events(configs.size()), misses(configs.size());
+        std::vector<std::vector<uint64_t>> short_events(configs.size()),
+            short_misses(configs.size());
+        uint64_t simulated = 0;
+        for (size_t s = 0; s < plan.intervals.size(); ++s) {
+            const size_t i = plan.intervals[s];
+            const size_t first = i >= o.warmup ? i - o.warmup : 0;
+            const size_t first_short = i >= short_warmup ? i - short_warmup : 0;
+            reader.seek(cursors[first]);
+            size_t warm = 0, skip = 0;
+            for (size_t j = first; j < i; ++j)
+                (j < first_short ? skip : warm) += lengths[j];
+            warm += skip;
+            const size_t n = reader.read(buffer.data(), warm + lengths[i]);
+            simulated += n;
+            for (size_t c = 0; c < configs.size(); ++c) {
+                std::unique_ptr<typename Kind::model> m = Kind::make(configs[c]);
+                m->run(buffer.data(), warm);
+                uint64_t e0 = Kind::events(*m), m0 = Kind::misses(*m);
+                m->run(buffer.data() + warm, n - warm);
+                events[c].push_back(Kind::events(*m) - e0);
+                misses[c].push_back(Kind::misses(*m) - m0);
+
+                m = Kind::make(configs[c]);
+                m->run(buffer.data() + skip, warm - skip);
+                e0 = Kind::events(*m);
+                m0 = Kind::misses(*m);
+                m->run(buffer.data() + warm, n - warm);
+                short_events[c].push_back(Kind::events(*m) - e0);
+                short_misses[c].push_back(Kind::misses(*m) - m0);
+            }
+        }
+        const double sample_seconds = seconds_since(start);
+        if (reader.failed())
+            return 1;
+
+        // the whole trace, for comparison
+        std::vector<double> full(configs.size(), 0);
+        double full_seconds = 0;
+        if (o.validate) {
+            start = std::chrono::steady_clock::now();
+            std::vector<std::unique_ptr<typename Kind::model>> models;
+            for (const std::string& c : configs)
+                models.push_back(Kind::make(c));
+            reader.seek(cursors[0]);
+            std::vector<event> all(chunk);
+            size_t n;
+            while ((n = reader.read(all.data(), chunk)) > 0)
+                for (auto& m : models)
+                    m->run(all.data(), n);
+            for (size_t c = 0; c < configs.size(); ++c)
+                full[c] = Kind::events(*models[c])
+                    ? static_cast<double>(Kind::misses(*models[c])) / Kind::events(*models[c]) : 0;
+            full_seconds = seconds_since(start);
+            if (reader.failed())
+                return 1;
+        }
+
+        uint64_t total = 0;
+        for (uint64_t l : lengths)
+            total += l;
+        std::cout << cursors.size() << " intervals of " << o.interval << " events, "
+            << prof.phases << " phases, " << plan.intervals.size() << " intervals simulated ("
+            << std::fixed << std::setprecision(2) << 100.0 * simulated / total
+            << "% of the events with warm-up)\n\n"
+            << std::left << std::setw(22) << "configuration" << std::right << std::setw(12)
+            << std::string(Kind::counted).substr(0, 6) + " %" << std::setw(10) << "+/- %"
+            << std::setw(10) << "warm %";
+        if (o.validate)
+            std::cout << std::setw(10) << "full %" << std::setw(10) << "error %";
+        std::cout << '\n';
+        for (size_t c = 0; c < configs.size(); ++c) {
+            const sim::sampling::estimate e = sim::sampling::extrapolate(plan, events[c],
+                misses[c], short_events[c], short_misses[c]);
+            std::cout << std::left << std::setw(22) << Kind::name(*Kind::make(configs[c]))
+                << std::right << std::setprecision(3) << std::setw(12) << 100 * e.rate;
+            if (std::isnan(e.error))
+                std::cout << std::setw(10) << "n/a";
+            else
+                std::cout << std::setw(10) << 100 * e.error;
+            std::cout << std::setw(10) << 100 * e.warmup;
+            if (o.validate)
+                std::cout << std::setw(10) << 100 * full[c] << std::setw(10)
+                    << 100 * std::fabs(e.rate - full[c]);
+            std::cout << '\n';
+        }
+        std::cout << "\n+/- is the 95% sampling interval plus warm %, the change of the rate"
+            " from half the warm-up\n(an estimate of the warm-up bias, not a bound)\n";
+        std::cerr << (reused ? "plan read in " : "profile ") << profile_seconds
+            << " s, sampled simulation " << sample_seconds << " s, "
+            << profile_seconds + sample_seconds << " s in all";
+        if (o.validate)
+            std::cerr << ", full simulation " << full_seconds << " s (" << std::fixed
+                << std::setprecision(1) << full_seconds / (profile_seconds + sample_seconds)
+                << "x end to end, " << full_seconds / sample_seconds << "x simulation only)";
+        std::cerr << '\n';
+        return 0;
+    }
+}  // namespace
+
+/** Driver Code */
+int main(int argc, char* argv[]) {
+    options o;
+    std::vector<std::string> configs;
+    bool usage = argc < 3;
+    for (int i = 2; i < argc && !usage; ++i) {
+        const std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0)
+            configs.push_back(arg);
+        else if (arg == "--validate")
+            o.validate = true;
+        else if (i + 1 == argc)
+            usage = true;
+        else if (arg == "--interval")
+            o.interval = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--max-k")
+            o.max_k = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--per-cluster")
+            o.per_cluster = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--warmup")
+            o.warmup = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--plan")
+            o.plan_path = argv[++i];
+        else
+            usage = true;
+    }
+    if (usage || configs.empty() || o.interval == 0 || o.max_k == 0 || o.per_cluster == 0) {
+        std::cerr << "Usage: " << argv[0] << " <trace> <configuration ...> [--interval N]"
+            << " [--max-k K]\n       [--per-cluster M] [--warmup W] [--plan file] [--validate]\n";
+        return 2;
+    }
+
+    // all predictors or all caches
+    const bool caches = !branch_kind::make(configs[0]);
+    for (const std::string& c : configs)
+        if (caches ? !access_kind::make(c) : !branch_kind::make(c)) {
+            std::cerr << "Invalid configuration: " << c << '\n';
+            return 2;
+        }
+    return caches ? run<access_kind>(argv[1], configs, o) : run<branch_kind>(argv[1], configs, o);
+}
@@ -0,0 +1,369 @@
+#pragma once
+/**
+ * @file
+ * @brief Phase clustering and sampled simulation (SimPoint)
+ *
+ * @details
+ * The method of Sherwood et al., "Automatically Characterizing Large Scale
+ * Program Behavior" (ASPLOS 2002):
+ *  1. the trace is cut into intervals of a fixed number of events; each
+ *     interval gets the vector of how often every code address (branch, or
+ *     instruction making an access) occurs in it, normalized to sum 1 and
+ *     randomly projected to `dimensions` dimensions (`signature`);
+ *  2. the vectors are clustered with k-means for k = 1 .. max_k, and the
+ *     smallest k whose BIC score reaches 90% of the best score's range is
+ *     kept (`cluster`);
+ *  3. only a few intervals per cluster are simulated: the one closest to
+ *     the centroid and, for an error estimate, `per_cluster - 1` random
+ *     others (`choose`), each after a warm-up;
+ *  4. the rate (misses per event) of the whole trace is the weighted mean
+ *     of the cluster rates (`extrapolate`). The intervals are simulated
+ *     after a warm-up and after one half as long that ends at the same
+ *     point; the rate is that of the longer one. Its error has two parts:
+ *     the spread of the rates within the clusters, as in stratified
+ *     sampling, and the bias left by the warm-up, taken to be the change
+ *     of the rate from the shorter warm-up, which holds if doubling the
+ *     warm-up at least halves the bias. The second part is an estimate,
+ *     not a bound.
+ */
+
+#include <algorithm>      /// for std::sort
+#include <array>          /// for std::array
+#include <cmath>          /// for std::log, std::sqrt, std::fabs
+#include <cstdint>        /// for uint64_t
+#include <limits>         /// for std::numeric_limits
+#include <unordered_map>  /// for std::unordered_map
+#include <utility>        /// for std::pair
+#include <vector>         /// for std::vector
+
+namespace simulator {
+    namespace sampling {
+        constexpr unsigned dimensions = 15;  /// of the projected vectors
+
+        using vector = std::array<double, dimensions>;
+
+        namespace detail {
+            inline uint64_t mix(uint64_t x) {
+                x += 0x9E3779B97F4A7C15ULL;
+                x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+                return x ^ (x >> 31);
+            }
+
+            inline double distance(const vector& a, const vector& b) {
+                double d = 0;
+                for (unsigned i = 0; i < dimensions; ++i)
+                    d += (a[i] - b[i]) * (a[i] - b[i]);
+                return d;
+            }
+
+            /** Small deterministic generator for the k-means seeds. */
+            class random {
+             public:
+                explicit random(uint64_t seed) : state_(seed | 1) {}
+
+                uint64_t next() {
+                    state_ ^= state_ << 13;
+                    state_ ^= state_ >> 7;
+                    state_ ^= state_ << 17;
+                    return state_;
+                }
+
+                double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+             private:
+                uint64_t state_;
+            };
+        }  // namespace detail
+
+        /**
+         * Projected code-address vector of one interval: `add` every event's
+         * address, then `finish`.
+         */
+        class signature {
+         public:
+            void add(uint64_t address) { counts_[address]++; }
+
+            /** The vector of the addresses added since the last call. */
+            vector finish() {
+                vector v{};
+                uint64_t total = 0;
+                for (const auto& c : counts_)
+                    total += c.second;
+                for (const auto& c : counts_) {
+                    const vector& p = projection(c.first);
+                    const double w = static_cast<double>(c.second) / total;
+                    for (unsigned i = 0; i < dimensions; ++i)
+                        v[i] += w * p[i];
+                }
+                counts_.clear();
+                return v;
+            }
+
+         private:
+            /** Random direction of `address`, components in [-1, 1). */
+            const vector& projection(uint64_t address) {
+                auto it = projections_.find(address);
+                if (it == projections_.end()) {
+                    vector p;
+                    for (unsigned i = 0; i < dimensions; ++i)
+                        p[i] = static_cast<double>(detail::mix(address * dimensions + i) >> 11)
+                            / 4503599627370496.0 - 1.0;
+                    it = projections_.emplace(address, p).first;
+                }
+                return it->second;
+            }
+
+            std::unordered_map<uint64_t, uint64_t> counts_;
+            std::unordered_map<uint64_t, vector> projections_;
+        };
+
+        /** Result of `kmeans` and `cluster`. */
+        struct clustering {
+            unsigned k = 0;
+            std::vector<unsigned> label;  /// cluster of every interval
+            std::vector<vector> centers;
+            double sse = 0;               /// sum of squared distances to the centers
+        };
+
+        /**
+         * k-means with k-means++ seeding, best of `restarts` runs.
+         */
+        inline clustering kmeans(const std::vector<vector>& points, unsigned k,
+            unsigned restarts = 5, uint64_t seed = 1) {
+            const size_t n = points.size();
+            clustering best;
+            best.sse = std::numeric_limits<double>::infinity();
+            detail::random rng(seed * 0x9E3779B97F4A7C15ULL + k);
+            for (unsigned run = 0; run < restarts; ++run) {
+                clustering c;
+                c.k = k;
+                c.label.assign(n, 0);
+                c.centers.push_back(points[rng.next() % n]);
+                std::vector<double> d(n);
+                while (c.centers.size() < k) {
+                    double total = 0;
+                    for (size_t i = 0; i < n; ++i) {
+                        d[i] = std::numeric_limits<double>::infinity();
+                        for (const vector& m : c.centers)
+                            d[i] = std::min(d[i], detail::distance(points[i], m));
+                        total += d[i];
+                    }
+                    size_t pick = rng.next() % n;
+                    if (total > 0) {
+                        double r = rng.uniform() * total;
+                        for (pick = 0; pick + 1 < n && (r -= d[pick]) > 0; ++pick) {}
+                    }
+                    c.centers.push_back(points[pick]);
+                }
+                for (int iteration = 0; iteration < 100; ++iteration) {
+                    bool moved = false;
+                    c.sse = 0;
+                    for (size_t i = 0; i < n; ++i) {
+                        unsigned nearest = 0;
+                        double nd = std::numeric_limits<double>::infinity();
+                        for (unsigned j = 0; j < k; ++j) {
+                            const double dj = detail::distance(points[i], c.centers[j]);
+                            if (dj < nd) {
+                                nd = dj;
+                                nearest = j;
+                            }
+                        }
+                        moved |= c.label[i] != nearest;
+                        c.label[i] = nearest;
+                        c.sse += nd;
+                    }
+                    if (!moved && iteration > 0)
+                        break;
+                    std::vector<vector> sum(k, vector{});
+                    std::vector<size_t> count(k, 0);
+                    for (size_t i = 0; i < n; ++i) {
+                        count[c.label[i]]++;
+                        for (unsigned t = 0; t < dimensions; ++t)
+                            sum[c.label[i]][t] += points[i][t];
+                    }
+                    for (unsigned j = 0; j < k; ++j)
+                        if (count[j])
+                            for (unsigned t = 0; t < dimensions; ++t)
+                                c.centers[j][t] = sum[j][t] / count[j];
+                }
+                if (c.sse < best.sse)
+                    best = c;
+            }
+            return best;
+        }
+
+        /**
+         * Bayesian information criterion of `c` for a mixture of spherical
+         * Gaussians (Pelleg and Moore, X-means); larger is better.
+         */
+        inline double bic(const std::vector<vector>& points, const clustering& c) {
+            const double r = static_cast<double>(points.size());
+            const double m = dimensions;
+            const double k = c.k;
+            if (r <= k)
+                return -std::numeric_limits<double>::infinity();
+            const double variance = std::max(c.sse / (m * (r - k)), 1e-12);
+            std::vector<double> size(c.k, 0);
+            for (unsigned l : c.label)
+                size[l]++;
+            double likelihood = -r * m / 2 * std::log(6.283185307179586 * variance) - m * (r - k) / 2;
+            for (double s : size)
+                if (s > 0)
+                    likelihood += s * std::log(s / r);
+            const double parameters = k * (m + 1);
+            return likelihood - parameters / 2 * std::log(r);
+        }
+
+        /**
+         * Clusters `points` with the smallest k (up to `max_k`) whose BIC
+         * is at least `threshold` of the way from the worst to the best.
+         */
+        inline clustering cluster(const std::vector<vector>& points, unsigned max_k,
+            double threshold = 0.9) {
+            max_k = static_cast<unsigned>(std::min<size_t>(max_k, points.size()));
+            std::vector<clustering> runs;
+            std::vector<double> scores;
+            for (unsigned k = 1; k <= max_k; ++k) {
+                runs.push_back(kmeans(points, k));
+                scores.push_back(bic(points, runs.back()));
+            }
+            double lo = std::numeric_limits<double>::infinity(), hi = -lo;
+            for (double s : scores)
+                if (std::isfinite(s)) {
+                    lo = std::min(lo, s);
+                    hi = std::max(hi, s);
+                }
+            for (unsigned k = 0; k < max_k; ++k)
+                if (std::isfinite(scores[k]) && scores[k] >= lo + threshold * (hi - lo))
+                    return runs[k];
+            return runs.back();
+        }
+
+        /**
+         * Intervals to simulate.
+         */
+        struct plan {
+            std::vector<size_t> intervals;  /// sorted
+            std::vector<unsigned> cluster;  /// of every sampled interval
+            std::vector<double> weight;     /// events of the cluster / all events
+            std::vector<size_t> members;    /// intervals of the cluster
+        };
+
+        /**
+         * Picks up to `per_cluster` intervals of every cluster of `c`: the
+         * one nearest the centroid, then random ones. `events[i]` is the
+         * length of interval i (the last one may be short).
+         */
+        inline plan choose(const std::vector<vector>& points, const clustering& c,
+            const std::vector<uint64_t>& events, unsigned per_cluster, uint64_t seed = 1) {
+            plan p;
+            p.weight.assign(c.k, 0);
+            p.members.assign(c.k, 0);
+            std::vector<std::vector<size_t>> by_cluster(c.k);
+            uint64_t total = 0;
+            for (size_t i = 0; i < points.size(); ++i) {
+                by_cluster[c.label[i]].push_back(i);
+                p.weight[c.label[i]] += events[i];
+                total += events[i];
+            }
+            detail::random rng(seed);
+            std::vector<std::pair<size_t, unsigned>> picked;
+            for (unsigned j = 0; j < c.k; ++j) {
+                std::vector<size_t>& m = by_cluster[j];
+                p.members[j] = m.size();
+                p.weight[j] /= total;
+                if (m.empty())
+                    continue;
+                // nearest first, then a random order of the others
+                size_t nearest = 0;
+                for (size_t i = 1; i < m.size(); ++i)
+                    if (detail::distance(points[m[i]], c.centers[j]) <
+                        detail::distance(points[m[nearest]], c.centers[j]))
+                        nearest = i;
+                std::swap(m[0], m[nearest]);
+                for (size_t i = m.size() - 1; i > 1; --i)
+                    std::swap(m[i], m[1 + rng.next() % i]);
+                for (size_t i = 0; i < m.size() && i < per_cluster; ++i)
+                    picked.push_back({m[i], j});
+            }
+            std::sort(picked.begin(), picked.end());
+            for (const auto& x : picked) {
+                p.intervals.push_back(x.first);
+                p.cluster.push_back(x.second);
+            }
+            return p;
+        }
+
+        /** Extrapolated rate and its error. */
+        struct estimate {
+            double rate = 0;      /// misses per event
+            double error = 0;     /// sampling + warmup, NaN if unknown
+            double sampling = 0;  /// half-width of the 95% sampling interval, NaN if unknown
+            double warmup = 0;    /// change of the rate from the shorter warm-up
+        };
+
+        namespace detail {
+            /** Weighted mean of the cluster rates of `p`. */
+            inline double rate(const plan& p, const std::vector<uint64_t>& events,
+                const std::vector<uint64_t>& misses) {
+                const size_t k = p.weight.size();
+                std::vector<uint64_t> e(k, 0), m(k, 0);
+                for (size_t s = 0; s < p.intervals.size(); ++s) {
+                    e[p.cluster[s]] += events[s];
+                    m[p.cluster[s]] += misses[s];
+                }
+                double r = 0;
+                for (size_t c = 0; c < k; ++c)
+                    if (e[c])
+                        r += p.weight[c] * m[c] / e[c];
+                return r;
+            }
+        }  // namespace detail
+
+        /**
+         * Rate of the whole trace from the sampled intervals of `p`, which
+         * had `events[s]` events and `misses[s]` misses, and
+         * `short_events[s]` and `short_misses[s]` after the shorter warm-up.
+         */
+        inline estimate extrapolate(const plan& p, const std::vector<uint64_t>& events,
+            const std::vector<uint64_t>& misses, const std::vector<uint64_t>& short_events,
+            const std::vector<uint64_t>& short_misses) {
+            const size_t k = p.weight.size();
+            std::vector<std::vector<double>> rates(k);
+            std::vector<uint64_t> e(k, 0);
+            for (size_t s = 0; s < p.intervals.size(); ++s) {
+                const unsigned c = p.cluster[s];
+                e[c] += events[s];
+                if (events[s])
+                    rates[c].push_back(static_cast<double>(misses[s]) / events[s]);
+            }
+            estimate r;
+            r.rate = detail::rate(p, events, misses);
+            double variance = 0;
+            bool known = true;
+            for (size_t c = 0; c < k; ++c) {
+                if (e[c] == 0)
+                    continue;
+                const size_t n = rates[c].size();
+                if (n >= p.members[c])
+                    continue;  // every interval simulated: no sampling error
+                if (n < 2) {
+                    known = false;
+                    continue;
+                }
+                double mean = 0, s2 = 0;
+                for (double x : rates[c])
+                    mean += x / n;
+                for (double x : rates[c])
+                    s2 += (x - mean) * (x - mean) / (n - 1);
+                const double fpc = 1.0 - static_cast<double>(n) / p.members[c];
+                variance += p.weight[c] * p.weight[c] * fpc * s2 / n;
+            }
+            r.sampling = known ? 1.96 * std::sqrt(variance) : std::nan("");
+            r.warmup = std::fabs(r.rate - detail::rate(p, short_events, short_misses));
+            r.error = r.sampling + r.warmup;
+            return r;
+        }
+    }  // namespace sampling
+}  // namespace simulator
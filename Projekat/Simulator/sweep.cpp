@@ -0,0 +1,476 @@
+/**
+ * @file
+ * @brief Parallel design-space sweep over predictor and cache parameters
+ *
+ * @details
+ *     g++ -O3 -march=native -std=c++14 -pthread sweep.cpp -o sweep
+ *     ./sweep HelloTrace.trc 'gshare:{8..16}:{0..16..2}' '2bcgskew:{10..14}:{6,8,10}' \
+ *         --out results.csv --checkpoint sweep.ckpt
+ *     ./sweep mem.trc '{16K,32K,64K}:{2,4,8}:64:{lru,fifo,random,slru}'
+ *
+ * Every pattern is brace-expanded like in bash (`{a,b}`, `{lo..hi}`,
+ * `{lo..hi..step}`) into configurations of `branch_sim`
+ * (`kind:log_size[:history]`) or `cache_sim` (`size:ways:block:policy`);
+ * `--grid file` reads more patterns, one per line.
+ *
+ * The trace is decoded once into memory (branches packed to 8 bytes) and
+ * shared read-only by all workers. Configurations are grouped into batches
+ * whose state fits in `--budget` KiB (default 256, a private L2), so a
+ * worker runs a whole batch chunk by chunk, like `branch_sim`, with all
+ * its tables resident. There are at least as many batches as workers;
+ * workers (`--threads`, default one per CPU the process may run on) are
+ * pinned to their own CPU of that set and take batches from a shared
+ * counter.
+ *
+ * Every finished batch is appended to the checkpoint file, after a line
+ * `# trace <bytes> <mtime ns> <path>` naming the trace of the run; a
+ * restarted sweep skips the configurations found under a line that names
+ * the same trace, unchanged. The table (`--out`, default stdout) has one
+ * CSV row per configuration in grid order.
+ */
+
+#include <pthread.h>  /// for pthread_setaffinity_np
+#include <sched.h>    /// for cpu_set_t, sched_getaffinity
+
+#include <algorithm>  /// for std::count, std::min
+#include <atomic>     /// for std::atomic
+#include <chrono>     /// for std::chrono::steady_clock
+#include <cstdio>     /// for snprintf, sscanf
+#include <cstdlib>    /// for atoi, strtol
+#include <fstream>    /// for std::ifstream, std::ofstream
+#include <iostream>   /// for io operations
+#include <map>        /// for std::map
+#include <memory>     /// for std::unique_ptr
+#include <mutex>      /// for std::mutex
+#include <string>     /// for std::string
+#include <thread>     /// for std::thread
+#include <vector>     /// for std::vector
+
+#include "binary_trace.h"
+#include "cache.h"
+#include "lackey.h"
+#include "mapped_file.h"
+#include "predictors.h"
+
+namespace {
+    namespace sim = simulator;
+
+    constexpr size_t chunk = 1 << 14;  /// events per step of a batch
+
+    /**
+     * Expands the first brace group of `pattern` and recurses.
+     */
+    void expand(const std::string& pattern, std::vector<std::string>& out) {
+        const size_t open = pattern.find('{');
+        const size_t close = open == std::string::npos ? open : pattern.find('}', open);
+        if (close == std::string::npos) {
+            out.push_back(pattern);
+            return;
+        }
+        const std::string head = pattern.substr(0, open);
+        const std::string body = pattern.substr(open + 1, close - open - 1);
+        const std::string tail = pattern.substr(close + 1);
+
+        std::vector<std::string> items;
+        const size_t dots = body.find("..");
+        if (dots != std::string::npos) {
+            const long lo = strtol(body.c_str(), nullptr, 10);
+            const size_t dots2 = body.find("..", dots + 2);
+            const long hi = strtol(body.c_str() + dots + 2, nullptr, 10);
+            long step = dots2 == std::string::npos ? 1 : strtol(body.c_str() + dots2 + 2, nullptr, 10);
+            if (step <= 0)
+                step = 1;
+            for (long v = lo; v <= hi; v += step)
+                items.push_back(std::to_string(v));
+        }
+        else {
+            size_t from = 0;
+            for (;;) {
+                const size_t comma = body.find(',', from);
+                items.push_back(body.substr(from, comma - from));
+                if (comma == std::string::npos)
+                    break;
+                from = comma + 1;
+            }
+        }
+        for (const std::string& item : items)
+            expand(head + item + tail, out);
+    }
+
+    /**
+     * One point of the grid.
+     */
+    struct point {
+        std::string name;   /// canonical configuration
+        bool cache;         /// cache, or branch predictor
+        sim::cache::config config;
+        size_t bytes;       /// simulated state
+    };
+
+    /** Result of one point. */
+    struct result {
+        uint64_t events = 0, misses = 0, writebacks = 0;
+        double kib = 0;
+    };
+
+    /**
+     * @returns false if `text` is neither kind of configuration
+     */
+    bool make_point(const std::string& text, point& p) {
+        if (auto pred = sim::predictors::make(text)) {
+            p.name = pred->name();
+            p.cache = false;
+            p.bytes = pred->storage_bits() / 8;
+            return true;
+        }
+        if (sim::cache::parse(text, p.config)) {
+            p.name = p.config.name();
+            p.cache = true;
+            // tag, order byte and a dirty bit per block
+            p.bytes = static_cast<size_t>(p.config.size / p.config.block * 9);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * The decoded trace, shared by all workers.
+     */
+    struct trace_data {
+        std::vector<uint64_t> branches;  /// pc | taken << 63
+        std::vector<sim::lackey::access> accesses;
+    };
+
+    /**
+     * Decodes the branches and/or the accesses of `path` into `t`.
+     */
+    bool load(const std::string& path, bool branches, bool accesses, trace_data& t) {
+        sim::mapped_file file;
+        if (!file.open(path))
+            return false;
+        std::vector<sim::lackey::branch> b(sim::binary::default_block_records);
+        std::vector<sim::lackey::access> a(sim::binary::default_block_records);
+        auto keep = [&](size_t n) {
+            for (size_t i = 0; i < n; ++i)
+                t.branches.push_back(b[i].pc | uint64_t(b[i].taken) << 63);
+        };
+        if (sim::binary::reader::is_binary(file)) {
+            file.close();
+            sim::binary::reader in;
+            if (!in.open(path))
+                return false;
+            for (size_t k = 0; k < in.blocks().size(); ++k) {
+                if (branches) {
+                    if (!in.branches(k, b))
+                        return false;
+                    keep(b.size());
+                }
+                if (accesses) {
+                    if (!in.accesses(k, a))
+                        return false;
+                    t.accesses.insert(t.accesses.end(), a.begin(), a.end());
+                }
+            }
+            return true;
+        }
+        size_t n;
+        if (branches) {
+            sim::lackey::branch_scanner scanner(file.begin(), file.end());
+            while ((n = scanner.read(b.data(), b.size())) > 0)
+                keep(n);
+        }
+        if (accesses) {
+            sim::lackey::access_scanner scanner(file.begin(), file.end());
+            while ((n = scanner.read(a.data(), a.size())) > 0)
+                t.accesses.insert(t.accesses.end(), a.begin(), a.begin() + n);
+        }
+        return true;
+    }
+
+    /**
+     * Simulates the points `batch` over the whole trace.
+     */
+    void run_batch(const trace_data& t, const std::vector<point>& points,
+        const std::vector<size_t>& batch, std::vector<result>& results) {
+        if (points[batch[0]].cache) {
+            std::vector<std::unique_ptr<sim::cache::cache>> caches;
+            for (size_t i : batch)
+                caches.push_back(sim::cache::make(points[i].config));
+            for (size_t from = 0; from < t.accesses.size(); from += chunk) {
+                const size_t n = std::min(chunk, t.accesses.size() - from);
+                for (auto& c : caches)
+                    c->run(t.accesses.data() + from, n);
+            }
+            for (size_t k = 0; k < batch.size(); ++k) {
+                const sim::cache::statistics& s = caches[k]->stats();
+                result& r = results[batch[k]];
+                r.events = s.total_accesses();
+                r.misses = s.total_misses();
+                r.writebacks = s.writebacks;
+                r.kib = points[batch[k]].config.size / 1024.0;
+            }
+            return;
+        }
+        std::vector<std::unique_ptr<sim::predictors::predictor>> predictors;
+        for (size_t i : batch)
+            predictors.push_back(sim::predictors::make(points[i].name));
+        std::vector<sim::lackey::branch> buffer(chunk);
+        for (size_t from = 0; from < t.branches.size(); from += chunk) {
+            const size_t n = std::min(chunk, t.branches.size() - from);
+            for (size_t i = 0; i < n; ++i) {
+                const uint64_t v = t.branches[from + i];
+                buffer[i] = {v & ~(uint64_t(1) << 63), (v >> 63) != 0};
+            }
+            for (auto& p : predictors)
+                p->run(buffer.data(), n);
+        }
+        for (size_t k = 0; k < batch.size(); ++k) {
+            result& r = results[batch[k]];
+            r.events = predictors[k]->branches;
+            r.misses = predictors[k]->mispredictions;
+            r.kib = predictors[k]->storage_bits() / 8192.0;
+        }
+    }
+
+    /** One CSV row; also the checkpoint format. */
+    std::string row(const point& p, const result& r) {
+        char buf[160];
+        snprintf(buf, sizeof(buf), "%s,%s,%.2f,%llu,%llu,%.4f,%llu", p.name.c_str(),
+            p.cache ? "cache" : "predictor", r.kib,
+            static_cast<unsigned long long>(r.events), static_cast<unsigned long long>(r.misses),
+            r.events ? 100.0 * r.misses / r.events : 0.0,
+            static_cast<unsigned long long>(r.writebacks));
+        return buf;
+    }
+
+    const char* const header = "config,kind,kib,events,misses,miss_rate,writebacks";
+
+    /**
+     * Checkpoint line naming the trace `path` as it is now, "" if it can
+     * not be read.
+     */
+    std::string trace_identity(const std::string& path) {
+        const std::string identity = sim::file_identity(path);
+        return identity.empty() ? "" : "# trace " + identity;
+    }
+
+    /**
+     * Reads the rows of earlier runs of the sweep over the trace of
+     * `identity`; rows of other traces, of an older version of the trace
+     * and rows before any trace line are ignored.
+     */
+    std::map<std::string, result> read_checkpoint(const std::string& path,
+        const std::string& identity) {
+        std::map<std::string, result> done;
+        std::ifstream in(path);
+        std::string line;
+        bool same_trace = false;
+        while (std::getline(in, line)) {
+            if (line.compare(0, 2, "# ") == 0) {
+                same_trace = !identity.empty() && line == identity;
+                continue;
+            }
+            if (!same_trace)
+                continue;
+            const size_t c1 = line.find(','), c2 = line.find(',', c1 + 1);
+            if (c2 == std::string::npos)
+                continue;
+            result r;
+            unsigned long long events, misses, writebacks;
+            double rate;
+            if (sscanf(line.c_str() + c2 + 1, "%lf,%llu,%llu,%lf,%llu", &r.kib, &events, &misses,
+                    &rate, &writebacks) != 5)
+                continue;
+            r.events = events;
+            r.misses = misses;
+            r.writebacks = writebacks;
+            done[line.substr(0, c1)] = r;
+        }
+        return done;
+    }
+
+    /** CPUs the process may run on, empty if they can not be read. */
+    std::vector<unsigned> allowed_cpus() {
+        std::vector<unsigned> cpus;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) != 0)
+            return cpus;
+        for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &set))
+                cpus.push_back(cpu);
+        return cpus;
+    }
+
+    /**
+     * Pins the calling thread to CPU `cpu`.
+     * @returns false if that is not allowed
+     */
+    bool pin(unsigned cpu) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+}  // namespace
+
+/** Driver Code */
+int main(int argc, char* argv[]) {
+    std::vector<std::string> patterns;
+    std::string out_path, checkpoint_path;
+    const std::vector<unsigned> cpus = allowed_cpus();
+    unsigned threads = cpus.empty() ? std::thread::hardware_concurrency()
+        : static_cast<unsigned>(cpus.size());
+    size_t budget = 256 << 10;
+    bool usage = argc < 3;
+    for (int i = 2; i < argc && !usage; ++i) {
+        const std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0)
+            patterns.push_back(arg);
+        else if (i + 1 == argc)
+            usage = true;
+        else if (arg == "--out")
+            out_path = argv[++i];
+        else if (arg == "--checkpoint")
+            checkpoint_path = argv[++i];
+        else if (arg == "--threads")
+            threads = static_cast<unsigned>(atoi(argv[++i]));
+        else if (arg == "--budget")
+            budget = static_cast<size_t>(atol(argv[++i])) << 10;
+        else if (arg == "--grid") {
+            std::ifstream grid(argv[++i]);
+            if (!grid) {
+                std::cerr << argv[i] << ": can not open\n";
+                return 1;
+            }
+            std::string line;
+            while (std::getline(grid, line))
+                if (!line.empty() && line[0] != '#')
+                    patterns.push_back(line);
+        }
+        else
+            usage = true;
+    }
+    if (usage || patterns.empty()) {
+        std::cerr << "Usage: " << argv[0] << " <trace> <pattern ...> [--grid file]"
+            << " [--out results.csv]\n       [--checkpoint file] [--threads N]"
+            << " [--budget KiB]\n";
+        return 2;
+    }
+    if (threads == 0)
+        threads = 1;
+
+    // the grid, without points done in an earlier run
+    std::vector<point> points;
+    for (const std::string& pattern : patterns) {
+        std::vector<std::string> texts;
+        expand(pattern, texts);
+        for (const std::string& text : texts) {
+            point p;
+            if (!make_point(text, p)) {
+                std::cerr << "Invalid configuration: " << text << '\n';
+                return 2;
+            }
+            points.push_back(p);
+        }
+    }
+    std::vector<result> results(points.size());
+    std::vector<bool> pending(points.size(), true);
+    const std::string identity = trace_identity(argv[1]);
+    if (!checkpoint_path.empty()) {
+        const std::map<std::string, result> done = read_checkpoint(checkpoint_path, identity);
+        for (size_t i = 0; i < points.size(); ++i) {
+            const auto it = done.find(points[i].name);
+            if (it != done.end()) {
+                results[i] = it->second;
+                pending[i] = false;
+            }
+        }
+    }
+
+    // batches of one kind that fit in the budget together, and at least
+    // one per thread
+    const size_t todo = static_cast<size_t>(std::count(pending.begin(), pending.end(), true));
+    const size_t per_batch = std::max<size_t>(1, (todo + threads - 1) / threads);
+    std::vector<std::vector<size_t>> batches;
+    bool need_branches = false, need_accesses = false;
+    for (int kind = 0; kind < 2; ++kind) {
+        std::vector<size_t> batch;
+        size_t bytes = 0;
+        for (size_t i = 0; i < points.size(); ++i) {
+            if (!pending[i] || points[i].cache != (kind == 1))
+                continue;
+            if (!batch.empty() && (bytes + points[i].bytes > budget || batch.size() == per_batch)) {
+                batches.push_back(batch);
+                batch.clear();
+                bytes = 0;
+            }
+            batch.push_back(i);
+            bytes += points[i].bytes;
+            (kind ? need_accesses : need_branches) = true;
+        }
+        if (!batch.empty())
+            batches.push_back(batch);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    trace_data trace;
+    if (!batches.empty() && !load(argv[1], need_branches, need_accesses, trace))
+        return 1;
+    const double load_seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::ofstream checkpoint;
+    if (!checkpoint_path.empty() && !batches.empty() && !identity.empty()) {
+        checkpoint.open(checkpoint_path, std::ios::app);
+        checkpoint << identity << '\n';
+    }
+    std::mutex mutex;
+    std::atomic<size_t> next{0};
+    size_t finished = 0;
+    std::vector<std::thread> pool;
+    for (unsigned w = 0; w < std::min<size_t>(threads, batches.size()); ++w) {
+        pool.emplace_back([&, w] {
+            // unpinned if the CPUs are unknown or pinning fails
+            if (!cpus.empty() && !pin(cpus[w % cpus.size()])) {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::cerr << "worker " << w << ": can not pin to CPU " << cpus[w % cpus.size()]
+                    << ", running unpinned\n";
+            }
+            for (size_t b; (b = next++) < batches.size();) {
+                run_batch(trace, points, batches[b], results);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (checkpoint.is_open()) {
+                    for (size_t i : batches[b])
+                        checkpoint << row(points[i], results[i]) << '\n';
+                    checkpoint.flush();
+                }
+                finished++;
+                std::cerr << "\rbatch " << finished << '/' << batches.size() << std::flush;
+            }
+        });
+    }
+    for (std::thread& t : pool)
+        t.join();
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    if (!batches.empty())
+        std::cerr << '\n';
+
+    std::ofstream file;
+    if (!out_path.empty()) {
+        file.open(out_path);
+        if (!file) {
+            std::cerr << out_path << ": can not create\n";
+            return 1;
+        }
+    }
+    std::ostream& out = out_path.empty() ? std::cout : file;
+    out << header << '\n';
+    for (size_t i = 0; i < points.size(); ++i)
+        out << row(points[i], results[i]) << '\n';
+    std::cerr << points.size() << " configurations (" << batches.size() << " batches) in "
+        << seconds << " s, trace loaded in " << load_seconds << " s, "
+        << std::min<size_t>(threads, batches.size()) << " threads\n";
+    return 0;
+}
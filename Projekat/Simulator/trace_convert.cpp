@@ -0,0 +1,113 @@
+/**
+ * @file
+ * @brief Converter between Lackey text traces and the binary trace format
+ *
+ * @details
+ *     g++ -O2 -std=c++14 -pthread trace_convert.cpp -o trace_convert
+ *     ./trace_convert HelloTrace.txt HelloTrace.trc
+ *     ./trace_convert -d HelloTrace.trc HelloTrace.txt [threads]
+ *
+ * Decoding runs `threads` blocks at a time (default: all cores), each in
+ * its own thread, and writes them in order; the output is identical to the
+ * original text.
+ */
+
+#include <chrono>    /// for std::chrono::steady_clock
+#include <cstdlib>   /// for atoi
+#include <cstring>   /// for strcmp
+#include <fstream>   /// for std::ofstream
+#include <iostream>  /// for io operations
+#include <string>    /// for std::string
+#include <thread>    /// for std::thread
+#include <vector>    /// for std::vector
+
+#include "binary_trace.h"
+#include "mapped_file.h"
+
+namespace {
+    /**
+     * Writes the text of all blocks of `in` to `path`.
+     */
+    bool decode(const simulator::binary::reader& in, const std::string& path,
+        unsigned threads) {
+        std::ofstream out(path, std::ios::binary);
+        if (!out) {
+            std::cerr << path << ": can not create\n";
+            return false;
+        }
+        const size_t blocks = in.blocks().size();
+        std::vector<std::string> text(threads);
+        std::vector<char> good(threads);
+        for (size_t first = 0; first < blocks; first += threads) {
+            const size_t n = std::min<size_t>(threads, blocks - first);
+            std::vector<std::thread> pool;
+            for (size_t t = 0; t < n; ++t) {
+                pool.emplace_back([&, t] {
+                    std::vector<simulator::binary::record> recs;
+                    std::string lines;
+                    good[t] = in.decode(first + t, recs, lines);
+                    text[t].clear();
+                    in.render(recs, lines, first + t + 1 == blocks, text[t]);
+                });
+            }
+            bool ok = true;
+            for (size_t t = 0; t < n; ++t) {
+                pool[t].join();
+                ok = ok && good[t];
+                if (ok)
+                    out.write(text[t].data(), static_cast<std::streamsize>(text[t].size()));
+            }
+            if (!ok)
+                return false;
+        }
+        out.close();
+        if (!out) {
+            std::cerr << path << ": write error\n";
+            return false;
+        }
+        return true;
+    }
+}  // namespace
+
+/** Driver Code */
+int main(int argc, char* argv[]) {
+    const bool to_text = argc >= 4 && strcmp(argv[1], "-d") == 0;
+    if (!(argc == 3 || (to_text && argc <= 5))) {
+        std::cerr << "Usage: " << argv[0] << " <trace.txt> <trace.trc>\n"
+            << "       " << argv[0] << " -d <trace.trc> <trace.txt> [threads]\n";
+        return 2;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t in_bytes, out_bytes;
+    if (to_text) {
+        simulator::binary::reader in;
+        if (!in.open(argv[2]))
+            return 1;
+        unsigned threads = argc == 5 ? static_cast<unsigned>(atoi(argv[4]))
+            : std::thread::hardware_concurrency();
+        if (threads == 0)
+            threads = 1;
+        if (!decode(in, argv[3], threads))
+            return 1;
+        simulator::mapped_file a, b;
+        a.open(argv[2]);
+        b.open(argv[3]);
+        in_bytes = a.size();
+        out_bytes = b.size();
+    }
+    else {
+        simulator::mapped_file in;
+        if (!in.open(argv[1]) ||
+            !simulator::binary::convert(in.begin(), in.end(), argv[2]))
+            return 1;
+        simulator::mapped_file out;
+        out.open(argv[2]);
+        in_bytes = in.size();
+        out_bytes = out.size();
+    }
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cerr << in_bytes << " -> " << out_bytes << " bytes in " << seconds << " s\n";
+    return 0;
+}
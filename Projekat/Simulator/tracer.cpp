@@ -0,0 +1,158 @@
+/**
+ * @file
+ * @brief Ring registry and background drainer of `tracer.h`
+ *
+ * @details
+ * The drainer wakes every millisecond, or at once when a thread waits for
+ * room, copies the new events of every ring into its `binary::writer` and
+ * advances the ring's `tail`. `tracer_close` stops it, drains what is left
+ * and closes the files; it is also registered with `atexit`.
+ */
+
+#include "tracer.h"
+
+#include <chrono>              /// for std::chrono::milliseconds
+#include <condition_variable>  /// for std::condition_variable
+#include <cstdio>              /// for snprintf
+#include <cstdlib>             /// for getenv, atexit
+#include <memory>              /// for std::unique_ptr
+#include <mutex>               /// for std::mutex
+#include <string>              /// for std::string
+#include <thread>              /// for std::thread
+#include <vector>              /// for std::vector
+
+#include "binary_trace.h"
+
+__thread tracer_ring* tracer_active = nullptr;
+
+namespace {
+    namespace binary = simulator::binary;
+
+    /** A ring and the file it drains to. */
+    struct stream {
+        tracer_ring ring{};
+        binary::writer out;
+        bool ok = false;
+    };
+
+    class registry {
+     public:
+        /** Ring of a thread that starts tracing for the first time. */
+        tracer_ring* add() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (streams_.empty()) {
+                const char* env = getenv("AOR2_TRACER_OUT");
+                path_ = env && *env ? env : "trace.trc";
+                atexit(tracer_close);
+                drainer_ = std::thread([this] { drain_loop(); });
+            }
+            std::string path = path_;
+            if (!streams_.empty())
+                path += "." + std::to_string(streams_.size());
+            streams_.emplace_back(new stream());
+            streams_.back()->ok = streams_.back()->out.open(path);
+            return &streams_.back()->ring;
+        }
+
+        /** Wakes the drainer and waits until `r` has room. */
+        void wait(tracer_ring* r) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            for (;;) {
+                if (stop_) {
+                    // closed: nothing is drained any more, so overwrite
+                    tracer_active = nullptr;
+                    return;
+                }
+                r->tail_seen = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+                if (r->head - r->tail_seen < TRACER_RING_EVENTS)
+                    return;
+                wake_.notify_one();
+                drained_.wait(lock);
+            }
+        }
+
+        void close() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (stop_ || !drainer_.joinable())
+                    return;
+                stop_ = true;
+            }
+            wake_.notify_one();
+            drainer_.join();
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& s : streams_) {
+                drain(*s);
+                if (s->ok)
+                    s->out.close();
+            }
+        }
+
+     private:
+        void drain_loop() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!stop_) {
+                for (auto& s : streams_)
+                    drain(*s);
+                drained_.notify_all();
+                wake_.wait_for(lock, std::chrono::milliseconds(1));
+            }
+        }
+
+        /** Moves the new events of `s.ring` to its file. */
+        static void drain(stream& s) {
+            tracer_ring& r = s.ring;
+            const uint64_t head = __atomic_load_n(&r.head, __ATOMIC_ACQUIRE);
+            for (uint64_t i = r.tail; i < head; ++i) {
+                const tracer_event& e = r.events[i & (TRACER_RING_EVENTS - 1)];
+                if (!s.ok)
+                    continue;
+                if (e.type == TRACER_PREFETCH) {
+                    // not a Lackey record, kept as its text line
+                    char line[48];
+                    const int n = snprintf(line, sizeof(line), "P%c %08llx,%u", e.value,
+                        static_cast<unsigned long long>(e.address), e.size);
+                    s.out.add({binary::kind::text, false, static_cast<uint32_t>(n), 0}, line);
+                }
+                else
+                    s.out.add({static_cast<binary::kind>(e.type), e.value != 0, e.size,
+                        e.address});
+            }
+            __atomic_store_n(&r.tail, head, __ATOMIC_RELEASE);
+        }
+
+        std::mutex mutex_;
+        std::condition_variable wake_, drained_;
+        std::vector<std::unique_ptr<stream>> streams_;
+        std::thread drainer_;
+        std::string path_;
+        bool stop_ = false;
+    };
+
+    registry& get_registry() {
+        static registry r;
+        return r;
+    }
+
+    /** Ring of the calling thread, once it has one. */
+    thread_local tracer_ring* own = nullptr;
+}  // namespace
+
+void tracer_begin(void) {
+    if (!own)
+        own = get_registry().add();
+    tracer_active = own;
+}
+
+void tracer_end(void) {
+    tracer_active = nullptr;
+}
+
+void tracer_close(void) {
+    tracer_active = nullptr;
+    get_registry().close();
+}
+
+void tracer_wait(tracer_ring* r) {
+    get_registry().wait(r);
+}
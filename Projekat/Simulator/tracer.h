@@ -0,0 +1,141 @@
+#pragma once
+/**
+ * @file
+ * @brief In-process branch and memory tracing into the binary trace format
+ *
+ * @details
+ * A replacement for capturing `Hello.c` with Valgrind Lackey: the program
+ * marks what it wants traced and only the region between `TRACE_BEGIN()`
+ * and `TRACE_END()` (the `pocetak()`/`kraj()` markers) is recorded.
+ *
+ *  - `TRACE_BRANCH(cond)` evaluates to `cond` and records a branch
+ *    (`B  pc T|N`); the pc is a code address at that use of the macro,
+ *    inside its function, so every use is one branch and symbols name it;
+ *  - `TRACE_INSTR()` records an instruction fetch of the macro's address,
+ *    which `hierarchy_sim` uses as the PC of the accesses that follow;
+ *  - `TRACE_LOAD(p)`, `TRACE_STORE(p)`, `TRACE_MODIFY(p)` record an access
+ *    of `sizeof(*p)` bytes at `p`;
+ *  - `TRACE_PREFETCH(p, hint)` records a `P0/P1/P2/PN` prefetch record,
+ *    `hint` being one of `'0'`, `'1'`, `'2'`, `'N'`.
+ *
+ * Without `AOR2_TRACER` defined the macros do nothing (`TRACE_BRANCH(c)` is
+ * `(c)`), so the program can still be traced with Lackey. With it:
+ *
+ *     g++ -O2 -c tracer.cpp -pthread
+ *     gcc -O2 -DAOR2_TRACER Hello.c tracer.o -o Hello -lstdc++ -pthread
+ *     AOR2_TRACER_OUT=hello.trc ./Hello
+ *
+ * Each record is written into a ring buffer of the calling thread (no lock,
+ * no call, a few stores); a background thread drains the rings and encodes
+ * them with `simulator::binary::writer`. A thread only waits if its ring is
+ * full. Every thread gets its own file: the first one to call
+ * `TRACE_BEGIN()` writes `AOR2_TRACER_OUT` (default `trace.trc`), the
+ * others `<file>.1`, `<file>.2`, ... The files are complete once
+ * `tracer_close()` returns, which happens at exit at the latest.
+ *
+ * The macros use GNU C statement expressions (gcc, clang).
+ */
+
+#include <stdint.h>  /// for uint64_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Record kinds, in the order of `simulator::binary::kind`. */
+enum tracer_kind { TRACER_BRANCH, TRACER_INSTR, TRACER_LOAD, TRACER_STORE, TRACER_MODIFY,
+    TRACER_PREFETCH };
+
+/** One record in a ring. */
+struct tracer_event {
+    uint64_t address;
+    uint32_t size;
+    uint8_t type;   /// `tracer_kind`
+    uint8_t value;  /// branch outcome, or prefetch hint
+};
+
+#define TRACER_RING_EVENTS (1u << 16)  /// power of 2
+
+/**
+ * Ring of one thread. `head` is written by the thread, `tail` by the
+ * drainer, each on its own cache line.
+ */
+struct tracer_ring {
+    uint64_t head;
+    uint64_t tail_seen;  /// last `tail` the thread read
+    char pad0[48];
+    uint64_t tail;
+    char pad1[56];
+    struct tracer_event events[TRACER_RING_EVENTS];
+};
+
+/** Ring of the calling thread while it is inside a traced region. */
+extern __thread struct tracer_ring* tracer_active;
+
+/** Starts recording the calling thread. */
+void tracer_begin(void);
+
+/** Stops recording the calling thread. */
+void tracer_end(void);
+
+/** Writes everything recorded so far and closes the files. */
+void tracer_close(void);
+
+/** Waits until the ring of the calling thread has room. */
+void tracer_wait(struct tracer_ring* r);
+
+static inline void tracer_put(uint8_t type, uint64_t address, uint32_t size, uint8_t value)
+{
+    struct tracer_ring* r = tracer_active;
+    if (!r)
+        return;
+    const uint64_t h = r->head;
+    if (h - r->tail_seen == TRACER_RING_EVENTS) {
+        r->tail_seen = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        if (h - r->tail_seen == TRACER_RING_EVENTS)
+            tracer_wait(r);
+    }
+    struct tracer_event* e = &r->events[h & (TRACER_RING_EVENTS - 1)];
+    e->address = address;
+    e->size = size;
+    e->type = type;
+    e->value = value;
+    __atomic_store_n(&r->head, h + 1, __ATOMIC_RELEASE);
+}
+
+static inline int tracer_branch(const void* pc, int taken)
+{
+    tracer_put(TRACER_BRANCH, (uint64_t)(uintptr_t)pc, 0, (uint8_t)taken);
+    return taken;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef AOR2_TRACER
+
+/// code address of this use of a macro, a local label (GNU labels as values)
+#define TRACER_SITE() ({ __label__ tracer_site_; tracer_site_: ; (const void*)&&tracer_site_; })
+
+#define TRACE_BEGIN()           tracer_begin()
+#define TRACE_END()             tracer_end()
+#define TRACE_BRANCH(cond)      tracer_branch(TRACER_SITE(), (cond) != 0)
+#define TRACE_INSTR()           tracer_put(TRACER_INSTR, (uint64_t)(uintptr_t)TRACER_SITE(), 1, 0)
+#define TRACE_LOAD(p)           tracer_put(TRACER_LOAD, (uint64_t)(uintptr_t)(p), sizeof(*(p)), 0)
+#define TRACE_STORE(p)          tracer_put(TRACER_STORE, (uint64_t)(uintptr_t)(p), sizeof(*(p)), 0)
+#define TRACE_MODIFY(p)         tracer_put(TRACER_MODIFY, (uint64_t)(uintptr_t)(p), sizeof(*(p)), 0)
+#define TRACE_PREFETCH(p, hint) tracer_put(TRACER_PREFETCH, (uint64_t)(uintptr_t)(p), 1, (hint))
+
+#else
+
+#define TRACE_BEGIN()           ((void)0)
+#define TRACE_END()             ((void)0)
+#define TRACE_BRANCH(cond)      (cond)
+#define TRACE_INSTR()           ((void)0)
+#define TRACE_LOAD(p)           ((void)0)
+#define TRACE_STORE(p)          ((void)0)
+#define TRACE_MODIFY(p)         ((void)0)
+#define TRACE_PREFETCH(p, hint) ((void)0)
+
+#endif
@@ -0,0 +1,72 @@
+// Batch driver: maximum sum rectangle of every matrix
+// in a stream, reported as matrices per second.
+//
+//   Batch in.bin out.bin [threads]
+//   Batch -g in.bin count rows cols	(writes a random stream)
+//
+// Build: gcc -O2 -mavx2 Batch.c maxsum*.c -lpthread
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "maxsum.h"
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int generate(const char* path, long long count, int rows, int cols)
+{
+	FILE* f = fopen(path, "wb");
+	int* a = malloc(sizeof(int) * ((size_t)rows * cols + 2));
+	long long k;
+	int i;
+
+	if (!f || !a)
+	{
+		if (f)
+			fclose(f);
+		free(a);
+		return 1;
+	}
+	a[0] = rows;
+	a[1] = cols;
+	for (k = 0; k < count; ++k)
+	{
+		for (i = 0; i < rows * cols; ++i)
+			a[i + 2] = rand() % 201 - 100;
+		fwrite(a, sizeof(int), (size_t)rows * cols + 2, f);
+	}
+	free(a);
+	return fclose(f) != 0;
+}
+
+int main(int argc, char** argv)
+{
+	long long n;
+	double t;
+
+	if (argc == 6 && argv[1][0] == '-' && argv[1][1] == 'g')
+		return generate(argv[2], atoll(argv[3]), atoi(argv[4]),
+			atoi(argv[5]));
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s in.bin out.bin [threads]\n"
+			"       %s -g in.bin count rows cols\n", argv[0], argv[0]);
+		return 1;
+	}
+
+	t = now();
+	n = maxsum_batch(argv[1], argv[2], argc > 3 ? atoi(argv[3]) : 0);
+	t = now() - t;
+	if (n < 0)
+	{
+		fprintf(stderr, "%s: can not process %s\n", argv[0], argv[1]);
+		return 1;
+	}
+	printf("%lld matrices in %.3f s, %.0f matrices/s\n", n, t,
+		t > 0 ? n / t : 0.0);
+	return 0;
+}
@@ -4,6 +4,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+// TRACE_* record the region between pocetak() and kraj() when built
+// with -DAOR2_TRACER, and do nothing otherwise
+#include "../../Simulator/tracer.h"
 #define ROW 30
 #define COL 30
 // Implementation of Kadane's algorithm
@@ -25,36 +28,45 @@ int kadane(int* arr, int* start,
 	// local variable
 	int local_start = 0;
 
-	for (i = 0; i < n; ++i)
+	for (i = 0; TRACE_BRANCH(i < n); ++i)
 	{
+		TRACE_LOAD(&arr[i]);
 		sum += arr[i];
-		if (sum < 0) {
+		if (TRACE_BRANCH(sum < 0)) {
 			sum = 0;
 			local_start = i + 1;
 		}
-		else if (sum > maxSum)
+		else if (TRACE_BRANCH(sum > maxSum))
 		{
 			maxSum = sum;
+			TRACE_STORE(start);
+			TRACE_STORE(finish);
 			*start = local_start;
 			*finish = i;
 		}
 	}
 
 	// There is at-least one non-negative number
-	if (*finish != -1)
+	if (TRACE_BRANCH(*finish != -1))
 		return maxSum;
 
 	// Special Case: When all numbers in arr[]
 	// are negative
+	TRACE_LOAD(&arr[0]);
 	maxSum = arr[0];
+	TRACE_STORE(start);
+	TRACE_STORE(finish);
 	*start = *finish = 0;
 
 	// Find the maximum element in array
-	for (i = 1; i < n; i++)
+	for (i = 1; TRACE_BRANCH(i < n); i++)
 	{
-		if (arr[i] > maxSum)
+		TRACE_LOAD(&arr[i]);
+		if (TRACE_BRANCH(arr[i] > maxSum))
 		{
 			maxSum = arr[i];
+			TRACE_STORE(start);
+			TRACE_STORE(finish);
 			*start = *finish = i;
 		}
 	}
@@ -77,18 +89,22 @@ void findMaxSum(int M[][COL])
 	int temp[ROW], sum, start, finish;
 
 	// Set the left column
-	for (left = 0; left < COL; ++left)
+	for (left = 0; TRACE_BRANCH(left < COL); ++left)
 	{
 		// Initialize all elements of temp as 0
 		memset(temp, 0, sizeof(temp));
 
 		// Set the right column for the left column set by
 		// outer loop
-		for (right = left; right < COL; ++right) {
+		for (right = left; TRACE_BRANCH(right < COL); ++right) {
 			// Calculate sum between current left and right
 			// for every row 'i'
-			for (i = 0; i < ROW; ++i)
+			for (i = 0; TRACE_BRANCH(i < ROW); ++i)
+			{
+				TRACE_LOAD(&M[i][right]);
+				TRACE_MODIFY(&temp[i]);
 				temp[i] += M[i][right];
+			}
 
 			// Find the maximum sum subarray in temp[].
 			// The kadane() function also sets values of
@@ -101,7 +117,7 @@ void findMaxSum(int M[][COL])
 			// Compare sum with maximum sum so far. If sum
 			// is more, then update maxSum and other output
 			// values
-			if (sum > maxSum)
+			if (TRACE_BRANCH(sum > maxSum))
 			{
 				maxSum = sum;
 				finalLeft = left;
@@ -119,8 +135,8 @@ void findMaxSum(int M[][COL])
 	printf("Max sum is: %d\n", maxSum);
 }
 
-void pocetak(){}
-void kraj(){}
+void pocetak(){ TRACE_BEGIN(); }
+void kraj(){ TRACE_END(); }
 
 // Driver Code
 int main()
@@ -0,0 +1,437 @@
+// Test driver: every max-sum kernel of maxsum.h against
+// find_max_sum() on random matrices, the int8 and int16
+// ones with their elements widened to int. In matrices
+// of extremes every row is all lowest or all highest
+// values, so the narrow row sums get as large as they
+// can.
+//
+//   Test [seed]
+//
+// Build: gcc -O2 -mavx2 Test.c maxsum*.c -lpthread
+//
+// The mmap kernel and the batch mode go through two
+// files in $TMPDIR (default /tmp), removed at the end.
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "maxsum.h"
+
+static int failures;
+static char in_path[4096], out_path[4096];
+
+static int same_rect(const max_rect* a, const max_rect* b)
+{
+	return a->sum == b->sum && a->top == b->top && a->left == b->left &&
+		a->bottom == b->bottom && a->right == b->right;
+}
+
+static void check(const char* kernel, int rows, int cols,
+		const max_rect* got, const max_rect* want, int sum_only)
+{
+	if (sum_only ? got->sum == want->sum : same_rect(got, want))
+		return;
+	++failures;
+	fprintf(stderr, "%s %dx%d: sum %lld (%d,%d)-(%d,%d), "
+		"expected %lld (%d,%d)-(%d,%d)\n", kernel, rows, cols,
+		got->sum, got->top, got->left, got->bottom, got->right,
+		want->sum, want->top, want->left, want->bottom, want->right);
+}
+
+// Random element in lo..hi.
+static int element(int lo, int hi)
+{
+	return lo + (int)(rand() % ((long)hi - lo + 1));
+}
+
+// Random rows x cols matrix in lo..hi; with 'extreme'
+// every row is lo or hi throughout.
+static void fill(int* M, int rows, int cols, int lo, int hi, int extreme)
+{
+	int i, j, v;
+
+	for (i = 0; i < rows; ++i)
+	{
+		v = rand() % 2 ? lo : hi;
+		for (j = 0; j < cols; ++j)
+			M[(size_t)i * cols + j] = extreme ? v : element(lo, hi);
+	}
+}
+
+// A new empty file in $TMPDIR, its name in path[4096];
+// 0 if it can not be made.
+static int temporary_file(char* path)
+{
+	const char* dir = getenv("TMPDIR");
+	int fd;
+
+	snprintf(path, 4096, "%s/maxsum_XXXXXX", dir && *dir ? dir : "/tmp");
+	fd = mkstemp(path);
+	if (fd < 0)
+		return 0;
+	close(fd);
+	return 1;
+}
+
+// Appends M as one record of the maxsum_batch()
+// stream: rows, cols and the elements.
+static int write_matrix(FILE* f, const int* M, int rows, int cols)
+{
+	int header[2];
+
+	header[0] = rows;
+	header[1] = cols;
+	return fwrite(header, sizeof(int), 2, f) == 2 &&
+		fwrite(M, sizeof(int), (size_t)rows * cols, f) ==
+			(size_t)rows * cols;
+}
+
+// find_max_sum_mmap() on M written to in_path, with the
+// default budget and with ones for groups of 1 and 3
+// left columns (tiles of 2 and 6 columns).
+static void test_mmap(const int* M, int rows, int cols,
+		const max_rect* want)
+{
+	const size_t budgets[] = { 0, 16, 48 };
+	FILE* f = fopen(in_path, "wb");
+	max_rect got;
+	int k;
+
+	if (!f || !write_matrix(f, M, rows, cols))
+	{
+		++failures;
+		if (f)
+			fclose(f);
+		return;
+	}
+	fclose(f);
+	for (k = 0; k < 3; ++k)
+	{
+		got = find_max_sum_mmap(in_path, budgets[k] * rows);
+		check("mmap", rows, cols, &got, want, 0);
+	}
+}
+
+#define WINDOWS 20
+
+// Random index in lo..hi, ordered pair of them.
+static void span(int lo, int hi, int* a, int* b)
+{
+	int x = element(lo, hi), y = element(lo, hi);
+
+	*a = x < y ? x : y;
+	*b = x < y ? y : x;
+}
+
+// maxsum_index on the whole matrix and on random
+// windows, some reaching past the matrix and some
+// outside of it. Sums are checked against adding up
+// the clipped window, rectangles against find_max_sum()
+// on a copy of it; then the same windows as batches,
+// with the query batch on 1 and on 3 threads.
+static void test_index(const int* M, int rows, int cols,
+		const max_rect* want)
+{
+	maxsum_index* idx = maxsum_index_build(M, rows, cols);
+	int* S = malloc(sizeof(int) * (size_t)rows * cols);
+	maxsum_window w[WINDOWS];
+	long long sums[WINDOWS], got_sums[WINDOWS];
+	max_rect rects[WINDOWS], got_rects[WINDOWS], got;
+	int q, t, i, j, top, left, bottom, right;
+
+	if (!idx || !S)
+	{
+		++failures;
+		maxsum_index_free(idx);
+		free(S);
+		return;
+	}
+	w[0].top = w[0].left = 0;
+	w[0].bottom = rows - 1;
+	w[0].right = cols - 1;
+	got = maxsum_index_max_rect(idx, w[0]);
+	check("index", rows, cols, &got, want, 0);
+
+	for (q = 0; q < WINDOWS; ++q)
+	{
+		if (q > 0)
+		{
+			span(-2, rows + 1, &w[q].top, &w[q].bottom);
+			span(-2, cols + 1, &w[q].left, &w[q].right);
+		}
+		top = w[q].top > 0 ? w[q].top : 0;
+		left = w[q].left > 0 ? w[q].left : 0;
+		bottom = w[q].bottom < rows ? w[q].bottom : rows - 1;
+		right = w[q].right < cols ? w[q].right : cols - 1;
+
+		sums[q] = 0;
+		for (i = top; i <= bottom; ++i)
+			for (j = left; j <= right; ++j)
+			{
+				S[(size_t)(i - top) * (right - left + 1) + j - left] =
+					M[(size_t)i * cols + j];
+				sums[q] += M[(size_t)i * cols + j];
+			}
+		if (top > bottom || left > right)
+		{
+			rects[q].sum = LLONG_MIN;
+			rects[q].top = rects[q].left = -1;
+			rects[q].bottom = rects[q].right = -1;
+		}
+		else
+		{
+			rects[q] = find_max_sum(S, bottom - top + 1,
+				right - left + 1);
+			rects[q].top += top;
+			rects[q].bottom += top;
+			rects[q].left += left;
+			rects[q].right += left;
+		}
+
+		got_sums[q] = maxsum_index_sum(idx, w[q]);
+		if (got_sums[q] != sums[q])
+		{
+			++failures;
+			fprintf(stderr, "index sum %dx%d: %lld, expected %lld\n",
+				rows, cols, got_sums[q], sums[q]);
+		}
+		got = maxsum_index_max_rect(idx, w[q]);
+		check("index window", rows, cols, &got, &rects[q], 0);
+	}
+
+	memset(got_sums, 0, sizeof(got_sums));
+	maxsum_index_sums(idx, w, WINDOWS, got_sums);
+	for (q = 0; q < WINDOWS; ++q)
+		if (got_sums[q] != sums[q])
+		{
+			++failures;
+			fprintf(stderr, "index sums %dx%d: %lld, expected %lld\n",
+				rows, cols, got_sums[q], sums[q]);
+		}
+	for (t = 1; t <= 3; t += 2)
+	{
+		memset(got_rects, 0, sizeof(got_rects));
+		maxsum_index_max_rects(idx, w, WINDOWS, got_rects, t);
+		for (q = 0; q < WINDOWS; ++q)
+			check(t == 1 ? "index batch" : "index batch, 3 threads",
+				rows, cols, &got_rects[q], &rects[q], 0);
+	}
+	maxsum_index_free(idx);
+	free(S);
+}
+
+// maxsum_dynamic on M, then after each of a series of
+// random point updates against find_max_sum() on the
+// updated matrix. Equal sums may end in another
+// rectangle, see maxsum.h, so only sums are compared.
+static void test_dynamic(const int* M, int rows, int cols,
+		const max_rect* want)
+{
+	int* U = malloc(sizeof(int) * (size_t)rows * cols);
+	maxsum_dynamic* d = maxsum_dynamic_build(M, rows, cols);
+	max_rect got, now;
+	int k, i, j;
+
+	if (!U || !d)
+	{
+		++failures;
+		free(U);
+		maxsum_dynamic_free(d);
+		return;
+	}
+	memcpy(U, M, sizeof(int) * (size_t)rows * cols);
+	got = maxsum_dynamic_query_max_rectangle(d);
+	check("dynamic", rows, cols, &got, want, 1);
+	for (k = 0; k < 20; ++k)
+	{
+		i = rand() % rows;
+		j = rand() % cols;
+		U[(size_t)i * cols + j] = element(-1000, 1000);
+		maxsum_dynamic_update(d, i, j, U[(size_t)i * cols + j]);
+		got = maxsum_dynamic_query_max_rectangle(d);
+		now = find_max_sum(U, rows, cols);
+		check("dynamic update", rows, cols, &got, &now, 1);
+	}
+	maxsum_dynamic_free(d);
+	free(U);
+}
+
+// The int kernels on the same matrix.
+static void test_int(const int* M, int rows, int cols,
+		const max_rect* want)
+{
+	max_rect got;
+
+	got = find_max_sum_simd(M, rows, cols);
+	check("simd", rows, cols, &got, want, 0);
+	got = find_max_sum_parallel(M, rows, cols, 3);
+	check("parallel", rows, cols, &got, want, 0);
+	got = find_max_sum_pruned(M, rows, cols, NULL);
+	check("pruned", rows, cols, &got, want, 0);
+
+	test_index(M, rows, cols, want);
+	test_dynamic(M, rows, cols, want);
+
+	test_mmap(M, rows, cols, want);
+}
+
+#define BATCH 150
+
+// maxsum_batch() on a stream of BATCH random matrices
+// of up to 9 x 12, over two chunks, with 1 and with 3
+// threads; every result against find_max_sum().
+static void test_batch(void)
+{
+	static int M[9 * 12];
+	max_rect want[BATCH], got[BATCH];
+	int size[BATCH][2];
+	FILE* f = fopen(in_path, "wb");
+	long long n;
+	int k, t, rows, cols;
+
+	if (!f)
+	{
+		++failures;
+		return;
+	}
+	for (k = 0; k < BATCH; ++k)
+	{
+		rows = size[k][0] = element(1, 9);
+		cols = size[k][1] = element(1, 12);
+		fill(M, rows, cols, -100, 100, 0);
+		want[k] = find_max_sum(M, rows, cols);
+		if (!write_matrix(f, M, rows, cols))
+			++failures;
+	}
+	if (fclose(f) != 0)
+		++failures;
+
+	for (t = 1; t <= 3; t += 2)
+	{
+		n = maxsum_batch(in_path, out_path, t);
+		f = fopen(out_path, "rb");
+		if (n != BATCH || !f ||
+			fread(got, sizeof(max_rect), BATCH, f) != BATCH)
+		{
+			++failures;
+			fprintf(stderr, "batch, %d threads: %lld matrices\n", t, n);
+		}
+		else
+			for (k = 0; k < BATCH; ++k)
+				check(t == 1 ? "batch" : "batch, 3 threads", size[k][0],
+					size[k][1], &got[k], &want[k], 0);
+		if (f)
+			fclose(f);
+	}
+}
+
+static void test_i8(int rows, int cols, int extreme)
+{
+	signed char* N = malloc((size_t)rows * cols);
+	int* M = malloc(sizeof(int) * (size_t)rows * cols);
+	max_rect got, want;
+	int i;
+
+	if (!N || !M)
+	{
+		++failures;
+		free(N);
+		free(M);
+		return;
+	}
+	fill(M, rows, cols, -128, 127, extreme);
+	for (i = 0; i < rows * cols; ++i)
+		N[i] = (signed char)M[i];
+	want = find_max_sum(M, rows, cols);
+	got = find_max_sum_i8(N, rows, cols);
+	check("i8", rows, cols, &got, &want, 0);
+	free(N);
+	free(M);
+}
+
+static void test_i16(int rows, int cols, int extreme)
+{
+	short* N = malloc(sizeof(short) * (size_t)rows * cols);
+	int* M = malloc(sizeof(int) * (size_t)rows * cols);
+	max_rect got, want;
+	int i;
+
+	if (!N || !M)
+	{
+		++failures;
+		free(N);
+		free(M);
+		return;
+	}
+	fill(M, rows, cols, -32768, 32767, extreme);
+	for (i = 0; i < rows * cols; ++i)
+		N[i] = (short)M[i];
+	want = find_max_sum(M, rows, cols);
+	got = find_max_sum_i16(N, rows, cols);
+	check("i16", rows, cols, &got, &want, 0);
+	free(N);
+	free(M);
+}
+
+int main(int argc, char** argv)
+{
+	// 1 and 2 rows/columns, the sizes of Hello.c and both
+	// sides of the 256 columns where int8 row sums widen
+	// from 16 to 32 bits
+	static const int sizes[][2] = {
+		{ 1, 1 }, { 1, 7 }, { 7, 1 }, { 2, 2 }, { 5, 9 },
+		{ 30, 30 }, { 17, 40 }, { 3, 256 }, { 3, 257 }, { 2, 300 }
+	};
+	int s, k, rows, cols;
+
+	srand(argc > 1 ? (unsigned)atoi(argv[1]) : 1);
+	if (!temporary_file(in_path) || !temporary_file(out_path))
+	{
+		perror("mkstemp");
+		return 1;
+	}
+	for (s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); ++s)
+	{
+		rows = sizes[s][0];
+		cols = sizes[s][1];
+		for (k = 0; k < 4; ++k)
+		{
+			// k = 0: mostly positive, 1: mixed,
+			// 2: all negative, 3: extremes
+			int* M = malloc(sizeof(int) * (size_t)rows * cols);
+			max_rect want;
+
+			if (!M)
+			{
+				++failures;
+				continue;
+			}
+			if (k == 0)
+				fill(M, rows, cols, -20, 100, 0);
+			else if (k == 1)
+				fill(M, rows, cols, -100, 100, 0);
+			else if (k == 2)
+				fill(M, rows, cols, -100, -1, 0);
+			else
+				fill(M, rows, cols, -1000000, 1000000, 1);
+			want = find_max_sum(M, rows, cols);
+			test_int(M, rows, cols, &want);
+			free(M);
+
+			test_i8(rows, cols, k == 3);
+			test_i16(rows, cols, k == 3);
+		}
+	}
+
+	test_batch();
+	remove(in_path);
+	remove(out_path);
+	if (failures)
+	{
+		fprintf(stderr, "%d failures\n", failures);
+		return 1;
+	}
+	printf("all kernels agree with find_max_sum()\n");
+	return 0;
+}
@@ -0,0 +1,455 @@
+// Maximum sum rectangle library, see maxsum.h
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "maxsum.h"
+#include "maxsum_impl.h"
+
+MAXSUM_KADANE(kadane64, long long)
+
+max_rect find_max_sum(const int* M, int rows, int cols)
+{
+	max_rect best = maxsum_empty_rect();
+	int left, right, i, start, finish;
+	long long sum;
+
+	if (rows <= 0 || cols <= 0)
+		return best;
+
+	// Column-major copy, so that adding column 'right'
+	// to temp[] is a contiguous (vectorizable) loop
+	// instead of one cache line per row.
+	int* T = malloc(sizeof(int) * (size_t)rows * cols);
+	long long* temp = malloc(sizeof(long long) * rows);
+	if (!T || !temp)
+	{
+		free(T);
+		free(temp);
+		return best;
+	}
+	for (i = 0; i < rows; ++i)
+		for (right = 0; right < cols; ++right)
+			T[(size_t)right * rows + i] = M[(size_t)i * cols + right];
+
+	for (left = 0; left < cols; ++left)
+	{
+		memset(temp, 0, sizeof(long long) * rows);
+
+		for (right = left; right < cols; ++right)
+		{
+			const int* col = T + (size_t)right * rows;
+			for (i = 0; i < rows; ++i)
+				temp[i] += col[i];
+
+			sum = kadane64(temp, rows, &start, &finish);
+			if (sum > best.sum)
+			{
+				best.sum = sum;
+				best.left = left;
+				best.right = right;
+				best.top = start;
+				best.bottom = finish;
+			}
+		}
+	}
+
+	free(T);
+	free(temp);
+	return best;
+}
+
+#ifdef __AVX2__
+// Inclusive prefix sum of the 4 lanes of x.
+static __m256i scan4(__m256i x)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	// [0, x0, x1, x2]
+	__m256i t = _mm256_blend_epi32(
+		_mm256_permute4x64_epi64(x, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0x03);
+	x = _mm256_add_epi64(x, t);
+	// [0, 0, x0, x1]
+	t = _mm256_blend_epi32(
+		_mm256_permute4x64_epi64(x, _MM_SHUFFLE(1, 0, 0, 0)), zero, 0x0F);
+	return _mm256_add_epi64(x, t);
+}
+
+// One Kadane step for 4 lanes, without branches:
+// reset to 0 where the sum went negative, keep the
+// best sum and its start/finish where it grew, and
+// track the largest element for the all-negative case.
+#define KADANE_STEP4(v, h) \
+	do { \
+		sum[h] = _mm256_add_epi64(sum[h], v); \
+		__m256i neg = _mm256_cmpgt_epi64(zero, sum[h]); \
+		sum[h] = _mm256_andnot_si256(neg, sum[h]); \
+		ls[h] = _mm256_blendv_epi8(ls[h], next, neg); \
+		__m256i upd = _mm256_andnot_si256(neg, \
+			_mm256_cmpgt_epi64(sum[h], mx[h])); \
+		mx[h] = _mm256_blendv_epi8(mx[h], sum[h], upd); \
+		st[h] = _mm256_blendv_epi8(st[h], ls[h], upd); \
+		fi[h] = _mm256_blendv_epi8(fi[h], idx, upd); \
+		__m256i e = _mm256_cmpgt_epi64(v, el[h]); \
+		el[h] = _mm256_blendv_epi8(el[h], v, e); \
+		ei[h] = _mm256_blendv_epi8(ei[h], idx, e); \
+	} while (0)
+#endif
+
+// Runs kadane64() for the column pairs (left, r0) ..
+// (left, r0 + MAXSUM_LANES - 1) at once. base[i] is
+// the sum of row i over columns left..r0-1 and is
+// advanced past the block on return.
+static void kadane_lanes(const int* M, int rows, int cols, int r0,
+		long long* base, long long* best, int* start, int* finish)
+{
+	int i, k;
+#ifdef __AVX2__
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i sum[2], mx[2], ls[2], st[2], fi[2], el[2], ei[2];
+	long long out[4];
+
+	for (k = 0; k < 2; ++k)
+	{
+		sum[k] = ls[k] = st[k] = ei[k] = zero;
+		mx[k] = el[k] = _mm256_set1_epi64x(LLONG_MIN);
+		fi[k] = _mm256_set1_epi64x(-1);
+	}
+	for (i = 0; i < rows; ++i)
+	{
+		__m256i x = _mm256_loadu_si256(
+			(const __m256i*)(M + (size_t)i * cols + r0));
+		__m256i lo = scan4(_mm256_cvtepi32_epi64(
+			_mm256_castsi256_si128(x)));
+		__m256i hi = scan4(_mm256_cvtepi32_epi64(
+			_mm256_extracti128_si256(x, 1)));
+		lo = _mm256_add_epi64(lo, _mm256_set1_epi64x(base[i]));
+		hi = _mm256_add_epi64(hi, _mm256_permute4x64_epi64(lo, 0xFF));
+		base[i] = _mm256_extract_epi64(hi, 3);
+
+		const __m256i idx = _mm256_set1_epi64x(i);
+		const __m256i next = _mm256_set1_epi64x(i + 1);
+		KADANE_STEP4(lo, 0);
+		KADANE_STEP4(hi, 1);
+	}
+	for (k = 0; k < 2; ++k)
+	{
+		// all-negative lanes take the largest element
+		__m256i none = _mm256_cmpeq_epi64(fi[k], _mm256_set1_epi64x(-1));
+		mx[k] = _mm256_blendv_epi8(mx[k], el[k], none);
+		st[k] = _mm256_blendv_epi8(st[k], ei[k], none);
+		fi[k] = _mm256_blendv_epi8(fi[k], ei[k], none);
+		_mm256_storeu_si256((__m256i*)out, mx[k]);
+		for (i = 0; i < 4; ++i)
+			best[4 * k + i] = out[i];
+		_mm256_storeu_si256((__m256i*)out, st[k]);
+		for (i = 0; i < 4; ++i)
+			start[4 * k + i] = (int)out[i];
+		_mm256_storeu_si256((__m256i*)out, fi[k]);
+		for (i = 0; i < 4; ++i)
+			finish[4 * k + i] = (int)out[i];
+	}
+#else
+	long long sum[MAXSUM_LANES], mx[MAXSUM_LANES], el[MAXSUM_LANES];
+	int ls[MAXSUM_LANES], st[MAXSUM_LANES], fi[MAXSUM_LANES];
+	int ei[MAXSUM_LANES];
+
+	for (k = 0; k < MAXSUM_LANES; ++k)
+	{
+		sum[k] = 0;
+		mx[k] = el[k] = LLONG_MIN;
+		ls[k] = st[k] = ei[k] = 0;
+		fi[k] = -1;
+	}
+	for (i = 0; i < rows; ++i)
+	{
+		const int* row = M + (size_t)i * cols + r0;
+		long long v = base[i];
+		for (k = 0; k < MAXSUM_LANES; ++k)
+		{
+			v += row[k];
+			// same step as kadane64(), with selects
+			// instead of branches
+			sum[k] += v;
+			int neg = sum[k] < 0;
+			sum[k] = neg ? 0 : sum[k];
+			ls[k] = neg ? i + 1 : ls[k];
+			int upd = !neg & (sum[k] > mx[k]);
+			mx[k] = upd ? sum[k] : mx[k];
+			st[k] = upd ? ls[k] : st[k];
+			fi[k] = upd ? i : fi[k];
+			int e = v > el[k];
+			el[k] = e ? v : el[k];
+			ei[k] = e ? i : ei[k];
+		}
+		base[i] = v;
+	}
+	for (k = 0; k < MAXSUM_LANES; ++k)
+	{
+		int none = fi[k] == -1;
+		best[k] = none ? el[k] : mx[k];
+		start[k] = none ? ei[k] : st[k];
+		finish[k] = none ? ei[k] : fi[k];
+	}
+#endif
+}
+
+max_rect maxsum_simd_search(const int* M, int rows, int cols,
+		long long* base)
+{
+	max_rect best = maxsum_empty_rect();
+	long long lane_sum[MAXSUM_LANES];
+	int lane_start[MAXSUM_LANES], lane_finish[MAXSUM_LANES];
+	int left, right, i, k, start, finish;
+	long long sum;
+
+	if (rows <= 0 || cols <= 0)
+		return best;
+
+	for (left = 0; left < cols; ++left)
+	{
+		memset(base, 0, sizeof(long long) * rows);
+
+		for (right = left; right + MAXSUM_LANES <= cols;
+				right += MAXSUM_LANES)
+		{
+			kadane_lanes(M, rows, cols, right, base,
+				lane_sum, lane_start, lane_finish);
+			// lanes in order of 'right', so ties go to
+			// the same pair as in find_max_sum()
+			for (k = 0; k < MAXSUM_LANES; ++k)
+			{
+				if (lane_sum[k] > best.sum)
+				{
+					best.sum = lane_sum[k];
+					best.left = left;
+					best.right = right + k;
+					best.top = lane_start[k];
+					best.bottom = lane_finish[k];
+				}
+			}
+		}
+		// remaining columns one by one
+		for (; right < cols; ++right)
+		{
+			for (i = 0; i < rows; ++i)
+				base[i] += M[(size_t)i * cols + right];
+			sum = kadane64(base, rows, &start, &finish);
+			if (sum > best.sum)
+			{
+				best.sum = sum;
+				best.left = left;
+				best.right = right;
+				best.top = start;
+				best.bottom = finish;
+			}
+		}
+	}
+
+	return best;
+}
+
+max_rect find_max_sum_simd(const int* M, int rows, int cols)
+{
+	max_rect best;
+
+	if (rows <= 0 || cols <= 0)
+		return maxsum_empty_rect();
+	long long* base = malloc(sizeof(long long) * rows);
+	if (!base)
+		return maxsum_empty_rect();
+	best = maxsum_simd_search(M, rows, cols, base);
+	free(base);
+	return best;
+}
+
+// The pair (left, right) comes before the pair of r
+// in the loop order of find_max_sum().
+static int pair_before(int left, int right, const max_rect* r)
+{
+	return left < r->left || (left == r->left && right < r->right);
+}
+
+// Kadane over rows top..bottom of the band left..right,
+// from the column prefix sums P; keeps the result if it
+// is better than best, with ties going to the earlier
+// pair. Returns the best sum of the band.
+static long long scan_band(const long long* P, int rows, int top,
+		int bottom, int left, int right, long long* temp, max_rect* best)
+{
+	const long long* hi = P + (size_t)(right + 1) * rows + top;
+	const long long* lo = P + (size_t)left * rows + top;
+	int i, start, finish, n = bottom - top + 1;
+	long long sum;
+
+	for (i = 0; i < n; ++i)
+		temp[i] = hi[i] - lo[i];
+	sum = kadane64(temp, n, &start, &finish);
+	if (sum > best->sum ||
+		(sum == best->sum && pair_before(left, right, best)))
+	{
+		best->sum = sum;
+		best->left = left;
+		best->right = right;
+		best->top = top + start;
+		best->bottom = top + finish;
+	}
+	return sum;
+}
+
+long long* maxsum_column_prefix(const int* M, int rows, int cols)
+{
+	long long* P = malloc(sizeof(long long) * (size_t)(cols + 1) * rows);
+	int i, j;
+
+	if (!P)
+		return NULL;
+	memset(P, 0, sizeof(long long) * rows);
+	for (j = 0; j < cols; ++j)
+	{
+		long long* prev = P + (size_t)j * rows;
+		long long* next = prev + rows;
+		for (i = 0; i < rows; ++i)
+			next[i] = prev[i] + M[(size_t)i * cols + j];
+	}
+	return P;
+}
+
+max_rect maxsum_search_window(const long long* P, int rows, int top,
+		int bottom, int left, int right, long long* scans)
+{
+	max_rect best = maxsum_empty_rect();
+	max_rect single;
+	int l, r, i, c;
+	long long seed_sum;
+	long long count = 0;
+	const int w = right - left + 1, h = bottom - top + 1;
+
+	if (scans)
+		*scans = 0;
+	if (w <= 0 || h <= 0)
+		return best;
+
+	// Relative to column 'left', all over rows top..bottom:
+	// pos[c]: sum of the positive elements of columns 0..c-1
+	// tot[c]: sum of all elements of columns 0..c-1
+	// col[c]: best sum inside column c alone
+	// colpos[c]: sum of max(0, col[k]) for k < c
+	long long* pos = malloc(sizeof(long long) * (w + 1));
+	long long* tot = malloc(sizeof(long long) * (w + 1));
+	long long* col = malloc(sizeof(long long) * w);
+	long long* colpos = malloc(sizeof(long long) * (w + 1));
+	long long* temp = malloc(sizeof(long long) * h);
+	if (!pos || !tot || !col || !colpos || !temp)
+		goto done;
+
+	pos[0] = tot[0] = colpos[0] = 0;
+	for (c = 0; c < w; ++c)
+	{
+		const long long* lo = P + (size_t)(left + c) * rows;
+		const long long* hi = lo + rows;
+		pos[c + 1] = pos[c];
+		tot[c + 1] = tot[c];
+		for (i = top; i <= bottom; ++i)
+		{
+			long long x = hi[i] - lo[i];
+			pos[c + 1] += x > 0 ? x : 0;
+			tot[c + 1] += x;
+		}
+		single = maxsum_empty_rect();
+		col[c] = scan_band(P, rows, top, bottom, left + c, left + c,
+			temp, &single);
+		colpos[c + 1] = colpos[c] + (col[c] > 0 ? col[c] : 0);
+	}
+
+	// seed: the band whose full-height rectangle is
+	// largest, its Kadane result is at least that
+	int seed_l = 0, seed_r = 0;
+	long long seed = LLONG_MIN;
+	for (l = 0; l < w; ++l)
+		for (r = l; r < w; ++r)
+			if (tot[r + 1] - tot[l] > seed)
+			{
+				seed = tot[r + 1] - tot[l];
+				seed_l = l;
+				seed_r = r;
+			}
+	seed_sum = scan_band(P, rows, top, bottom, left + seed_l,
+		left + seed_r, temp, &best);
+	count++;
+
+	// Upper bounds of the band l..r:
+	//  - pos[r + 1] - pos[l], all positive elements;
+	//  - bound(l, r - 1) + col[r], since the best
+	//    rectangle splits into a part in l..r-1 and a
+	//    part in column r.
+	// Both only grow with r; the first one falls with l,
+	// so the outer loop stops at the first l whose
+	// widest band can not reach the best sum.
+	for (l = 0; l < w; ++l)
+	{
+		if (pos[w] - pos[l] < best.sum)
+			break;
+		long long bound = 0;
+		for (r = l; r < w; ++r)
+		{
+			long long b = pos[r + 1] - pos[l];
+			bound = r == l ? col[l] : bound + col[r];
+			if (b < bound)
+				bound = b;
+			// no wider band of this l can do better
+			if (bound + colpos[w] - colpos[r + 1] < best.sum)
+				break;
+			if (bound < best.sum ||
+				(bound == best.sum &&
+					!pair_before(left + l, left + r, &best)))
+				continue;
+			// exact value of this band, the tightest bound
+			if (l == seed_l && r == seed_r)
+			{
+				bound = seed_sum;
+				continue;
+			}
+			bound = scan_band(P, rows, top, bottom, left + l, left + r,
+				temp, &best);
+			count++;
+		}
+	}
+	if (scans)
+		*scans = count;
+
+done:
+	free(pos);
+	free(tot);
+	free(col);
+	free(colpos);
+	free(temp);
+	return best;
+}
+
+max_rect find_max_sum_pruned(const int* M, int rows, int cols,
+		long long* scans)
+{
+	max_rect best = maxsum_empty_rect();
+
+	if (scans)
+		*scans = 0;
+	if (rows <= 0 || cols <= 0)
+		return best;
+	long long* P = maxsum_column_prefix(M, rows, cols);
+	if (!P)
+		return best;
+	best = maxsum_search_window(P, rows, 0, rows - 1, 0, cols - 1, scans);
+	free(P);
+	return best;
+}
+
+void print_max_rect(const max_rect* r)
+{
+	printf("(Top, Left) (%d, %d)\n", r->top, r->left);
+	printf("(Bottom, Right) (%d, %d)\n", r->bottom,
+		r->right);
+	printf("Max sum is: %lld\n", r->sum);
+}
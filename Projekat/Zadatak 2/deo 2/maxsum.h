@@ -0,0 +1,178 @@
+// Maximum sum rectangle library.
+// Same search as findMaxSum() in Hello.c, but for
+// matrices of any size, with 64-bit sums, and with
+// the result returned instead of printed.
+#ifndef MAXSUM_H
+#define MAXSUM_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Rectangle with the maximum sum. Rows top..bottom and
+// columns left..right, all inclusive. For an empty
+// matrix (or when memory can not be allocated) sum is
+// LLONG_MIN and all coordinates are -1.
+typedef struct
+{
+	long long sum;
+	int top, left, bottom, right;
+} max_rect;
+
+// Kadane's algorithm over 64-bit sums. Same result and
+// the same tie rules as kadane() in Hello.c.
+long long kadane64(const long long* arr, int n,
+		int* start, int* finish);
+
+// Finds the maximum sum rectangle of the rows x cols
+// matrix M, stored row-major (M[i * cols + j]).
+// Ties are broken like in findMaxSum(): the first
+// (left, right) pair in loop order wins.
+max_rect find_max_sum(const int* M, int rows, int cols);
+
+// Number of (left, right) column pairs that
+// find_max_sum_simd() scans at once.
+#define MAXSUM_LANES 8
+
+// Same result as find_max_sum(), but MAXSUM_LANES
+// right columns of one left column are scanned at
+// once by a branch-free Kadane (AVX2 when compiled
+// with -mavx2, scalar code with conditional moves
+// otherwise). Reads M row-major, without a copy.
+max_rect find_max_sum_simd(const int* M, int rows, int cols);
+
+// Same result as find_max_sum(), with the left
+// columns spread over 'threads' worker threads (0 =
+// all cores) that steal work from each other. Every
+// worker keeps its own best rectangle; equal sums are
+// resolved towards the smaller (left, right) pair,
+// which is the pair find_max_sum() keeps.
+max_rect find_max_sum_parallel(const int* M, int rows, int cols,
+		int threads);
+
+// Same result as find_max_sum(), but (left, right)
+// pairs that can not beat the best sum found so far
+// are skipped. A pair is bounded by the sum of the
+// positive elements in its column band (from prefix
+// sums) and by the bound of the narrower band plus
+// the best sum of the added column alone. Both grow
+// with the width of the band, so the rest of the
+// right columns (and of the left columns) are cut at
+// once. The pair with the best full-height band is
+// evaluated first to get a good bound early.
+// If 'scans' is not NULL it gets the number of Kadane
+// scans that were done.
+max_rect find_max_sum_pruned(const int* M, int rows, int cols,
+		long long* scans);
+
+// Prebuilt index over one matrix for repeated queries:
+// a summed-area table for O(1) rectangle sums and the
+// column prefix sums of every row, so the row sums of
+// any column band are one subtraction per row. After
+// maxsum_index_build() the index is read-only, and all
+// queries may run from many threads at once.
+typedef struct maxsum_index maxsum_index;
+
+// Window (or rectangle) top..bottom x left..right,
+// all inclusive.
+typedef struct
+{
+	int top, left, bottom, right;
+} maxsum_window;
+
+// Builds the index of the rows x cols row-major matrix
+// M; M is not needed afterwards. NULL if out of memory.
+maxsum_index* maxsum_index_build(const int* M, int rows, int cols);
+void maxsum_index_free(maxsum_index* idx);
+
+// Sum of the elements of rectangle w, in O(1).
+long long maxsum_index_sum(const maxsum_index* idx, maxsum_window w);
+
+// Maximum sum rectangle inside window w, in matrix
+// coordinates; same as find_max_sum() on the window.
+max_rect maxsum_index_max_rect(const maxsum_index* idx, maxsum_window w);
+
+// Batches of n queries. Window searches are spread
+// over 'threads' threads (0 = all cores, 1 = the
+// calling thread only); sums are cheap and run in the
+// calling thread.
+void maxsum_index_sums(const maxsum_index* idx, const maxsum_window* w,
+		int n, long long* out);
+void maxsum_index_max_rects(const maxsum_index* idx,
+		const maxsum_window* w, int n, max_rect* out, int threads);
+
+// Maximum sum rectangle of a matrix that changes one
+// cell at a time. Every column band left..right keeps
+// a segment tree over the rows with (total, best
+// prefix, best suffix, best subarray) per node, which
+// replaces the Kadane scan of that band, and a
+// tournament tree over the bands keeps the best band.
+// An update of column j touches the (j + 1) * (cols - j)
+// bands that contain it, O(log rows + log bands) each.
+// Memory is O(cols^2 * rows), meant for grids up to a
+// few hundred columns.
+typedef struct maxsum_dynamic maxsum_dynamic;
+
+// Builds the structure for the rows x cols row-major
+// matrix M (copied). NULL if out of memory.
+maxsum_dynamic* maxsum_dynamic_build(const int* M, int rows, int cols);
+void maxsum_dynamic_free(maxsum_dynamic* d);
+
+// Sets M[i][j] = value.
+void maxsum_dynamic_update(maxsum_dynamic* d, int i, int j, int value);
+
+// Current maximum sum rectangle, in O(1). The sum is
+// always the one find_max_sum() returns; among equal
+// sums the band with the smallest (left, right) wins,
+// inside the band the choice can differ from Kadane.
+max_rect maxsum_dynamic_query_max_rectangle(const maxsum_dynamic* d);
+
+// Same result as find_max_sum() for matrices of 8-bit
+// and 16-bit elements, kept in their narrow type. The
+// row sums of a band are 16-bit for int8 with up to
+// 256 columns, 32-bit for up to 2^24 (int8) or 65536
+// (int16) columns and 64-bit beyond, so they never
+// overflow; more of them fit in one vector register
+// and the column copy takes 1/4 or 1/2 of the memory.
+max_rect find_max_sum_i8(const signed char* M, int rows, int cols);
+max_rect find_max_sum_i16(const short* M, int rows, int cols);
+
+// Same result as find_max_sum() for a matrix that
+// does not fit in memory. The file holds int rows,
+// int cols and then rows * cols ints row-major (one
+// record of the maxsum_batch() stream) and is mapped
+// with mmap(). Groups of left columns are searched
+// together while their right columns are gathered
+// from the file in tiles (a strided read of every
+// row, see maxsum_mmap.c), so at most about
+// memory_budget bytes (0 = 256 MB) of buffers are
+// used. On a bad file the result is the empty one.
+max_rect find_max_sum_mmap(const char* path, size_t memory_budget);
+
+// Batch mode for streams of many small matrices.
+// The input file is a packed sequence of matrices,
+// each one int rows, int cols and rows * cols ints
+// row-major, all in native byte order. The output file
+// gets one max_rect (24 bytes) per matrix, in input
+// order. The input is mapped with mmap() and the
+// matrices are shared by 'threads' threads (0 = all
+// cores) in chunks of MAXSUM_BATCH_CHUNK; each matrix
+// is searched by find_max_sum_simd() with a per-thread
+// buffer, without printing or allocating.
+// Returns the number of matrices, or -1 if a file can
+// not be read/written, the input is malformed or
+// memory can not be allocated.
+#define MAXSUM_BATCH_CHUNK 64
+long long maxsum_batch(const char* in_path, const char* out_path,
+		int threads);
+
+// Prints the result in the format of findMaxSum().
+void print_max_rect(const max_rect* r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,195 @@
+// Batch mode over a stream of matrices, see maxsum.h
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "maxsum.h"
+#include "maxsum_impl.h"
+
+typedef struct
+{
+	const char* data;
+	const size_t* offset;	// offset[k]: header of matrix k
+	max_rect* out;
+	long long n;
+	int max_rows;
+	long long next;			// first matrix nobody has taken yet
+	pthread_mutex_t lock;
+} stream;
+
+typedef struct
+{
+	stream* s;
+	long long* base;	// scratch of s->max_rows elements
+} worker;
+
+static void* run_stream(void* arg)
+{
+	stream* s = ((worker*)arg)->s;
+	long long* base = ((worker*)arg)->base;
+	long long first, k, end;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&s->lock);
+		first = s->next;
+		s->next += MAXSUM_BATCH_CHUNK;
+		pthread_mutex_unlock(&s->lock);
+		if (first >= s->n)
+			break;
+		end = first + MAXSUM_BATCH_CHUNK < s->n
+			? first + MAXSUM_BATCH_CHUNK : s->n;
+		for (k = first; k < end; ++k)
+		{
+			const int* h = (const int*)(s->data + s->offset[k]);
+			s->out[k] = maxsum_simd_search(h + 2, h[0], h[1], base);
+		}
+	}
+	return NULL;
+}
+
+// Offsets of all matrices in data[0..size); NULL if the
+// stream is malformed or memory can not be allocated.
+static size_t* index_stream(const char* data, size_t size,
+		long long* n, int* max_rows)
+{
+	size_t pos = 0, cap = 1024;
+	size_t* offset = malloc(sizeof(size_t) * cap);
+	int header[2];
+
+	*n = 0;
+	*max_rows = 1;
+	if (!offset)
+		return NULL;
+	while (pos < size)
+	{
+		if (size - pos < sizeof(header))
+			goto bad;
+		header[0] = ((const int*)(data + pos))[0];
+		header[1] = ((const int*)(data + pos))[1];
+		if (header[0] <= 0 || header[1] <= 0 ||
+			(size - pos - sizeof(header)) / sizeof(int) / header[0]
+				< (size_t)header[1])
+			goto bad;
+		if (*n == (long long)cap)
+		{
+			size_t* grown = realloc(offset, sizeof(size_t) * cap * 2);
+			if (!grown)
+				goto bad;
+			offset = grown;
+			cap *= 2;
+		}
+		offset[(*n)++] = pos;
+		if (header[0] > *max_rows)
+			*max_rows = header[0];
+		pos += sizeof(header) + sizeof(int) * (size_t)header[0] * header[1];
+	}
+	return offset;
+
+bad:
+	free(offset);
+	return NULL;
+}
+
+long long maxsum_batch(const char* in_path, const char* out_path,
+		int threads)
+{
+	struct stat st;
+	stream s;
+	pthread_t* ids = NULL;
+	worker* workers = NULL;
+	long long* bases = NULL;
+	size_t* offset = NULL;
+	void* in = MAP_FAILED;
+	void* out = MAP_FAILED;
+	size_t out_size = 0;
+	long long result = -1;
+	int fin, fout = -1, t, started;
+
+	fin = open(in_path, O_RDONLY);
+	if (fin < 0)
+		return -1;
+	if (fstat(fin, &st) != 0)
+		goto done;
+	if (st.st_size > 0)
+	{
+		in = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fin, 0);
+		if (in == MAP_FAILED)
+			goto done;
+		// advice values are not flags, one call each
+		madvise(in, st.st_size, MADV_SEQUENTIAL);
+		madvise(in, st.st_size, MADV_WILLNEED);
+		offset = index_stream(in, st.st_size, &s.n, &s.max_rows);
+		if (!offset)
+			goto done;
+	}
+	else
+		s.n = 0;
+
+	fout = open(out_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fout < 0)
+		goto done;
+	if (s.n == 0)
+	{
+		result = 0;
+		goto done;
+	}
+	out_size = sizeof(max_rect) * (size_t)s.n;
+	if (ftruncate(fout, out_size) != 0)
+		goto done;
+	out = mmap(NULL, out_size, PROT_READ | PROT_WRITE, MAP_SHARED, fout, 0);
+	if (out == MAP_FAILED)
+		goto done;
+
+	if (threads <= 0)
+		threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads > (s.n + MAXSUM_BATCH_CHUNK - 1) / MAXSUM_BATCH_CHUNK)
+		threads = (int)((s.n + MAXSUM_BATCH_CHUNK - 1) / MAXSUM_BATCH_CHUNK);
+	if (threads < 1)
+		threads = 1;
+	// all scratch is allocated before any thread starts,
+	// so every matrix is either searched or the call fails
+	ids = malloc(sizeof(pthread_t) * threads);
+	workers = malloc(sizeof(worker) * threads);
+	bases = malloc(sizeof(long long) * (size_t)s.max_rows * threads);
+	if (!ids || !workers || !bases)
+		goto done;
+
+	s.data = in;
+	s.offset = offset;
+	s.out = out;
+	s.next = 0;
+	pthread_mutex_init(&s.lock, NULL);
+	for (t = 0; t < threads; ++t)
+	{
+		workers[t].s = &s;
+		workers[t].base = bases + (size_t)t * s.max_rows;
+	}
+	// worker 0 is the calling thread; if a thread can not
+	// be started, it takes the share of the missing ones
+	for (started = 1; started < threads; ++started)
+		if (pthread_create(&ids[started], NULL, run_stream,
+				&workers[started]) != 0)
+			break;
+	run_stream(&workers[0]);
+	for (t = 1; t < started; ++t)
+		pthread_join(ids[t], NULL);
+	pthread_mutex_destroy(&s.lock);
+	result = s.n;
+
+done:
+	if (out != MAP_FAILED)
+		munmap(out, out_size);
+	if (in != MAP_FAILED)
+		munmap(in, st.st_size);
+	if (fout >= 0)
+		close(fout);
+	close(fin);
+	free(offset);
+	free(ids);
+	free(workers);
+	free(bases);
+	return result;
+}
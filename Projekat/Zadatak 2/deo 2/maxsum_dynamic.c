@@ -0,0 +1,224 @@
+// Maximum sum rectangle under point updates, see maxsum.h
+#include <stdlib.h>
+#include <string.h>
+#include "maxsum.h"
+
+// Segment tree node over a range of rows of one band;
+// the leaves are the row sums of the band. n is the
+// number of rows, padding nodes (n == 0) are empty.
+typedef struct
+{
+	long long sum, pre, suf, best;
+	int pre_end, suf_start, best_start, best_end;
+	int n;
+} node;
+
+struct maxsum_dynamic
+{
+	int rows, cols;
+	int size;		// leaves per band tree, power of 2 >= rows
+	int bands;		// cols * (cols + 1) / 2
+	int bsize;		// leaves of the band tournament, power of 2
+	int* M;			// copy of the matrix
+	node* tree;		// band b uses tree[b * 2 * size ...]
+	int* top;		// tournament: index of the best band
+	int* band_left;
+	int* band_right;
+};
+
+// Band (left, right) in the order of find_max_sum():
+// all bands of left 0 first, then left 1, ...
+static int band_index(int cols, int left, int right)
+{
+	return left * cols - left * (left - 1) / 2 + (right - left);
+}
+
+static void leaf(node* x, long long v, int i)
+{
+	x->sum = x->pre = x->suf = x->best = v;
+	x->pre_end = x->suf_start = x->best_start = x->best_end = i;
+	x->n = 1;
+}
+
+// Parent of a (upper rows) and b (lower rows). Equal
+// sums prefer the shorter prefix/suffix and the upper
+// subarray, so the result does not depend on history.
+static void merge(node* x, const node* a, const node* b)
+{
+	if (a->n == 0 || b->n == 0)
+	{
+		*x = a->n == 0 ? *b : *a;
+		return;
+	}
+	x->n = a->n + b->n;
+	x->sum = a->sum + b->sum;
+	if (a->pre >= a->sum + b->pre)
+	{
+		x->pre = a->pre;
+		x->pre_end = a->pre_end;
+	}
+	else
+	{
+		x->pre = a->sum + b->pre;
+		x->pre_end = b->pre_end;
+	}
+	if (b->suf >= b->sum + a->suf)
+	{
+		x->suf = b->suf;
+		x->suf_start = b->suf_start;
+	}
+	else
+	{
+		x->suf = b->sum + a->suf;
+		x->suf_start = a->suf_start;
+	}
+	x->best = a->best;
+	x->best_start = a->best_start;
+	x->best_end = a->best_end;
+	if (a->suf + b->pre > x->best)
+	{
+		x->best = a->suf + b->pre;
+		x->best_start = a->suf_start;
+		x->best_end = b->pre_end;
+	}
+	if (b->best > x->best)
+	{
+		x->best = b->best;
+		x->best_start = b->best_start;
+		x->best_end = b->best_end;
+	}
+}
+
+static long long band_best(const maxsum_dynamic* d, int b)
+{
+	return d->tree[(size_t)b * 2 * d->size + 1].best;
+}
+
+// Tournament winner of two bands (-1 = no band); equal
+// sums go to the smaller band index.
+static int winner(const maxsum_dynamic* d, int a, int b)
+{
+	if (a < 0 || b < 0)
+		return a < 0 ? b : a;
+	return band_best(d, b) > band_best(d, a) ? b : a;
+}
+
+static void tournament_update(maxsum_dynamic* d, int b)
+{
+	int k = (d->bsize + b) / 2;
+	for (; k >= 1; k /= 2)
+		d->top[k] = winner(d, d->top[2 * k], d->top[2 * k + 1]);
+}
+
+maxsum_dynamic* maxsum_dynamic_build(const int* M, int rows, int cols)
+{
+	maxsum_dynamic* d;
+	int left, right, i, k, b;
+
+	if (rows <= 0 || cols <= 0)
+		return NULL;
+	d = calloc(1, sizeof(maxsum_dynamic));
+	if (!d)
+		return NULL;
+	d->rows = rows;
+	d->cols = cols;
+	for (d->size = 1; d->size < rows; d->size *= 2)
+		;
+	d->bands = cols * (cols + 1) / 2;
+	for (d->bsize = 1; d->bsize < d->bands; d->bsize *= 2)
+		;
+	d->M = malloc(sizeof(int) * (size_t)rows * cols);
+	d->tree = calloc((size_t)d->bands * 2 * d->size, sizeof(node));
+	d->top = malloc(sizeof(int) * 2 * d->bsize);
+	d->band_left = malloc(sizeof(int) * d->bands);
+	d->band_right = malloc(sizeof(int) * d->bands);
+	long long* temp = malloc(sizeof(long long) * rows);
+	if (!d->M || !d->tree || !d->top || !d->band_left || !d->band_right ||
+		!temp)
+	{
+		free(temp);
+		maxsum_dynamic_free(d);
+		return NULL;
+	}
+	memcpy(d->M, M, sizeof(int) * (size_t)rows * cols);
+
+	for (left = 0; left < cols; ++left)
+	{
+		memset(temp, 0, sizeof(long long) * rows);
+		for (right = left; right < cols; ++right)
+		{
+			b = band_index(cols, left, right);
+			d->band_left[b] = left;
+			d->band_right[b] = right;
+			node* t = d->tree + (size_t)b * 2 * d->size;
+			for (i = 0; i < rows; ++i)
+			{
+				temp[i] += M[(size_t)i * cols + right];
+				leaf(&t[d->size + i], temp[i], i);
+			}
+			for (k = d->size - 1; k >= 1; --k)
+				merge(&t[k], &t[2 * k], &t[2 * k + 1]);
+		}
+	}
+	free(temp);
+
+	for (b = 0; b < d->bsize; ++b)
+		d->top[d->bsize + b] = b < d->bands ? b : -1;
+	for (k = d->bsize - 1; k >= 1; --k)
+		d->top[k] = winner(d, d->top[2 * k], d->top[2 * k + 1]);
+	return d;
+}
+
+void maxsum_dynamic_free(maxsum_dynamic* d)
+{
+	if (!d)
+		return;
+	free(d->M);
+	free(d->tree);
+	free(d->top);
+	free(d->band_left);
+	free(d->band_right);
+	free(d);
+}
+
+void maxsum_dynamic_update(maxsum_dynamic* d, int i, int j, int value)
+{
+	int left, right, k;
+	long long delta;
+
+	if (i < 0 || i >= d->rows || j < 0 || j >= d->cols)
+		return;
+	delta = (long long)value - d->M[(size_t)i * d->cols + j];
+	d->M[(size_t)i * d->cols + j] = value;
+	if (delta == 0)
+		return;
+
+	// row i of every band that contains column j
+	for (left = 0; left <= j; ++left)
+	{
+		for (right = j; right < d->cols; ++right)
+		{
+			int b = band_index(d->cols, left, right);
+			node* t = d->tree + (size_t)b * 2 * d->size;
+			k = d->size + i;
+			leaf(&t[k], t[k].sum + delta, i);
+			for (k /= 2; k >= 1; k /= 2)
+				merge(&t[k], &t[2 * k], &t[2 * k + 1]);
+			tournament_update(d, b);
+		}
+	}
+}
+
+max_rect maxsum_dynamic_query_max_rectangle(const maxsum_dynamic* d)
+{
+	max_rect r;
+	int b = d->top[1];
+	const node* root = d->tree + (size_t)b * 2 * d->size + 1;
+
+	r.sum = root->best;
+	r.top = root->best_start;
+	r.bottom = root->best_end;
+	r.left = d->band_left[b];
+	r.right = d->band_right[b];
+	return r;
+}
@@ -0,0 +1,84 @@
+// Internal helpers shared by the maxsum*.c files.
+#ifndef MAXSUM_IMPL_H
+#define MAXSUM_IMPL_H
+
+#include <limits.h>
+#include "maxsum.h"
+
+// The empty result, see max_rect.
+static inline max_rect maxsum_empty_rect(void)
+{
+	max_rect r;
+	r.sum = LLONG_MIN;
+	r.top = r.left = r.bottom = r.right = -1;
+	return r;
+}
+
+// Defines NAME(), Kadane's algorithm over an array of
+// ACC with 64-bit sums: kadane() of Hello.c, with the
+// same result and ties. kadane64() is the long long
+// one, the narrow kernels get one per row sum type.
+#define MAXSUM_KADANE(NAME, ACC) \
+long long NAME(const ACC* arr, int n, int* start, int* finish) \
+{ \
+	long long sum = 0, maxSum = LLONG_MIN; \
+	int i, local_start = 0; \
+\
+	*finish = -1; \
+	for (i = 0; i < n; ++i) \
+	{ \
+		sum += arr[i]; \
+		if (sum < 0) \
+		{ \
+			sum = 0; \
+			local_start = i + 1; \
+		} \
+		else if (sum > maxSum) \
+		{ \
+			maxSum = sum; \
+			*start = local_start; \
+			*finish = i; \
+		} \
+	} \
+	/* there is at least one non-negative number */ \
+	if (*finish != -1) \
+		return maxSum; \
+\
+	/* all numbers are negative: the largest one */ \
+	maxSum = arr[0]; \
+	*start = *finish = 0; \
+	for (i = 1; i < n; i++) \
+	{ \
+		if (arr[i] > maxSum) \
+		{ \
+			maxSum = arr[i]; \
+			*start = *finish = i; \
+		} \
+	} \
+	return maxSum; \
+}
+
+// Column prefix sums of the rows x cols matrix M:
+// P[j * rows + i] is the sum of row i over columns
+// 0..j-1, for j = 0..cols. The sums of a band of
+// columns left..right are then P[right + 1] - P[left],
+// one contiguous subtraction per row. Returns NULL if
+// memory can not be allocated; free() the result.
+long long* maxsum_column_prefix(const int* M, int rows, int cols);
+
+// Pruned search (see find_max_sum_pruned()) inside the
+// window top..bottom x left..right, on the column
+// prefix sums P of a matrix with 'rows' rows. The
+// result is in matrix coordinates, with the same ties
+// as find_max_sum() on the window alone. Uses no
+// shared state, so it may run in many threads at once.
+max_rect maxsum_search_window(const long long* P, int rows, int top,
+		int bottom, int left, int right, long long* scans);
+
+// find_max_sum_simd() with the caller's scratch
+// buffer of 'rows' elements, so that nothing is
+// allocated per matrix.
+max_rect maxsum_simd_search(const int* M, int rows, int cols,
+		long long* base);
+
+#endif
@@ -0,0 +1,172 @@
+// Prebuilt query index over one matrix, see maxsum.h
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "maxsum.h"
+#include "maxsum_impl.h"
+
+struct maxsum_index
+{
+	int rows, cols;
+	long long* S;	// S[i * (cols + 1) + j]: sum of rows < i, columns < j
+	long long* P;	// column prefix sums, see maxsum_column_prefix()
+};
+
+maxsum_index* maxsum_index_build(const int* M, int rows, int cols)
+{
+	maxsum_index* idx;
+	int i, j;
+
+	if (rows <= 0 || cols <= 0)
+		return NULL;
+	idx = malloc(sizeof(maxsum_index));
+	if (!idx)
+		return NULL;
+	idx->rows = rows;
+	idx->cols = cols;
+	idx->S = malloc(sizeof(long long) * (size_t)(rows + 1) * (cols + 1));
+	idx->P = maxsum_column_prefix(M, rows, cols);
+	if (!idx->S || !idx->P)
+	{
+		maxsum_index_free(idx);
+		return NULL;
+	}
+
+	memset(idx->S, 0, sizeof(long long) * (cols + 1));
+	for (i = 0; i < rows; ++i)
+	{
+		const long long* up = idx->S + (size_t)i * (cols + 1);
+		long long* cur = idx->S + (size_t)(i + 1) * (cols + 1);
+		long long row = 0;
+		cur[0] = 0;
+		for (j = 0; j < cols; ++j)
+		{
+			row += M[(size_t)i * cols + j];
+			cur[j + 1] = up[j + 1] + row;
+		}
+	}
+	return idx;
+}
+
+void maxsum_index_free(maxsum_index* idx)
+{
+	if (!idx)
+		return;
+	free(idx->S);
+	free(idx->P);
+	free(idx);
+}
+
+// Window clipped to the matrix; 0 if nothing is left.
+static int clip(const maxsum_index* idx, maxsum_window* w)
+{
+	if (w->top < 0)
+		w->top = 0;
+	if (w->left < 0)
+		w->left = 0;
+	if (w->bottom >= idx->rows)
+		w->bottom = idx->rows - 1;
+	if (w->right >= idx->cols)
+		w->right = idx->cols - 1;
+	return w->top <= w->bottom && w->left <= w->right;
+}
+
+long long maxsum_index_sum(const maxsum_index* idx, maxsum_window w)
+{
+	const long long* S = idx->S;
+	const size_t stride = idx->cols + 1;
+
+	if (!clip(idx, &w))
+		return 0;
+	return S[(w.bottom + 1) * stride + w.right + 1]
+		- S[w.top * stride + w.right + 1]
+		- S[(w.bottom + 1) * stride + w.left]
+		+ S[w.top * stride + w.left];
+}
+
+max_rect maxsum_index_max_rect(const maxsum_index* idx, maxsum_window w)
+{
+	if (!clip(idx, &w))
+		return maxsum_empty_rect();
+	return maxsum_search_window(idx->P, idx->rows, w.top, w.bottom,
+		w.left, w.right, NULL);
+}
+
+void maxsum_index_sums(const maxsum_index* idx, const maxsum_window* w,
+		int n, long long* out)
+{
+	int q;
+
+	// O(1) each, threads would cost more than they save
+	for (q = 0; q < n; ++q)
+		out[q] = maxsum_index_sum(idx, w[q]);
+}
+
+typedef struct
+{
+	const maxsum_index* idx;
+	const maxsum_window* w;
+	max_rect* out;
+	int n;
+	int next;		// first query nobody has taken yet
+	pthread_mutex_t lock;
+} batch;
+
+static void* run_batch(void* arg)
+{
+	batch* b = arg;
+	int q;
+
+	for (;;)
+	{
+		// queries differ a lot in cost, so they are
+		// handed out one by one
+		pthread_mutex_lock(&b->lock);
+		q = b->next++;
+		pthread_mutex_unlock(&b->lock);
+		if (q >= b->n)
+			break;
+		b->out[q] = maxsum_index_max_rect(b->idx, b->w[q]);
+	}
+	return NULL;
+}
+
+void maxsum_index_max_rects(const maxsum_index* idx,
+		const maxsum_window* w, int n, max_rect* out, int threads)
+{
+	batch b;
+	pthread_t* ids;
+	int t, started;
+
+	if (threads <= 0)
+		threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads > n)
+		threads = n;
+	ids = threads > 1 ? malloc(sizeof(pthread_t) * threads) : NULL;
+	if (!ids)
+	{
+		for (t = 0; t < n; ++t)
+			out[t] = maxsum_index_max_rect(idx, w[t]);
+		return;
+	}
+
+	b.idx = idx;
+	b.w = w;
+	b.out = out;
+	b.n = n;
+	b.next = 0;
+	pthread_mutex_init(&b.lock, NULL);
+	for (started = 0; started < threads; ++started)
+		if (pthread_create(&ids[started], NULL, run_batch, &b) != 0)
+		{
+			// the calling thread takes the share of the
+			// threads that could not be started
+			run_batch(&b);
+			break;
+		}
+	for (t = 0; t < started; ++t)
+		pthread_join(ids[t], NULL);
+	pthread_mutex_destroy(&b.lock);
+	free(ids);
+}
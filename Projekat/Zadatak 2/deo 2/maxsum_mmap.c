@@ -0,0 +1,183 @@
+// Out-of-core maximum sum rectangle, see maxsum.h
+//
+// The left columns are taken in groups; a group keeps
+// one temp[] per left column. For every group the
+// columns from its first left to the end of the matrix
+// are gathered in tiles of column ranges, copied
+// column-major into a buffer. The file is row-major, so
+// a tile is one run of its columns from every row: a
+// strided read over the tile's part of the file, not a
+// sequential one, and a page holding several tiles is
+// read once per tile (from the page cache after the
+// first). Every right column of the tile is added to
+// the temp[] of each left of the group and scanned
+// with Kadane. Groups and tiles are as large as the
+// memory budget allows, half of it each, so the file
+// is gone through about cols / group times in all.
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "maxsum.h"
+#include "maxsum_impl.h"
+
+#define MAXSUM_MMAP_DEFAULT_BUDGET ((size_t)256 << 20)
+
+typedef struct
+{
+	const int* M;		// mapped matrix, row-major
+	int rows, cols;
+	size_t page;
+} mapped;
+
+// Hint for the tile of columns [c0, c1), one call for
+// the bytes from its first element (row 0) to its last
+// (row rows - 1): MADV_WILLNEED before the tile is
+// read, MADV_DONTNEED for the whole pages of a tile
+// that is done. Both are skipped when that span is
+// more than twice the tile, where rows are so long
+// that it holds mostly other columns: read-ahead would
+// read them and dropping would evict the ones the
+// next tiles need.
+static void advise(const mapped* m, int c0, int c1, int advice)
+{
+	size_t from, to;
+
+	if (c0 >= c1)
+		return;
+	from = (size_t)(m->M + c0);
+	to = (size_t)(m->M + (size_t)(m->rows - 1) * m->cols + c1);
+	if (to - from > 2 * sizeof(int) * (size_t)m->rows * (c1 - c0))
+		return;
+	if (advice == MADV_WILLNEED)
+		from &= ~(m->page - 1);
+	else
+	{
+		from = (from + m->page - 1) & ~(m->page - 1);
+		to &= ~(m->page - 1);
+	}
+	if (from < to)
+		madvise((void*)from, to - from, advice);
+}
+
+// Columns [c0, c1) of the matrix, column-major.
+static void load_tile(const mapped* m, int c0, int c1, int* tile)
+{
+	int i, j;
+
+	for (i = 0; i < m->rows; ++i)
+	{
+		const int* row = m->M + (size_t)i * m->cols;
+		for (j = c0; j < c1; ++j)
+			tile[(size_t)(j - c0) * m->rows + i] = row[j];
+	}
+}
+
+static max_rect search(const mapped* m, size_t budget)
+{
+	max_rect best;
+	int rows = m->rows, cols = m->cols;
+	int group, width, l0, l1, c0, c1, left, right, i, start, finish;
+	long long sum;
+
+	best = maxsum_empty_rect();
+	group = (int)(budget / 2 / (sizeof(long long) * rows));
+	width = (int)(budget / 2 / (sizeof(int) * rows));
+	if (group < 1)
+		group = 1;
+	if (group > cols)
+		group = cols;
+	if (width < 1)
+		width = 1;
+	if (width > cols)
+		width = cols;
+	long long* temp = malloc(sizeof(long long) * rows * group);
+	int* tile = malloc(sizeof(int) * rows * width);
+	if (!temp || !tile)
+		goto done;
+
+	for (l0 = 0; l0 < cols; l0 = l1)
+	{
+		l1 = l0 + group < cols ? l0 + group : cols;
+		memset(temp, 0, sizeof(long long) * rows * (l1 - l0));
+
+		for (c0 = l0; c0 < cols; c0 = c1)
+		{
+			c1 = c0 + width < cols ? c0 + width : cols;
+			advise(m, c1, c1 + width < cols ? c1 + width : cols,
+				MADV_WILLNEED);
+			load_tile(m, c0, c1, tile);
+
+			for (right = c0; right < c1; ++right)
+			{
+				const int* col = tile + (size_t)(right - c0) * rows;
+				for (left = l0; left < l1 && left <= right; ++left)
+				{
+					long long* t = temp + (size_t)(left - l0) * rows;
+					for (i = 0; i < rows; ++i)
+						t[i] += col[i];
+
+					// pairs are not visited in the order of
+					// find_max_sum(), so equal sums go to
+					// the pair that comes first there
+					sum = kadane64(t, rows, &start, &finish);
+					if (sum > best.sum || (sum == best.sum &&
+						(left < best.left ||
+						(left == best.left && right < best.right))))
+					{
+						best.sum = sum;
+						best.left = left;
+						best.right = right;
+						best.top = start;
+						best.bottom = finish;
+					}
+				}
+			}
+			advise(m, c0, c1, MADV_DONTNEED);
+		}
+	}
+
+done:
+	free(temp);
+	free(tile);
+	return best;
+}
+
+max_rect find_max_sum_mmap(const char* path, size_t memory_budget)
+{
+	max_rect best;
+	struct stat st;
+	mapped m;
+	void* data;
+	int header[2];
+	int fd;
+
+	best = maxsum_empty_rect();
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return best;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(header) ||
+		read(fd, header, sizeof(header)) != sizeof(header) ||
+		header[0] <= 0 || header[1] <= 0 ||
+		((size_t)st.st_size - sizeof(header)) / sizeof(int) / header[0]
+			< (size_t)header[1])
+	{
+		close(fd);
+		return best;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return best;
+	m.M = (const int*)data + 2;
+	m.rows = header[0];
+	m.cols = header[1];
+	m.page = (size_t)sysconf(_SC_PAGESIZE);
+	best = search(&m, memory_budget ? memory_budget
+		: MAXSUM_MMAP_DEFAULT_BUDGET);
+	munmap(data, st.st_size);
+	return best;
+}
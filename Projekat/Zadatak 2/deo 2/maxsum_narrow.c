@@ -0,0 +1,96 @@
+// Maximum sum rectangle of 8-bit and 16-bit matrices,
+// see maxsum.h
+//
+// The matrix stays in its narrow type, in the column-
+// major copy too, so the hot loop temp[i] += col[i]
+// loads 1 or 2 bytes per element instead of 4. temp[]
+// (the row sums of one band) gets the narrowest type
+// that can not overflow for the given number of
+// columns, so more of it fits in one vector register;
+// only the Kadane sums over the rows are 64-bit.
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "maxsum.h"
+#include "maxsum_impl.h"
+
+// Generates kadane_NAME(), kadane64() over ACC, and
+// search_NAME(), find_max_sum() over an ELEM matrix
+// with ACC row sums. Same scans and the same ties as
+// the int versions.
+#define MAXSUM_NARROW_KERNEL(NAME, ELEM, ACC) \
+static MAXSUM_KADANE(kadane_##NAME, ACC) \
+\
+static max_rect search_##NAME(const ELEM* M, int rows, int cols) \
+{ \
+	max_rect best = maxsum_empty_rect(); \
+	int left, right, i, start, finish; \
+	long long sum; \
+\
+	ELEM* T = malloc(sizeof(ELEM) * (size_t)rows * cols); \
+	ACC* temp = malloc(sizeof(ACC) * rows); \
+	if (!T || !temp) \
+	{ \
+		free(T); \
+		free(temp); \
+		return best; \
+	} \
+	for (i = 0; i < rows; ++i) \
+		for (right = 0; right < cols; ++right) \
+			T[(size_t)right * rows + i] = M[(size_t)i * cols + right]; \
+\
+	for (left = 0; left < cols; ++left) \
+	{ \
+		memset(temp, 0, sizeof(ACC) * rows); \
+		for (right = left; right < cols; ++right) \
+		{ \
+			const ELEM* col = T + (size_t)right * rows; \
+			for (i = 0; i < rows; ++i) \
+				temp[i] = (ACC)(temp[i] + col[i]); \
+\
+			sum = kadane_##NAME(temp, rows, &start, &finish); \
+			if (sum > best.sum) \
+			{ \
+				best.sum = sum; \
+				best.left = left; \
+				best.right = right; \
+				best.top = start; \
+				best.bottom = finish; \
+			} \
+		} \
+	} \
+\
+	free(T); \
+	free(temp); \
+	return best; \
+}
+
+MAXSUM_NARROW_KERNEL(i8_i16, signed char, short)
+MAXSUM_NARROW_KERNEL(i8_i32, signed char, int)
+MAXSUM_NARROW_KERNEL(i8_i64, signed char, long long)
+MAXSUM_NARROW_KERNEL(i16_i32, short, int)
+MAXSUM_NARROW_KERNEL(i16_i64, short, long long)
+
+max_rect find_max_sum_i8(const signed char* M, int rows, int cols)
+{
+	if (rows <= 0 || cols <= 0)
+		return maxsum_empty_rect();
+	// |row sum| <= 128 * cols: 256 columns fit in a
+	// short (-32768 included), 2^24 in an int
+	if (cols <= 256)
+		return search_i8_i16(M, rows, cols);
+	if (cols <= (1 << 24))
+		return search_i8_i32(M, rows, cols);
+	return search_i8_i64(M, rows, cols);
+}
+
+max_rect find_max_sum_i16(const short* M, int rows, int cols)
+{
+	if (rows <= 0 || cols <= 0)
+		return maxsum_empty_rect();
+	// |row sum| <= 32768 * cols: 65536 columns fit in
+	// an int
+	if (cols <= 65536)
+		return search_i16_i32(M, rows, cols);
+	return search_i16_i64(M, rows, cols);
+}
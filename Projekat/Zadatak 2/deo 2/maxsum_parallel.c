@@ -0,0 +1,216 @@
+// Parallel maximum sum rectangle search, see maxsum.h
+//
+// Every left column is one task; the task for 'left'
+// scans cols - left right columns, so tasks shrink as
+// left grows. Tasks are dealt round-robin into one
+// deque per worker. A worker takes tasks from the back
+// of its own deque (largest first) and, when it runs
+// out, steals from the front of the other deques, so
+// the small tasks at the end fill in the imbalance.
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "maxsum.h"
+#include "maxsum_impl.h"
+
+typedef struct
+{
+	pthread_mutex_t lock;
+	int* tasks;
+	int head, tail;		// tasks[head..tail-1] are left
+} deque;
+
+typedef struct
+{
+	const int* T;		// column-major copy of M
+	int rows, cols;
+	int nworkers;
+	deque* deques;
+} shared_state;
+
+typedef struct
+{
+	shared_state* s;
+	int id;
+	long long* temp;	// scratch of s->rows elements
+	int started;		// runs in its own thread
+	max_rect best;
+} worker;
+
+// a is better than b: larger sum, or equal sum at a
+// pair that comes first in loop order
+static int better(const max_rect* a, const max_rect* b)
+{
+	if (a->sum != b->sum)
+		return a->sum > b->sum;
+	if (a->left != b->left)
+		return a->left < b->left;
+	return a->right < b->right;
+}
+
+static int pop_back(deque* d, int* task)
+{
+	int ok = 0;
+	pthread_mutex_lock(&d->lock);
+	if (d->head < d->tail)
+	{
+		*task = d->tasks[--d->tail];
+		ok = 1;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return ok;
+}
+
+static int steal_front(deque* d, int* task)
+{
+	int ok = 0;
+	pthread_mutex_lock(&d->lock);
+	if (d->head < d->tail)
+	{
+		*task = d->tasks[d->head++];
+		ok = 1;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return ok;
+}
+
+// All right columns of one left column, in order.
+static void scan_left(const shared_state* s, int left,
+		long long* temp, max_rect* best)
+{
+	int right, i, start, finish;
+	long long sum;
+
+	memset(temp, 0, sizeof(long long) * s->rows);
+	for (right = left; right < s->cols; ++right)
+	{
+		const int* col = s->T + (size_t)right * s->rows;
+		for (i = 0; i < s->rows; ++i)
+			temp[i] += col[i];
+
+		sum = kadane64(temp, s->rows, &start, &finish);
+		if (sum > best->sum)
+		{
+			best->sum = sum;
+			best->left = left;
+			best->right = right;
+			best->top = start;
+			best->bottom = finish;
+		}
+	}
+}
+
+static void* run_worker(void* arg)
+{
+	worker* w = arg;
+	shared_state* s = w->s;
+	int task = 0, v;
+
+	for (;;)
+	{
+		if (!pop_back(&s->deques[w->id], &task))
+		{
+			// own deque is empty, try the others
+			for (v = 1; v < s->nworkers; ++v)
+				if (steal_front(&s->deques[(w->id + v) % s->nworkers],
+						&task))
+					break;
+			if (v == s->nworkers)
+				break;
+		}
+		// tasks come in no fixed order, so every task
+		// starts from an empty candidate and is merged
+		// with better()
+		max_rect cand = maxsum_empty_rect();
+		scan_left(s, task, w->temp, &cand);
+		if (better(&cand, &w->best))
+			w->best = cand;
+	}
+	return NULL;
+}
+
+max_rect find_max_sum_parallel(const int* M, int rows, int cols,
+		int threads)
+{
+	max_rect best;
+	shared_state s;
+	int i, j, left, n;
+
+	best = maxsum_empty_rect();
+	if (rows <= 0 || cols <= 0)
+		return best;
+	if (threads <= 0)
+		threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads > cols)
+		threads = cols;
+	if (threads <= 1)
+		return find_max_sum(M, rows, cols);
+
+	int* T = malloc(sizeof(int) * (size_t)rows * cols);
+	int* tasks = malloc(sizeof(int) * cols);
+	deque* deques = malloc(sizeof(deque) * threads);
+	worker* workers = malloc(sizeof(worker) * threads);
+	pthread_t* ids = malloc(sizeof(pthread_t) * threads);
+	// all scratch is allocated up front, so a worker can
+	// not fail half way and leave its tasks unscanned
+	long long* temps = malloc(sizeof(long long) * (size_t)rows * threads);
+	if (!T || !tasks || !deques || !workers || !ids || !temps)
+		goto done;
+
+	for (i = 0; i < rows; ++i)
+		for (j = 0; j < cols; ++j)
+			T[(size_t)j * rows + i] = M[(size_t)i * cols + j];
+
+	// deque k gets left = k, k + threads, ... stored
+	// with the smallest left (largest task) at the back
+	s.T = T;
+	s.rows = rows;
+	s.cols = cols;
+	s.nworkers = threads;
+	s.deques = deques;
+	n = 0;
+	for (i = 0; i < threads; ++i)
+	{
+		pthread_mutex_init(&deques[i].lock, NULL);
+		deques[i].tasks = tasks + n;
+		deques[i].head = 0;
+		deques[i].tail = 0;
+		for (left = cols - 1; left >= 0; --left)
+			if (left % threads == i)
+				deques[i].tasks[deques[i].tail++] = left;
+		n += deques[i].tail;
+	}
+
+	for (i = 0; i < threads; ++i)
+	{
+		workers[i].s = &s;
+		workers[i].id = i;
+		workers[i].temp = temps + (size_t)i * rows;
+		workers[i].best = best;
+		// without a thread the worker runs here; it steals
+		// everything the missing threads would have done
+		workers[i].started =
+			pthread_create(&ids[i], NULL, run_worker, &workers[i]) == 0;
+		if (!workers[i].started)
+			run_worker(&workers[i]);
+	}
+	for (i = 0; i < threads; ++i)
+	{
+		if (workers[i].started)
+			pthread_join(ids[i], NULL);
+		if (better(&workers[i].best, &best))
+			best = workers[i].best;
+	}
+	for (i = 0; i < threads; ++i)
+		pthread_mutex_destroy(&deques[i].lock);
+
+done:
+	free(T);
+	free(tasks);
+	free(deques);
+	free(workers);
+	free(ids);
+	free(temps);
+	return best;
+}
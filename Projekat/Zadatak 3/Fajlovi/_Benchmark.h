@@ -0,0 +1,232 @@
+#pragma once
+/**
+ * @file
+ * @brief Statistical micro-benchmarks
+ *
+ * @details
+ * `StartTimer`/`EndTimer` from `_Timer.h` time a single run, output
+ * included. `benchmark::run` instead does warm-up runs, picks the number of
+ * iterations per sample so that one sample is long enough for the clock,
+ * collects samples until a target wall time is reached, and reports the
+ * median, p90, p99 and standard deviation of the time of one iteration
+ * (optionally also TSC cycles). Results are printed as a table or written
+ * as CSV / JSON.
+ *
+ * Example:
+ *
+ *     benchmark::result r = benchmark::run("ORIGINAL", [&] {
+ *         benchmark::do_not_optimize(ciphers::vigenere::encrypt(text, key));
+ *     });
+ *     std::cout << r;
+ */
+
+#include <algorithm>  /// for std::sort
+#include <chrono>     /// for std::chrono::steady_clock
+#include <cmath>      /// for sqrt
+#include <cstdint>    /// for uint64_t
+#include <iomanip>    /// for std::setw
+#include <iostream>   /// for io operations
+#include <string>     /// for std::string
+#include <vector>     /// for std::vector
+
+#ifdef _MSC_VER
+#include <intrin.h>  /// for __rdtsc, _ReadWriteBarrier
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>  /// for __rdtsc
+#endif
+
+namespace benchmark {
+    /**
+     * Keeps `value` alive, the compiler has to assume it is read.
+     */
+    template <class T>
+    inline void do_not_optimize(const T& value) {
+#ifdef _MSC_VER
+        static volatile const void* sink;
+        sink = &value;
+        _ReadWriteBarrier();
+#else
+        asm volatile("" : : "r,m"(value) : "memory");
+#endif
+    }
+
+    /**
+     * Compiler barrier, all pending writes to memory have to be done.
+     */
+    inline void clobber_memory() {
+#ifdef _MSC_VER
+        _ReadWriteBarrier();
+#else
+        asm volatile("" : : : "memory");
+#endif
+    }
+
+    /**
+     * Time stamp counter, 0 where there is none.
+     */
+    inline uint64_t rdtsc() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+
+    /**
+     * Benchmark settings.
+     */
+    struct options {
+        int warmup = 3;           /// untimed runs before sampling
+        double min_time = 0.5;    /// seconds of sampling
+        int min_samples = 10;     /// samples taken even if min_time passed
+        int max_samples = 1000;   /// upper bound on samples
+        uint64_t iterations = 0;  /// iterations per sample, 0 = automatic
+        bool cycles = false;      /// also count TSC cycles
+    };
+
+    /**
+     * Statistics of one benchmark, times are per iteration.
+     */
+    struct result {
+        std::string name;
+        uint64_t iterations = 0;  /// iterations per sample
+        int samples = 0;
+        double mean_ns = 0, median_ns = 0, p90_ns = 0, p99_ns = 0;
+        double stddev_ns = 0, min_ns = 0, max_ns = 0;
+        double median_cycles = 0;  /// 0 unless options::cycles
+    };
+
+    namespace {
+        /// nearest-rank percentile of sorted data
+        inline double percentile(const std::vector<double>& sorted, double p) {
+            size_t i = static_cast<size_t>(std::ceil(p * sorted.size()));
+            return sorted[i > 0 ? i - 1 : 0];
+        }
+    }  // Unnamed namespace
+
+    /**
+     * Runs `f` repeatedly and collects timing statistics.
+     * @param name label of the benchmark
+     * @param f code under test, should pass its results to do_not_optimize
+     * @param opt benchmark settings
+     *
+     * @returns statistics per iteration of f
+     */
+    template <class F>
+    result run(const std::string& name, F&& f, const options& opt = options()) {
+        using clock = std::chrono::steady_clock;
+        result res;
+        res.name = name;
+
+        for (int i = 0; i < opt.warmup; ++i) {
+            f();
+            clobber_memory();
+        }
+
+        /// one sample should take min_time / 100, at least ~10 us
+        const double target = std::max(1e-5, opt.min_time / 100);
+        uint64_t n = opt.iterations;
+        if (n == 0) {
+            for (n = 1;; n *= 2) {
+                auto start = clock::now();
+                for (uint64_t i = 0; i < n; ++i) {
+                    f();
+                    clobber_memory();
+                }
+                double t = std::chrono::duration<double>(clock::now() - start).count();
+                if (t >= target || n >= (uint64_t(1) << 40))
+                    break;
+            }
+        }
+        res.iterations = n;
+
+        std::vector<double> ns, cycles;
+        double total = 0;
+        while ((int)ns.size() < opt.max_samples &&
+            ((int)ns.size() < opt.min_samples || total < opt.min_time)) {
+            uint64_t c0 = opt.cycles ? rdtsc() : 0;
+            auto start = clock::now();
+            for (uint64_t i = 0; i < n; ++i) {
+                f();
+                clobber_memory();
+            }
+            auto end = clock::now();
+            uint64_t c1 = opt.cycles ? rdtsc() : 0;
+            double t = std::chrono::duration<double, std::nano>(end - start).count();
+            total += t * 1e-9;
+            ns.push_back(t / n);
+            if (opt.cycles)
+                cycles.push_back(double(c1 - c0) / n);
+        }
+
+        res.samples = static_cast<int>(ns.size());
+        double sum = 0;
+        for (double x : ns)
+            sum += x;
+        res.mean_ns = sum / ns.size();
+        double var = 0;
+        for (double x : ns)
+            var += (x - res.mean_ns) * (x - res.mean_ns);
+        res.stddev_ns = ns.size() > 1 ? sqrt(var / (ns.size() - 1)) : 0;
+
+        std::sort(ns.begin(), ns.end());
+        res.min_ns = ns.front();
+        res.max_ns = ns.back();
+        res.median_ns = percentile(ns, 0.5);
+        res.p90_ns = percentile(ns, 0.9);
+        res.p99_ns = percentile(ns, 0.99);
+        if (opt.cycles) {
+            std::sort(cycles.begin(), cycles.end());
+            res.median_cycles = percentile(cycles, 0.5);
+        }
+        return res;
+    }
+
+    /**
+     * One line of human readable output.
+     */
+    inline std::ostream& operator<<(std::ostream& os, const result& r) {
+        os << std::left << std::setw(24) << r.name << std::right
+            << " median " << std::setw(12) << r.median_ns << " ns"
+            << "  p90 " << std::setw(12) << r.p90_ns
+            << "  p99 " << std::setw(12) << r.p99_ns
+            << "  stddev " << std::setw(10) << r.stddev_ns;
+        if (r.median_cycles > 0)
+            os << "  cycles " << std::setw(12) << r.median_cycles;
+        return os << "  (" << r.samples << " x " << r.iterations << ")";
+    }
+
+    /**
+     * Writes results as CSV with a header line.
+     */
+    inline void write_csv(std::ostream& os, const std::vector<result>& results) {
+        os << "name,iterations,samples,mean_ns,median_ns,p90_ns,p99_ns,"
+            "stddev_ns,min_ns,max_ns,median_cycles\n";
+        for (const result& r : results) {
+            os << r.name << ',' << r.iterations << ',' << r.samples << ','
+                << r.mean_ns << ',' << r.median_ns << ',' << r.p90_ns << ','
+                << r.p99_ns << ',' << r.stddev_ns << ',' << r.min_ns << ','
+                << r.max_ns << ',' << r.median_cycles << '\n';
+        }
+    }
+
+    /**
+     * Writes results as a JSON array of objects.
+     */
+    inline void write_json(std::ostream& os, const std::vector<result>& results) {
+        os << "[\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const result& r = results[i];
+            os << "  {\"name\": \"" << r.name << "\", \"iterations\": "
+                << r.iterations << ", \"samples\": " << r.samples
+                << ", \"mean_ns\": " << r.mean_ns
+                << ", \"median_ns\": " << r.median_ns
+                << ", \"p90_ns\": " << r.p90_ns << ", \"p99_ns\": " << r.p99_ns
+                << ", \"stddev_ns\": " << r.stddev_ns
+                << ", \"min_ns\": " << r.min_ns << ", \"max_ns\": " << r.max_ns
+                << ", \"median_cycles\": " << r.median_cycles << "}"
+                << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        os << "]\n";
+    }
+}  // namespace benchmark
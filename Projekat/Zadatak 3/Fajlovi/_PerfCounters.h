@@ -0,0 +1,280 @@
+#pragma once
+/**
+ * @file
+ * @brief Hardware performance counters around a region of code
+ *
+ * @details
+ * Uses Linux `perf_event_open` to count instructions, cycles, L1D read
+ * misses, LLC misses, branch misses and dTLB read misses of the calling
+ * thread. Counters that can not be opened (no PMU in a VM, restrictive
+ * `perf_event_paranoid`, other OS) are reported as "n/a" and everything
+ * else keeps working, so timing code can always use it.
+ *
+ * The events are opened as one group, so they are enabled, disabled and
+ * read together and always count the same window. If the PMU is shared
+ * with other groups the kernel multiplexes them; the counts are then scaled
+ * by time enabled / time running, and the printed line says what fraction
+ * of the region was actually counted.
+ *
+ * Example, next to the existing timer macros:
+ *
+ *     perf::thread_counters();  /// once, before anything is timed
+ *     ...
+ *     StartTimer(OPTIMIZOVANO1)
+ *     StartCounters
+ *     encrypted1 = ciphers::vigenere::encryptO(text1, "TESLA");
+ *     EndCounters
+ *     EndTimer
+ *     PrintCounters(OPTIMIZOVANO1)
+ *
+ * The counters of a thread are opened on first use, six perf_event_open
+ * calls, so that has to happen outside the timed regions. EndCounters only
+ * keeps the sample and PrintCounters prints it once the clock is read.
+ *
+ * or with an explicit object:
+ *
+ *     perf::counters pc;
+ *     pc.start();
+ *     ...
+ *     perf::sample s = pc.stop();
+ */
+
+#include <cstdint>   /// for uint64_t
+#include <cstring>   /// for memset
+#include <iostream>  /// for io operations
+
+#ifdef __linux__
+#include <linux/perf_event.h>  /// for perf_event_attr
+#include <sys/ioctl.h>         /// for ioctl
+#include <sys/syscall.h>       /// for SYS_perf_event_open
+#include <unistd.h>            /// for syscall, read, close
+#endif
+
+namespace perf {
+    /**
+     * Events that are counted, in the order of sample::value.
+     */
+    enum event {
+        INSTRUCTIONS,
+        CYCLES,
+        L1D_MISSES,
+        LLC_MISSES,
+        BRANCH_MISSES,
+        DTLB_MISSES,
+        EVENT_COUNT
+    };
+
+    inline const char* event_name(int e) {
+        static const char* names[EVENT_COUNT] = {
+            "instructions", "cycles", "L1D-misses",
+            "LLC-misses", "branch-misses", "dTLB-misses" };
+        return names[e];
+    }
+
+    /**
+     * Counter deltas of one region.
+     */
+    struct sample {
+        uint64_t value[EVENT_COUNT] = {};
+        bool valid[EVENT_COUNT] = {};  /// false if the counter is unavailable
+        double counted = 1;            /// time running / time enabled, < 1 if multiplexed
+    };
+
+    /**
+     * Set of counters of the calling thread, one perf group under the first
+     * event that could be opened. Opening the counters is done once in the
+     * constructor; start/stop are a few ioctl/read calls on the leader.
+     */
+    class counters {
+     public:
+        counters() {
+            for (int e = 0; e < EVENT_COUNT; ++e) {
+                fd_[e] = open_event(e, leader_);
+                slot_[e] = -1;
+                if (fd_[e] < 0)
+                    continue;
+                if (leader_ < 0)
+                    leader_ = fd_[e];
+                slot_[e] = members_++;
+            }
+        }
+
+        ~counters() {
+#ifdef __linux__
+            for (int e = EVENT_COUNT - 1; e >= 0; --e)
+                if (fd_[e] >= 0)
+                    close(fd_[e]);
+#endif
+        }
+
+        counters(const counters&) = delete;
+        counters& operator=(const counters&) = delete;
+
+        /// true if at least one counter could be opened
+        bool available() const { return leader_ >= 0; }
+
+        void start() {
+#ifdef __linux__
+            if (leader_ < 0)
+                return;
+            ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            /// the times are not reset, so they are taken as a baseline
+            group g;
+            if (read_group(g)) {
+                enabled_ = g.time_enabled;
+                running_ = g.time_running;
+            }
+            ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+        }
+
+        sample stop() {
+            sample s;
+#ifdef __linux__
+            if (leader_ < 0)
+                return s;
+            ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            group g;
+            if (!read_group(g))
+                return s;
+            const uint64_t enabled = g.time_enabled - enabled_;
+            const uint64_t running = g.time_running - running_;
+            if (running == 0)
+                return s;  /// never scheduled, nothing is known
+            s.counted = enabled ? static_cast<double>(running) / enabled : 1;
+            for (int e = 0; e < EVENT_COUNT; ++e) {
+                if (slot_[e] < 0 || slot_[e] >= static_cast<int>(g.nr))
+                    continue;
+                const uint64_t v = g.value[slot_[e]];
+                s.value[e] = running < enabled
+                    ? static_cast<uint64_t>(static_cast<double>(v) * enabled / running)
+                    : v;
+                s.valid[e] = true;
+            }
+#endif
+            return s;
+        }
+
+     private:
+        /// layout of a PERF_FORMAT_GROUP read with both times
+        struct group {
+            uint64_t nr;
+            uint64_t time_enabled;
+            uint64_t time_running;
+            uint64_t value[EVENT_COUNT];
+        };
+
+        int fd_[EVENT_COUNT];
+        int slot_[EVENT_COUNT];  /// position in the group, -1 if not opened
+        int leader_ = -1;
+        int members_ = 0;
+        uint64_t enabled_ = 0, running_ = 0;
+
+        bool read_group(group& g) const {
+#ifdef __linux__
+            const ssize_t n = read(leader_, &g, sizeof(g));
+            return n >= static_cast<ssize_t>(3 * sizeof(uint64_t));
+#else
+            (void)g;
+            return false;
+#endif
+        }
+
+        /// opens event `e` as a member of `leader`'s group, or as the leader
+        static int open_event(int e, int leader) {
+#ifdef __linux__
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.disabled = leader < 0;  /// members follow the leader
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP |
+                PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            const uint64_t read_miss =
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            switch (e) {
+            case INSTRUCTIONS:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+            case CYCLES:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+            case L1D_MISSES:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_L1D | read_miss;
+                break;
+            case LLC_MISSES:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CACHE_MISSES;
+                break;
+            case BRANCH_MISSES:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+                break;
+            case DTLB_MISSES:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_DTLB | read_miss;
+                break;
+            default:
+                return -1;
+            }
+            /// this thread, any cpu; a member that would make the group
+            /// impossible to schedule is refused here and reported as n/a
+            return static_cast<int>(
+                syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+#else
+            (void)e;
+            (void)leader;
+            return -1;
+#endif
+        }
+    };
+
+    /**
+     * Prints the deltas of a region on one line, unavailable ones as n/a.
+     */
+    inline void print(const char* name, const sample& s) {
+        std::cout << name << ":";
+        for (int e = 0; e < EVENT_COUNT; ++e) {
+            std::cout << " \t" << event_name(e) << " ";
+            if (s.valid[e])
+                std::cout << s.value[e];
+            else
+                std::cout << "n/a";
+        }
+        if (s.counted < 1)
+            std::cout << " \t(multiplexed, scaled from " << s.counted * 100
+                << "% of the region)";
+        std::cout << std::endl;
+    }
+
+    /**
+     * Counters of the calling thread, opened on first use.
+     */
+    inline counters& thread_counters() {
+        static thread_local counters pc;
+        return pc;
+    }
+
+    /**
+     * Sample of the last EndCounters of the calling thread.
+     */
+    inline sample& last_sample() {
+        static thread_local sample s;
+        return s;
+    }
+}  // namespace perf
+
+/// nested inside StartTimer/EndTimer; printed by PrintCounters after EndTimer
+#define StartCounters	{ perf::counters& pcounters = perf::thread_counters();\
+				pcounters.start();
+
+#define EndCounters	perf::last_sample() = pcounters.stop(); \
+				} \
+
+#define PrintCounters(name)	perf::print(#name, perf::last_sample());
+
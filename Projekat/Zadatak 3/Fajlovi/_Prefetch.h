@@ -0,0 +1,364 @@
+#pragma once
+/**
+ * @file
+ * @brief Software prefetch once per cache line, with tuned distance and hint
+ *
+ * @details
+ * A `prefetch::stream` follows a loop over an array: `advance(&a[i])`
+ * prefetches every line up to `distance` bytes ahead of element i that has
+ * not been prefetched yet, so each line is prefetched once whatever the
+ * element size, and nothing past the end of the array.
+ *
+ * The distance and the hint (`_MM_HINT_T0` .. `_MM_HINT_NTA`) of a kernel
+ * depend on the machine and on the input size, so they are looked up per
+ * kernel and size class (inputs of 2^(k-1) .. 2^k - 1 bytes) in a
+ * `prefetch::kernel`:
+ *
+ *     static prefetch::kernel tuning("encrypt");
+ *     prefetch::settings s = tuning.get(text.length(), [&](const prefetch::settings& t) {
+ *         benchmark::do_not_optimize(encryptO(text, key, t));
+ *     });
+ *
+ * The environment variable `AOR2_PREFETCH` chooses where settings come from:
+ *  - unset: the cache file, else 4 lines ahead with `T0`;
+ *  - `calibrate`: the first call of every kernel and size class that is not
+ *    in the cache file times the probe with prefetching off and with every
+ *    distance and hint, keeps the fastest and appends it to the cache file,
+ *    so later runs on the same machine start with it (delete the file to
+ *    measure again). Prefetching is kept only if it is significantly
+ *    faster than off: by 2% in the median, with the 95% confidence
+ *    intervals of the means apart, and again when the winner is timed once
+ *    more against off, since the best of many candidates is fast partly by
+ *    chance;
+ *  - `off`, or `<distance>:<hint>` such as `512:t0`: fixed settings.
+ *
+ * Size classes that fit in the L1 data cache are not calibrated and, unless
+ * fixed or in the cache file, not prefetched: their data is there already.
+ *
+ * The cache file is `prefetch.cache`, or `AOR2_PREFETCH_CACHE`; its lines are
+ * "machine kernel size-class distance hint", the machine being the CPU model.
+ * Calibration is meant for single-threaded start-up code.
+ */
+
+#include <algorithm>    /// for std::min
+#include <cmath>        /// for std::sqrt
+#include <cstdint>      /// for uintptr_t
+#include <cstdlib>      /// for getenv, strtoul
+#include <cstring>      /// for strcmp
+#include <fstream>      /// for std::ifstream, std::ofstream
+#include <iostream>     /// for std::cerr
+#include <map>          /// for std::map
+#include <sstream>      /// for std::istringstream
+#include <string>       /// for std::string
+#include <unistd.h>     /// for sysconf
+#include <xmmintrin.h>  /// for _mm_prefetch
+
+#include "_Benchmark.h"
+
+namespace prefetch {
+    /**
+     * Hints of `_mm_prefetch`, from all cache levels to non-temporal.
+     */
+    enum hint {
+        T0,
+        T1,
+        T2,
+        NTA,
+        HINT_COUNT
+    };
+
+    inline const char* hint_name(int h) {
+        static const char* names[HINT_COUNT] = { "t0", "t1", "t2", "nta" };
+        return names[h];
+    }
+
+    static const size_t LINE = 64;            /// bytes of a cache line
+    static const size_t MAX_DISTANCE = 4096;  /// longest distance tried
+
+    /// bytes of the L1 data cache, 32 KiB where the system does not say
+    inline size_t l1_bytes() {
+        long bytes = 0;
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+        bytes = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+#endif
+        return bytes > 0 ? static_cast<size_t>(bytes) : 32 * 1024;
+    }
+
+    /**
+     * How far ahead and into which caches to prefetch.
+     */
+    struct settings {
+        size_t distance = 4 * LINE;  /// bytes, 0 = no prefetching
+        hint locality = T0;
+    };
+
+    inline void issue(uintptr_t address, hint h) {
+        const char* p = reinterpret_cast<const char*>(address);
+        switch (h) {
+        case T0: _mm_prefetch(p, _MM_HINT_T0); break;
+        case T1: _mm_prefetch(p, _MM_HINT_T1); break;
+        case T2: _mm_prefetch(p, _MM_HINT_T2); break;
+        default: _mm_prefetch(p, _MM_HINT_NTA); break;
+        }
+    }
+
+    /**
+     * Prefetches of one array read from `begin` towards `end`.
+     */
+    class stream {
+     public:
+        stream(const void* begin, const void* end, const settings& s)
+            : next_(reinterpret_cast<uintptr_t>(begin) & ~uintptr_t(LINE - 1)),
+            end_(s.distance ? reinterpret_cast<uintptr_t>(end) : next_),
+            distance_(s.distance), locality_(s.locality) {}
+
+        /// the loop has reached `p`
+        void advance(const void* p) {
+            const uintptr_t ahead = reinterpret_cast<uintptr_t>(p) + distance_;
+            while (next_ <= ahead && next_ < end_) {
+                issue(next_, locality_);
+                next_ += LINE;
+            }
+        }
+
+     private:
+        uintptr_t next_;  /// first line not prefetched yet
+        uintptr_t end_;
+        size_t distance_;
+        hint locality_;
+    };
+
+    /**
+     * Source of the settings of all kernels: the environment, the cache
+     * file and calibration.
+     */
+    class tuner {
+     public:
+        tuner() {
+            if (const char* path = getenv("AOR2_PREFETCH_CACHE"))
+                if (*path)
+                    path_ = path;
+            if (const char* env = getenv("AOR2_PREFETCH")) {
+                if (strcmp(env, "calibrate") == 0)
+                    calibrating_ = true;
+                else if (strcmp(env, "off") == 0) {
+                    fixed_ = true;
+                    fixed_settings_.distance = 0;
+                }
+                else if (*env)
+                    fixed_ = parse(env, fixed_settings_);
+            }
+            machine_ = machine();
+            load();
+        }
+
+        bool calibrating() const { return calibrating_; }
+        void set_calibrating(bool on) { calibrating_ = on; }
+
+        /// fixed or cached settings of `kernel` for `size_class`, false if none
+        bool find(const char* kernel, int size_class, settings& s) const {
+            if (fixed_) {
+                s = fixed_settings_;
+                return true;
+            }
+            auto it = cache_.find(key(kernel, size_class));
+            if (it == cache_.end())
+                return false;
+            s = it->second;
+            return true;
+        }
+
+        /// remembers calibrated settings, also in the cache file
+        void store(const char* kernel, int size_class, const settings& s) {
+            cache_[key(kernel, size_class)] = s;
+            std::ofstream out(path_, std::ios::app);
+            if (out)
+                out << machine_ << ' ' << kernel << ' ' << size_class << ' '
+                    << s.distance << ' ' << hint_name(s.locality) << '\n';
+        }
+
+     private:
+        static std::string key(const char* kernel, int size_class) {
+            return std::string(kernel) + ' ' + std::to_string(size_class);
+        }
+
+        /// "<distance>:<hint>"
+        static bool parse(const std::string& text, settings& s) {
+            const size_t colon = text.find(':');
+            if (colon == std::string::npos)
+                return false;
+            for (int h = 0; h < HINT_COUNT; ++h)
+                if (text.compare(colon + 1, std::string::npos, hint_name(h)) == 0) {
+                    s.distance = strtoul(text.c_str(), nullptr, 10);
+                    s.locality = static_cast<hint>(h);
+                    return true;
+                }
+            return false;
+        }
+
+        /// CPU model without spaces, "unknown" where there is no /proc/cpuinfo
+        static std::string machine() {
+            std::ifstream in("/proc/cpuinfo");
+            std::string line;
+            while (std::getline(in, line)) {
+                if (line.compare(0, 10, "model name") != 0)
+                    continue;
+                std::string name;
+                for (size_t i = line.find(':') + 1; i < line.size(); ++i)
+                    if (line[i] != ' ' || (!name.empty() && name.back() != '_'))
+                        name += line[i] == ' ' ? '_' : line[i];
+                return name.empty() ? "unknown" : name;
+            }
+            return "unknown";
+        }
+
+        /// entries of this machine, later lines win
+        void load() {
+            std::ifstream in(path_);
+            std::string line;
+            while (std::getline(in, line)) {
+                std::istringstream fields(line);
+                std::string machine, kernel, locality;
+                int size_class;
+                settings s;
+                if (!(fields >> machine >> kernel >> size_class >> s.distance >> locality) ||
+                    machine != machine_ ||
+                    !parse(std::to_string(s.distance) + ':' + locality, s))
+                    continue;
+                cache_[key(kernel.c_str(), size_class)] = s;
+            }
+        }
+
+        std::string path_ = "prefetch.cache";
+        std::string machine_;
+        bool calibrating_ = false;
+        bool fixed_ = false;
+        settings fixed_settings_;
+        std::map<std::string, settings> cache_;
+    };
+
+    inline tuner& get_tuner() {
+        static tuner t;
+        return t;
+    }
+
+    /**
+     * Runtime switch of calibration, initially on if `AOR2_PREFETCH=calibrate`.
+     */
+    inline bool calibrating() { return get_tuner().calibrating(); }
+    inline void set_calibrating(bool on) { get_tuner().set_calibrating(on); }
+
+    /**
+     * `a` is faster than `b` beyond the noise: by 2% in the median, and the
+     * 95% confidence intervals of the means do not overlap.
+     */
+    inline bool faster(const benchmark::result& a, const benchmark::result& b) {
+        const double ha = 1.96 * a.stddev_ns / std::sqrt(a.samples);
+        const double hb = 1.96 * b.stddev_ns / std::sqrt(b.samples);
+        return a.median_ns < 0.98 * b.median_ns && a.mean_ns + ha < b.mean_ns - hb;
+    }
+
+    /**
+     * Times `probe(settings)` for no prefetching and every distance up to
+     * the input size (at most MAX_DISTANCE) and hint.
+     * @returns the fastest settings, off unless they are `faster` than off
+     * also when timed again
+     */
+    template <class F>
+    settings calibrate(const char* name, size_t bytes, F&& probe) {
+        benchmark::options opt;
+        opt.warmup = 1;
+        opt.min_time = 0.01;
+        opt.min_samples = 5;
+        settings off;
+        off.distance = 0;
+        settings best = off;
+        const benchmark::result off_result = benchmark::run(name, [&] { probe(off); }, opt);
+        benchmark::result best_result = off_result;
+        double fastest_ns = off_result.median_ns;  /// of all settings, for the report
+        for (size_t d = LINE; d <= MAX_DISTANCE && d < bytes + LINE; d *= 2) {
+            for (int h = 0; h < HINT_COUNT; ++h) {
+                settings s;
+                s.distance = d;
+                s.locality = static_cast<hint>(h);
+                const benchmark::result res = benchmark::run(name, [&] { probe(s); }, opt);
+                fastest_ns = std::min(fastest_ns, res.median_ns);
+                if (res.median_ns < best_result.median_ns && faster(res, off_result)) {
+                    best = s;
+                    best_result = res;
+                }
+            }
+        }
+        std::cerr << "prefetch " << name << ", " << bytes << " B: ";
+        if (best.distance) {
+            const benchmark::result off_again = benchmark::run(name, [&] { probe(off); }, opt);
+            const benchmark::result best_again = benchmark::run(name, [&] { probe(best); }, opt);
+            std::cerr << best.distance << " B " << hint_name(best.locality) << " ("
+                << best_again.median_ns << " ns, off " << off_again.median_ns << " ns when timed again)";
+            if (!faster(best_again, off_again)) {
+                std::cerr << ", not significant: off";
+                best = off;
+            }
+        }
+        else
+            std::cerr << "off (" << off_result.median_ns << " ns, fastest prefetching "
+                << fastest_ns << " ns)";
+        std::cerr << '\n';
+        return best;
+    }
+
+    /**
+     * Settings of one kernel per size class, resolved on first use.
+     */
+    class kernel {
+     public:
+        explicit kernel(const char* name) : name_(name) {}
+
+        /// settings for `bytes` of input, never calibrating
+        settings get(size_t bytes) {
+            const int c = size_class(bytes);
+            if (!known_[c]) {
+                if (!get_tuner().find(name_, c, settings_[c]) && in_l1(c))
+                    settings_[c].distance = 0;
+                known_[c] = true;
+            }
+            return settings_[c];
+        }
+
+        /// settings for `bytes` of input, calibrated with `probe` if needed
+        template <class F>
+        settings get(size_t bytes, F&& probe) {
+            const int c = size_class(bytes);
+            if (!known_[c]) {
+                tuner& t = get_tuner();
+                if (!t.find(name_, c, settings_[c])) {
+                    if (in_l1(c))
+                        settings_[c].distance = 0;
+                    else if (t.calibrating()) {
+                        settings_[c] = calibrate(name_, bytes, probe);
+                        t.store(name_, c, settings_[c]);
+                    }
+                }
+                known_[c] = true;
+            }
+            return settings_[c];
+        }
+
+     private:
+        /// all inputs of size class `c` (below 2^c bytes) fit in L1
+        static bool in_l1(int c) {
+            return c < 64 && (uint64_t(1) << c) - 1 <= l1_bytes();
+        }
+
+        static int size_class(size_t bytes) {
+            int c = 0;
+            while (bytes >> c)
+                ++c;
+            return c;
+        }
+
+        const char* name_;
+        bool known_[65] = {};
+        settings settings_[65];
+    };
+}  // namespace prefetch
@@ -0,0 +1,135 @@
+#pragma once
+/**
+ * @file
+ * @brief Registry of kernel variants for the comparison benchmark
+ *
+ * @details
+ * Every kernel (Vigenere, Gram Schmidt, ...) registers once with an input
+ * generator, a list of input sizes and an equivalence check, and every
+ * variant of it (ORIGINAL, OPTIMIZOVANO, VEKTORSKI, ...) registers with a
+ * name and a function from input to output. The first variant of a kernel
+ * is the reference. `benchmark.cpp` sweeps all sizes, checks every variant
+ * against the reference on the same input and times it with
+ * `benchmark::run`.
+ *
+ * Registration is done with static objects in the source file of the
+ * kernel, compiled with AOR2_BENCHMARK defined:
+ *
+ *     static registry::kernel<std::string, std::string> vigenere_kernel(
+ *         "vigenere", { 16, 1024 }, generate, std::equal_to<std::string>());
+ *     static registry::variant<std::string, std::string> v1(
+ *         vigenere_kernel, "ORIGINAL", run_original);
+ */
+
+#include <functional>  /// for std::function
+#include <memory>      /// for std::unique_ptr
+#include <string>      /// for std::string
+#include <vector>      /// for std::vector
+
+#include "_Benchmark.h"
+
+namespace registry {
+    /**
+     * One row of the comparison table.
+     */
+    struct row {
+        std::string kernel;
+        std::string variant;
+        size_t size = 0;
+        bool equivalent = false;  /// output matches the reference
+        benchmark::result timing;
+        double speedup = 0;       /// reference median / variant median
+    };
+
+    /**
+     * Type erased kernel, as stored in the registry.
+     */
+    class kernel_base {
+     public:
+        explicit kernel_base(const std::string& name) : name_(name) {}
+        virtual ~kernel_base() {}
+
+        const std::string& name() const { return name_; }
+
+        /// checks and times every variant on every size
+        virtual std::vector<row> run(const benchmark::options& opt) = 0;
+
+     private:
+        std::string name_;
+    };
+
+    /**
+     * All registered kernels, in registration order.
+     */
+    inline std::vector<kernel_base*>& kernels() {
+        static std::vector<kernel_base*> all;
+        return all;
+    }
+
+    /**
+     * Kernel taking `Input` and producing `Output`.
+     */
+    template <class Input, class Output>
+    class kernel : public kernel_base {
+     public:
+        typedef std::function<Input(size_t size, unsigned seed)> generator;
+        typedef std::function<bool(const Output& ref, const Output& out)> checker;
+        typedef std::function<Output(const Input&)> function;
+
+        kernel(const std::string& name, const std::vector<size_t>& sizes,
+            generator generate, checker equivalent)
+            : kernel_base(name), sizes_(sizes), generate_(generate),
+            equivalent_(equivalent) {
+            kernels().push_back(this);
+        }
+
+        void add(const std::string& name, function f) {
+            variants_.push_back(std::make_pair(name, f));
+        }
+
+        std::vector<row> run(const benchmark::options& opt) override {
+            std::vector<row> rows;
+            for (size_t size : sizes_) {
+                Input in = generate_(size, 1);
+                Output ref;
+                double ref_median = 0;
+                for (size_t v = 0; v < variants_.size(); ++v) {
+                    const function& f = variants_[v].second;
+                    row r;
+                    r.kernel = name();
+                    r.variant = variants_[v].first;
+                    r.size = size;
+                    Output out = f(in);
+                    if (v == 0)
+                        ref = out;
+                    r.equivalent = equivalent_(ref, out);
+                    r.timing = benchmark::run(r.variant, [&] {
+                        benchmark::do_not_optimize(f(in));
+                    }, opt);
+                    if (v == 0)
+                        ref_median = r.timing.median_ns;
+                    r.speedup = ref_median / r.timing.median_ns;
+                    rows.push_back(r);
+                }
+            }
+            return rows;
+        }
+
+     private:
+        std::vector<size_t> sizes_;
+        generator generate_;
+        checker equivalent_;
+        std::vector<std::pair<std::string, function>> variants_;
+    };
+
+    /**
+     * Registers one variant of a kernel; the first one is the reference.
+     */
+    template <class Input, class Output>
+    struct variant {
+        variant(kernel<Input, Output>& k, const std::string& name,
+            typename kernel<Input, Output>::function f) {
+            k.add(name, f);
+        }
+    };
+}  // namespace registry
@@ -10,7 +10,7 @@
 					if(strlen(timername)>0)			\
 						std::cout<<""<<timername<<": \t"<< chrono::duration_cast<chrono::nanoseconds>(end - start).count() << " ns" <<std::endl; \
 					else \
-						std::cout<<"Time of execution: %f\n" << chrono::duration_cast<chrono::nanoseconds>(end - start).count() << " ns" <<std::endl; \
+						std::cout<<"Time of execution: \t" << chrono::duration_cast<chrono::nanoseconds>(end - start).count() << " ns" <<std::endl; \
 						} \
 
 
@@ -0,0 +1,228 @@
+#pragma once
+/**
+ * @file
+ * @brief Low-overhead tracing profiler with Chrome trace export
+ *
+ * @details
+ * `TraceScope(name)` marks the rest of the enclosing block as a named
+ * scope. When the scope closes, one complete event (name, start, duration)
+ * is written into a ring buffer owned by the current thread, and the scope
+ * total and count are added to a per-thread table. There is no lock, no
+ * allocation and no output on that path, only two clock reads and a few
+ * stores. When a buffer is full the oldest events are overwritten; totals
+ * and counts are still exact.
+ *
+ * Tracing is off unless the environment variable `AOR2_TRACE` is set (its
+ * value is the output file) or `trace::set_enabled(true)` is called. At
+ * program exit the events of all threads are written as Chrome
+ * `trace_event` JSON (open in chrome://tracing or Perfetto) and the
+ * per-scope totals are printed to std::cerr.
+ *
+ * The exporter runs at exit, so threads that record events must have been
+ * joined by then.
+ */
+
+#include <algorithm>  /// for std::sort
+#include <atomic>     /// for std::atomic
+#include <chrono>     /// for std::chrono::steady_clock
+#include <cstdint>    /// for uint64_t
+#include <cstdlib>    /// for getenv
+#include <fstream>    /// for std::ofstream
+#include <iostream>   /// for std::cerr
+#include <map>        /// for std::map
+#include <memory>     /// for std::unique_ptr
+#include <mutex>      /// for std::mutex
+#include <string>     /// for std::string
+#include <vector>     /// for std::vector
+
+namespace trace {
+    /**
+     * One finished scope.
+     */
+    struct event {
+        const char* name;
+        uint64_t start_ns;
+        uint64_t duration_ns;
+    };
+
+    /**
+     * Total time and number of closings of one scope name.
+     */
+    struct scope_stats {
+        const char* name = nullptr;
+        uint64_t total_ns = 0;
+        uint64_t count = 0;
+    };
+
+    /**
+     * Events and scope totals of one thread. Only the owning thread writes;
+     * the exporter reads after the writers are done.
+     */
+    struct thread_buffer {
+        static const size_t CAPACITY = size_t(1) << 16;  /// events, power of 2
+        static const size_t STATS = 256;                 /// scope names
+
+        int tid = 0;
+        std::atomic<uint64_t> written{0};
+        event events[CAPACITY];
+        scope_stats stats[STATS];
+
+        void record(const char* name, uint64_t start, uint64_t duration) {
+            uint64_t n = written.load(std::memory_order_relaxed);
+            events[n & (CAPACITY - 1)] = event{ name, start, duration };
+            written.store(n + 1, std::memory_order_release);
+
+            /// names are string literals, so the pointer is the key
+            size_t h = (reinterpret_cast<uintptr_t>(name) >> 3) & (STATS - 1);
+            for (size_t i = 0; i < STATS; ++i, h = (h + 1) & (STATS - 1)) {
+                if (stats[h].name == name || stats[h].name == nullptr) {
+                    stats[h].name = name;
+                    stats[h].total_ns += duration;
+                    stats[h].count++;
+                    return;
+                }
+            }
+        }
+    };
+
+    inline uint64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * All thread buffers; writes the trace when destroyed at exit.
+     */
+    class registry {
+     public:
+        std::atomic<bool> enabled{false};
+        std::string path = "trace.json";
+
+        registry() {
+            if (const char* env = getenv("AOR2_TRACE")) {
+                if (*env)
+                    path = env;
+                enabled.store(true, std::memory_order_relaxed);
+            }
+        }
+
+        ~registry() {
+            if (!buffers_.empty())
+                write();
+        }
+
+        thread_buffer* add() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            buffers_.emplace_back(new thread_buffer());
+            buffers_.back()->tid = static_cast<int>(buffers_.size());
+            return buffers_.back().get();
+        }
+
+        /**
+         * Writes the Chrome trace to `path` and the scope totals to std::cerr.
+         */
+        void write() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::ofstream out(path);
+            out.setf(std::ios::fixed);
+            out.precision(3);  /// microseconds with ns resolution
+            out << "{\"traceEvents\": [\n";
+            bool first = true;
+            std::map<std::string, scope_stats> total;
+            for (const auto& b : buffers_) {
+                uint64_t n = b->written.load(std::memory_order_acquire);
+                uint64_t from = n > thread_buffer::CAPACITY
+                    ? n - thread_buffer::CAPACITY : 0;
+                for (uint64_t i = from; i < n; ++i) {
+                    const event& e = b->events[i & (thread_buffer::CAPACITY - 1)];
+                    out << (first ? "" : ",\n") << "{\"name\": \"" << e.name
+                        << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << b->tid
+                        << ", \"ts\": " << e.start_ns / 1000.0
+                        << ", \"dur\": " << e.duration_ns / 1000.0 << "}";
+                    first = false;
+                }
+                for (const scope_stats& s : b->stats) {
+                    if (s.name == nullptr)
+                        continue;
+                    scope_stats& t = total[s.name];
+                    t.total_ns += s.total_ns;
+                    t.count += s.count;
+                }
+            }
+            out << "\n]}\n";
+
+            std::vector<std::pair<std::string, scope_stats>> sorted(
+                total.begin(), total.end());
+            std::sort(sorted.begin(), sorted.end(),
+                [](const std::pair<std::string, scope_stats>& a,
+                    const std::pair<std::string, scope_stats>& b) {
+                    return a.second.total_ns > b.second.total_ns;
+                });
+            std::cerr << "Trace written to " << path << '\n';
+            for (const auto& s : sorted) {
+                std::cerr << s.first << ": \t" << s.second.count << " x, "
+                    << s.second.total_ns << " ns total, "
+                    << s.second.total_ns / s.second.count << " ns avg\n";
+            }
+        }
+
+     private:
+        std::mutex mutex_;
+        std::vector<std::unique_ptr<thread_buffer>> buffers_;
+    };
+
+    inline registry& get_registry() {
+        static registry r;
+        return r;
+    }
+
+    /**
+     * Runtime switch; can be changed at any time.
+     */
+    inline void set_enabled(bool on) {
+        get_registry().enabled.store(on, std::memory_order_relaxed);
+    }
+
+    /**
+     * Sets the output file of the trace written at exit.
+     */
+    inline void set_output(const std::string& path) {
+        get_registry().path = path;
+    }
+
+    inline thread_buffer* this_thread_buffer() {
+        static thread_local thread_buffer* buffer = get_registry().add();
+        return buffer;
+    }
+
+    /**
+     * Records one event when it goes out of scope, if tracing is enabled.
+     */
+    class scope {
+     public:
+        explicit scope(const char* name)
+            : name_(name),
+            start_(get_registry().enabled.load(std::memory_order_relaxed)
+                ? now_ns() : 0) {}
+
+        ~scope() {
+            if (start_ != 0) {
+                uint64_t end = now_ns();
+                this_thread_buffer()->record(name_, start_, end - start_);
+            }
+        }
+
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+
+     private:
+        const char* name_;
+        uint64_t start_;
+    };
+}  // namespace trace
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+
+/// traces the rest of the enclosing block under the given name
+#define TraceScope(name)	trace::scope TRACE_CONCAT(tracescope_, __LINE__)(#name);
@@ -0,0 +1,105 @@
+/**
+ * @file
+ * @brief Comparison benchmark of all registered kernel variants
+ *
+ * @details
+ * Build together with the kernels, with AOR2_BENCHMARK defined so their own
+ * `main` is left out and their variants are registered:
+ *
+ *     g++ -O2 -mavx2 -mfma -DAOR2_BENCHMARK benchmark.cpp gram_schmidt.cpp
+ *         vigenere_algorithm.cpp -o benchmark
+ *
+ * For every kernel and input size every variant is first checked against
+ * the reference variant on the same input, then timed. The result is a
+ * table with the median time, p90 and speedup over the reference. A variant
+ * whose output differs is marked MISMATCH and the program exits with 1.
+ *
+ * Options: --min-time <s> (sampling time per variant), --csv, --json
+ * (machine readable output instead of the table).
+ *
+ * With AOR2_PREFETCH=calibrate the prefetch distance and hint of the
+ * prefetching variants are tuned in their first, untimed run (`_Prefetch.h`).
+ */
+
+#include <cstdlib>   /// for atof
+#include <cstring>   /// for strcmp
+#include <iomanip>   /// for std::setw
+#include <iostream>  /// for io operations
+#include <string>    /// for std::string
+#include <vector>    /// for std::vector
+
+#include "_Benchmark.h"
+#include "_Registry.h"
+
+/** Driver Code */
+int main(int argc, char* argv[]) {
+    benchmark::options opt;
+    opt.min_time = 0.2;
+    bool csv = false, json = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+            opt.min_time = atof(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else if (strcmp(argv[i], "--json") == 0)
+            json = true;
+        else {
+            std::cerr << "Usage: " << argv[0]
+                << " [--min-time seconds] [--csv | --json]\n";
+            return 2;
+        }
+    }
+
+    std::vector<registry::row> rows;
+    for (registry::kernel_base* k : registry::kernels()) {
+        std::vector<registry::row> r = k->run(opt);
+        rows.insert(rows.end(), r.begin(), r.end());
+    }
+
+    bool ok = true;
+    for (const registry::row& r : rows)
+        ok = ok && r.equivalent;
+
+    if (csv) {
+        std::cout << "kernel,variant,size,equivalent,median_ns,p90_ns,p99_ns,"
+            "stddev_ns,speedup\n";
+        for (const registry::row& r : rows) {
+            std::cout << r.kernel << ',' << r.variant << ',' << r.size << ','
+                << (r.equivalent ? 1 : 0) << ',' << r.timing.median_ns << ','
+                << r.timing.p90_ns << ',' << r.timing.p99_ns << ','
+                << r.timing.stddev_ns << ',' << r.speedup << '\n';
+        }
+    }
+    else if (json) {
+        std::cout << "[\n";
+        for (size_t i = 0; i < rows.size(); ++i) {
+            const registry::row& r = rows[i];
+            std::cout << "  {\"kernel\": \"" << r.kernel << "\", \"variant\": \""
+                << r.variant << "\", \"size\": " << r.size
+                << ", \"equivalent\": " << (r.equivalent ? "true" : "false")
+                << ", \"median_ns\": " << r.timing.median_ns
+                << ", \"p90_ns\": " << r.timing.p90_ns
+                << ", \"p99_ns\": " << r.timing.p99_ns
+                << ", \"stddev_ns\": " << r.timing.stddev_ns
+                << ", \"speedup\": " << r.speedup << "}"
+                << (i + 1 < rows.size() ? ",\n" : "\n");
+        }
+        std::cout << "]\n";
+    }
+    else {
+        std::cout << std::left << std::setw(14) << "kernel" << std::setw(22)
+            << "variant" << std::right << std::setw(10) << "size"
+            << std::setw(16) << "median ns" << std::setw(16) << "p90 ns"
+            << std::setw(10) << "speedup" << "  check\n";
+        for (const registry::row& r : rows) {
+            std::cout << std::left << std::setw(14) << r.kernel << std::setw(22)
+                << r.variant << std::right << std::setw(10) << r.size
+                << std::fixed << std::setprecision(0) << std::setw(16)
+                << r.timing.median_ns << std::setw(16) << r.timing.p90_ns
+                << std::setprecision(2) << std::setw(10) << r.speedup
+                << std::defaultfloat << std::setprecision(6) << "  "
+                << (r.equivalent ? "OK" : "MISMATCH") << '\n';
+        }
+    }
+    return ok ? 0 : 1;
+}
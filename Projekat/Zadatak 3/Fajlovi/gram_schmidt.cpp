@@ -24,6 +24,11 @@
  *  taken is 20.
  *  Please do not give linearly dependent vectors
  *
+ *  The O variants prefetch through _Prefetch.h, but no input here is larger
+ *  than 30 x 30 doubles (7200 bytes), which fits in the L1 data cache: they
+ *  are never calibrated and do not prefetch unless AOR2_PREFETCH fixes the
+ *  settings.
+ *
  *
  * @author [Akanksha Gupta](https://github.com/Akanksha-Gupta920)
  */
@@ -38,7 +43,9 @@
 #include "emmintrin.h"
 #include "stdio.h"
 #include "math.h"
+#include "_Prefetch.h"
 #include "_Timer.h"
+#include "_Trace.h"
 
 using namespace std;
 
@@ -74,58 +81,28 @@ namespace linear_algebra {
         }
 
         double dot_productO(const std::array<double, 30>& x,
-            const std::array<double, 30>& y, const int& c) {
+            const std::array<double, 30>& y, const int& c,
+            const prefetch::settings& s) {
             /*OPTIMIZOVANO*/
-           // if (c > 9) {
-                double sum = 0;
-                register int i = 0;
-               // for (; i < 9; i++)
-                //{
-                    _mm_prefetch((char*)(&x[i]), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i]+1), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i]+2), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i]+3), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i]+4), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 5), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 6), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 7), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&y[i]), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i]+1), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i]+2), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i]+3), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&y[i]+4), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 5), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 6), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 7), _MM_HINT_T1);
-                //}
-
-                for (i = 1; i < c; i++) {
-                    _mm_prefetch((char*)(&x[i]), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 1), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 2), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 3), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 4), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 5), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 6), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 7), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&y[i]), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 1), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 2), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 3), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&y[i] + 4), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 5), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 6), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&x[i] + 7), _MM_HINT_T1);
-                    sum += x[i - 1] * y[i - 1];
-                }
-                sum += x[c - 1] * y[c - 1];
-               /* for ( i = c-9; i < c; i++)
-                {
-                    sum += x[i] * y[i];
-                }*/
-                return sum;
-            //}
-            //else return dot_product(x, y, c);
+            double sum = 0;
+            prefetch::stream ahead_x(&x[0], &x[0] + c, s), ahead_y(&y[0], &y[0] + c, s);
+            for (int i = 0; i < c; i++) {
+                ahead_x.advance(&x[i]);
+                ahead_y.advance(&y[i]);
+                sum += x[i] * y[i];
+            }
+            return sum;
+        }
+
+        /**
+         * dot_productO with the prefetch settings of this machine and size
+         */
+        double dot_productO(const std::array<double, 30>& x,
+            const std::array<double, 30>& y, const int& c) {
+            static prefetch::kernel tuning("dot_product");
+            return dot_productO(x, y, c, tuning.get(2 * c * sizeof(double),
+                [&](const prefetch::settings& s) {
+                    benchmark::do_not_optimize(dot_productO(x, y, c, s)); }));
         }
 
         /*OPTIMIZOVANO VEKTORSKI*/
@@ -133,28 +110,27 @@ namespace linear_algebra {
             const std::array<double, 30>& y, const int& c) {
             /*ORIGINAL*/
             double sum = 0;
-            register int i = 0;
-            int ostatak = c % 4;
+            int i = 0;
             int kolicnik = c / 4;
             if (kolicnik != 0) {
                 __m256d v1;
                 __m256d v2;
                 __m256d suma = _mm256_set1_pd(0);
                 for (; i < kolicnik; i++) {
-                    v1 = _mm256_load_pd(&x[4*i]);
-                    v2 = _mm256_load_pd(&y[4*i]);
+                    v1 = _mm256_loadu_pd(&x[4*i]);
+                    v2 = _mm256_loadu_pd(&y[4*i]);
                     suma = _mm256_fmadd_pd(v1, v2, suma);
                 }
+                double lanes[4];  /// the lanes of suma, portably
+                _mm256_storeu_pd(lanes, suma);
                 for (i = 0; i < 4; i++)
                 {
-                    sum += suma.m256d_f64[i];
+                    sum += lanes[i];
                 }
-                v1 = _mm256_load_pd(&x[4 * kolicnik]);
-                v2 = _mm256_load_pd(&y[4 * kolicnik]);
-                suma = _mm256_mul_pd(v1, v2);
-                for (i = 0;i < ostatak; i++)
+                /// the rest one by one, a 4-wide load would read past c
+                for (i = 4 * kolicnik; i < c; i++)
                 {
-                    sum += suma.m256d_f64[i];
+                    sum += x[i] * y[i];
                 }
                 return sum;
             }
@@ -187,11 +163,12 @@ namespace linear_algebra {
 
         /*OPTIMIZOVANO*/
         double projectionO(const std::array<double, 30>& x,
-            const std::array<double, 30>& y, const int& c) {
+            const std::array<double, 30>& y, const int& c,
+            const prefetch::settings& s) {
             double dot =
-                dot_productO(x, y, c);  /// The dot product of two vectors is taken
+                dot_productO(x, y, c, s);  /// The dot product of two vectors is taken
             double anorm =
-                dot_productO(y, y, c);  /// The norm of the second vector is taken.
+                dot_productO(y, y, c, s);  /// The norm of the second vector is taken.
             double factor =
                 dot /
                 anorm;  /// multiply that factor with every element in a 3rd vector,
@@ -235,67 +212,41 @@ namespace linear_algebra {
         }
 
         void displayO(const int& r, const int& c,
-            const std::array<std::array<double, 30>, 30>& B) {
+            const std::array<std::array<double, 30>, 30>& B,
+            const prefetch::settings& s) {
             /*OPTIMIZOVANO*/
-           // if (c > 8) {
-                for (int i = 0; i < r; ++i) {
-                    std::cout << "Vector " << i + 1 << ": ";
-
-                    _mm_prefetch((char*)(&B[i][0]), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&B[i][0]+1), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&B[i][0]+2), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&B[i][0]+3), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&B[i][0]+4), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&B[i][0]+5), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&B[i][0]+6), _MM_HINT_T1);
-                    _mm_prefetch((char*)(&B[i][0]+7), _MM_HINT_T1);
-
-                    for (int j = 1; j < c; ++j) {
-                        _mm_prefetch((char*)(&B[i][0]), _MM_HINT_T1);
-                        _mm_prefetch((char*)(&B[i][0] + 1), _MM_HINT_T1);
-                        _mm_prefetch((char*)(&B[i][0] + 2), _MM_HINT_T1);
-                        _mm_prefetch((char*)(&B[i][0] + 3), _MM_HINT_T1);
-                        _mm_prefetch((char*)(&B[i][0] + 4), _MM_HINT_T1);
-                        _mm_prefetch((char*)(&B[i][0] + 5), _MM_HINT_T1);
-                        _mm_prefetch((char*)(&B[i][0] + 6), _MM_HINT_T1);
-                        _mm_prefetch((char*)(&B[i][0] + 7), _MM_HINT_T1);
-                        std::cout << B[i][j - 1] << " ";
-                    }
-                   /* std::cout << B[i][c - 8] << " ";
-                    std::cout << B[i][c - 7] << " ";
-                    std::cout << B[i][c - 6] << " ";
-                    std::cout << B[i][c - 5] << " ";
-                    std::cout << B[i][c - 4] << " ";
-                    std::cout << B[i][c - 3] << " ";
-                    std::cout << B[i][c - 2] << " ";*/
-                    std::cout << B[i][c - 1] << " ";
-                    std::cout << '\n';
+            if (r <= 0)
+                return;  /// nothing to print, and no B[r - 1] to stream to
+            prefetch::stream ahead(&B[0][0], &B[r - 1][0] + c, s);
+            for (int i = 0; i < r; ++i) {
+                std::cout << "Vector " << i + 1 << ": ";
+                for (int j = 0; j < c; ++j) {
+                    ahead.advance(&B[i][j]);
+                    std::cout << B[i][j] << " ";
                 }
-           // }
-            //else display(r, c, B);
+                std::cout << '\n';
+            }
+        }
+
+        /**
+         * displayO with the cached prefetch settings; printing is not
+         * calibrated
+         */
+        void displayO(const int& r, const int& c,
+            const std::array<std::array<double, 30>, 30>& B) {
+            static prefetch::kernel tuning("display");
+            displayO(r, c, B, tuning.get(r * c * sizeof(double)));
         }
         
         
 
         /**
-         * Function for the process of Gram Schimdt Process
-         * @param r number of vectors
-         * @param c dimension of vectors
-         * @param A stores input of given LI vectors
-         * @param B stores orthogonalised vectors
-         *
-         * @returns void
+         * Orthogonalises the first r (at most c) vectors of A into B;
+         * gram_schmidt without the output.
          */
-        void gram_schmidt(int r, const int& c,
+        void orthogonalise(int r, const int& c,
             const std::array<std::array<double, 30>, 30>& A,
-            std::array<std::array<double, 30>, 30> B) {
-            if (c < r) {  /// we check whether appropriate dimensions are given or not.
-                std::cout << "Dimension of vector is less than number of vector, hence "
-                    "\n first "
-                    << c << " vectors are orthogonalised\n";
-                r = c;
-            }
-
+            std::array<std::array<double, 30>, 30>& B) {
             int k = 1;
 
             while (k <= r) {
@@ -340,19 +291,38 @@ namespace linear_algebra {
                 }
                 k++;
             }
-            display(r, c, B);  // for displaying orthogoanlised vectors
         }
 
-        void gram_schmidtO1(int r, const int& c,
+        /**
+         * Function for the process of Gram Schimdt Process
+         * @param r number of vectors
+         * @param c dimension of vectors
+         * @param A stores input of given LI vectors
+         * @param B stores orthogonalised vectors
+         *
+         * @returns void
+         */
+        void gram_schmidt(int r, const int& c,
             const std::array<std::array<double, 30>, 30>& A,
             std::array<std::array<double, 30>, 30> B) {
+            TraceScope(gram_schmidt)
             if (c < r) {  /// we check whether appropriate dimensions are given or not.
                 std::cout << "Dimension of vector is less than number of vector, hence "
                     "\n first "
                     << c << " vectors are orthogonalised\n";
                 r = c;
             }
+            orthogonalise(r, c, A, B);
+            display(r, c, B);  // for displaying orthogoanlised vectors
+        }
 
+        /**
+         * Orthogonalises the first r vectors of A into B with AVX;
+         * gram_schmidtO1 without the output.
+         */
+        void orthogonaliseO1(int r, const int& c,
+            const std::array<std::array<double, 30>, 30>& A,
+            std::array<std::array<double, 30>, 30>& B) {
             int k = 1;
 
             while (k <= r) {
@@ -376,17 +346,16 @@ namespace linear_algebra {
                                               /// previous array will change
                         factor = projectionO1(A[k - 1], B[l - 1], c);
                         
-                        register int i = 0;
-                        int ostatak = c % 4;
+                        int i = 0;
                         int kolicnik = c / 4;
-                        __m256 v2 = _mm256_set1_pd(factor);
+                        __m256d v2 = _mm256_set1_pd(factor);
                         if (kolicnik != 0) {
                             __m256d v1,suma;
                             for (; i < kolicnik; ++i) {
-                                v1 = _mm256_load_pd(&B[l-1][i*4]);
-                                suma = _mm256_load_pd(&all_projection[i*4]);
+                                v1 = _mm256_loadu_pd(&B[l-1][i*4]);
+                                suma = _mm256_loadu_pd(&all_projection[i*4]);
                                 suma = _mm256_fmadd_pd(v1, v2, suma);
-                                _mm256_store_pd(&all_projection[i*4], suma);
+                                _mm256_storeu_pd(&all_projection[i*4], suma);
                             }
                         }
 
@@ -406,19 +375,30 @@ namespace linear_algebra {
                 }
                 k++;
             }
-            display(r, c, B);  // for displaying orthogoanlised vectors
         }
 
-        void gram_schmidtO(int r, const int& c,
+        void gram_schmidtO1(int r, const int& c,
             const std::array<std::array<double, 30>, 30>& A,
             std::array<std::array<double, 30>, 30> B) {
+            TraceScope(gram_schmidtO1)
             if (c < r) {  /// we check whether appropriate dimensions are given or not.
                 std::cout << "Dimension of vector is less than number of vector, hence "
                     "\n first "
                     << c << " vectors are orthogonalised\n";
                 r = c;
             }
+            orthogonaliseO1(r, c, A, B);
+            display(r, c, B);  // for displaying orthogoanlised vectors
+        }
 
+        /**
+         * Orthogonalises the first r vectors of A into B, with the given
+         * prefetch settings; gram_schmidtO without the output.
+         */
+        void orthogonaliseO(int r, const int& c,
+            const std::array<std::array<double, 30>, 30>& A,
+            std::array<std::array<double, 30>, 30>& B,
+            const prefetch::settings& s) {
             int k = 1;
 
             while (k <= r) {
@@ -436,53 +416,16 @@ namespace linear_algebra {
 
                     int l = 1;
                     while (l < k) {
-                        std::array<double, 30>
-                            temp{};           /// to store previous projected array
                         double factor = NAN;  /// to store the factor by which the
                                               /// previous array will change
-                        factor = projectionO(A[k - 1], B[l - 1], c);
+                        factor = projectionO(A[k - 1], B[l - 1], c, s);
                         /*OPTIMIZOVANO*/
-                       
-                            register int i = 0;
-                            
-                                _mm_prefetch((char*)(&B[l - 1][i] + 0), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&B[l - 1][i] + 1), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&B[l - 1][i] + 2), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&B[l - 1][i] + 3), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&B[l - 1][i] + 4), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&B[l - 1][i] + 5), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&B[l - 1][i] + 6), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&B[l - 1][i] + 7), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&all_projection[i] + 0), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&all_projection[i] + 1), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&all_projection[i] + 2), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&all_projection[i] + 3), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&all_projection[i] + 4), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&all_projection[i] + 5), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&all_projection[i] + 6), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&all_projection[i] + 7), _MM_HINT_T1);
-                            
-                            for (i = 1; i < c; ++i) {
-                                _mm_prefetch((char*)(&B[l - 1][i] + 0), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&B[l - 1][i] + 1), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&B[l - 1][i] + 2), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&B[l - 1][i] + 3), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&B[l - 1][i] + 4), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&B[l - 1][i] + 5), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&B[l - 1][i] + 6), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&B[l - 1][i] + 7), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&all_projection[i] + 0), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&all_projection[i] + 1), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&all_projection[i] + 2), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&all_projection[i] + 3), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&all_projection[i] + 4), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&all_projection[i] + 5), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&all_projection[i] + 6), _MM_HINT_T1);
-                                _mm_prefetch((char*)(&all_projection[i] + 7), _MM_HINT_T1);
-                                all_projection[i - 1] += B[l - 1][i - 1] * factor;
-                            }
-                            all_projection[c-1] += B[l - 1][c-1] * factor;
-                        
+                        /// all_projection is a local array, already in L1
+                        prefetch::stream ahead(&B[l - 1][0], &B[l - 1][0] + c, s);
+                        for (int i = 0; i < c; ++i) {
+                            ahead.advance(&B[l - 1][i]);
+                            all_projection[i] += B[l - 1][i] * factor;
+                        }
                         l++;
                     }
                     for (int i = 0; i < c; ++i) {
@@ -494,10 +437,98 @@ namespace linear_algebra {
                 }
                 k++;
             }
-            displayO(r, c, B);  // for displaying orthogoanlised vectors
+        }
+
+        /**
+         * Prefetch settings of gram_schmidtO for r vectors of dimension c,
+         * calibrated on A if calibration is on.
+         */
+        prefetch::settings gram_schmidt_prefetch(int r, const int& c,
+            const std::array<std::array<double, 30>, 30>& A) {
+            static prefetch::kernel tuning("gram_schmidt");
+            return tuning.get(r * c * sizeof(double), [&](const prefetch::settings& s) {
+                std::array<std::array<double, 30>, 30> B{};
+                orthogonaliseO(r, c, A, B, s);
+                benchmark::do_not_optimize(B);
+            });
+        }
+
+        void gram_schmidtO(int r, const int& c,
+            const std::array<std::array<double, 30>, 30>& A,
+            std::array<std::array<double, 30>, 30> B) {
+            TraceScope(gram_schmidtO)
+            if (c < r) {  /// we check whether appropriate dimensions are given or not.
+                std::cout << "Dimension of vector is less than number of vector, hence "
+                    "\n first "
+                    << c << " vectors are orthogonalised\n";
+                r = c;
+            }
+            const prefetch::settings s = gram_schmidt_prefetch(r, c, A);
+            orthogonaliseO(r, c, A, B, s);
+            displayO(r, c, B, s);  // for displaying orthogoanlised vectors
         }
     }  // namespace gram_schmidt
 }  // namespace linear_algebra
+#ifdef AOR2_BENCHMARK
+#include "_Registry.h"
+
+namespace {
+    /// r x c input vectors, aligned for the AVX loads of the VEKTORSKI variant
+    struct alignas(32) gs_input {
+        int r = 0, c = 0;
+        std::array<std::array<double, 30>, 30> A{};
+    };
+
+    /// size x size random vectors
+    gs_input generate_vectors(size_t size, unsigned seed) {
+        srand(seed);
+        gs_input in;
+        in.r = in.c = static_cast<int>(size);
+        for (int i = 0; i < in.r; i++)
+            for (int j = 0; j < in.c; j++)
+                in.A[i][j] = rand() % 100;
+        return in;
+    }
+
+    typedef std::array<std::array<double, 30>, 30> matrix;
+
+    /**
+     * Same vectors up to rounding: the variants sum in different orders
+     * (and with FMA), so they agree to a few ulps of the largest entry.
+     */
+    bool same_vectors(const matrix& ref, const matrix& out) {
+        double scale = 1;
+        for (const auto& row : ref)
+            for (double x : row)
+                scale = std::max(scale, fabs(x));
+        for (size_t i = 0; i < ref.size(); i++)
+            for (size_t j = 0; j < ref[i].size(); j++)
+                if (!(fabs(ref[i][j] - out[i][j]) <= 1e-9 * scale))
+                    return false;
+        return true;
+    }
+
+    /// the variants without display, so only the computation is timed
+    registry::kernel<gs_input, matrix> gram_schmidt_kernel(
+        "gram_schmidt", { 4, 8, 16, 30 }, generate_vectors, same_vectors);
+    registry::variant<gs_input, matrix> gram_schmidt_original(
+        gram_schmidt_kernel, "ORIGINAL", [](const gs_input& in) {
+            matrix B{};
+            linear_algebra::gram_schmidt::orthogonalise(in.r, in.c, in.A, B);
+            return B; });
+    registry::variant<gs_input, matrix> gram_schmidt_optimized(
+        gram_schmidt_kernel, "OPTIMIZOVANO", [](const gs_input& in) {
+            matrix B{};
+            linear_algebra::gram_schmidt::orthogonaliseO(in.r, in.c, in.A, B,
+                linear_algebra::gram_schmidt::gram_schmidt_prefetch(in.r, in.c, in.A));
+            return B; });
+    registry::variant<gs_input, matrix> gram_schmidt_vector(
+        gram_schmidt_kernel, "VEKTORSKI", [](const gs_input& in) {
+            matrix B{};
+            linear_algebra::gram_schmidt::orthogonaliseO1(in.r, in.c, in.A, B);
+            return B; });
+}  // Unnamed namespace
+#else
 /**
  * Test Function. Process has been tested for 3 Sample Inputs
  * @returns void
@@ -634,7 +665,7 @@ static void test() {
     {
         for (int j = 0; j < 30; j++)
         {
-            a3[i][j] = rand()*10;
+            a3[i][j] = rand()*10.0;
             b3[i][j] = 0;
         }
     }
@@ -661,7 +692,7 @@ static void test() {
         {
             for (int j = 0; j < 30; j++)
             {
-                a3[i][j] = rand() * 10;
+                a3[i][j] = rand() * 10.0;
                 b3[i][j] = 0;
             }
         }
@@ -686,7 +717,7 @@ static void test() {
         {
             for (int j = 0; j < 30; j++)
             {
-                a3[i][j] = rand() * 10;
+                a3[i][j] = rand() * 10.0;
                 b3[i][j] = 0;
             }
         }
@@ -791,3 +822,4 @@ int main() {
 
     return 0;
 }
+#endif  // AOR2_BENCHMARK
@@ -0,0 +1,189 @@
+#pragma once
+/**
+ * @file
+ * @brief Out-of-core Gram Schmidt process over memory mapped files
+ *
+ * @details
+ * For bases that do not fit in memory. Input and output are raw files of
+ * `r * c` doubles, vector k stored at offset `k * c`, both accessed through
+ * `mmap`. Vectors are processed in panels sized to a memory budget: the
+ * panel is copied to the output, every finished vector before the panel is
+ * streamed once and projected out of the whole panel, and then the panel is
+ * orthogonalised internally. The next panel of the input is announced with
+ * `madvise(MADV_WILLNEED)` while the current one is processed, input panels
+ * that are done are dropped, and finished output panels are written back
+ * sequentially with `msync(MS_ASYNC)`.
+ *
+ * The arithmetic is the same as in `gram_schmidt` (projections of the input
+ * vector on the orthogonal vectors), only the order of the loops differs.
+ * POSIX only.
+ */
+
+#include <fcntl.h>     /// for open
+#include <sys/mman.h>  /// for mmap, madvise, msync
+#include <sys/stat.h>  /// for fstat
+#include <unistd.h>    /// for ftruncate, sysconf
+
+#include <algorithm>  /// for std::min
+#include <cstdint>    /// for uintptr_t
+#include <iostream>   /// for error messages
+#include <vector>     /// for std::vector
+
+namespace linear_algebra {
+    namespace gram_schmidt {
+        /**
+         * Options of the out-of-core mode.
+         */
+        struct mmap_options {
+            size_t memory_budget = size_t(256) << 20;  /// bytes for one panel
+        };
+
+        namespace {
+            /**
+             * madvise over [p, p + bytes), widened to whole pages.
+             */
+            inline void advise(const void* p, size_t bytes, int advice) {
+                static const uintptr_t page = sysconf(_SC_PAGESIZE);
+                uintptr_t begin = reinterpret_cast<uintptr_t>(p) & ~(page - 1);
+                uintptr_t end = reinterpret_cast<uintptr_t>(p) + bytes;
+                if (bytes > 0)
+                    madvise(reinterpret_cast<void*>(begin), end - begin, advice);
+            }
+
+            /**
+             * Starts write-back of [p, p + bytes), widened to whole pages.
+             */
+            inline void write_back(void* p, size_t bytes) {
+                static const uintptr_t page = sysconf(_SC_PAGESIZE);
+                uintptr_t begin = reinterpret_cast<uintptr_t>(p) & ~(page - 1);
+                uintptr_t end = reinterpret_cast<uintptr_t>(p) + bytes;
+                if (bytes > 0)
+                    msync(reinterpret_cast<void*>(begin), end - begin, MS_ASYNC);
+            }
+
+            inline double dot(const double* x, const double* y, int c) {
+                double sum = 0;
+                for (int i = 0; i < c; i++) {
+                    sum += x[i] * y[i];
+                }
+                return sum;
+            }
+        }  // Unnamed namespace
+
+        /**
+         * Gram Schmidt process over memory mapped files.
+         * @param in_path file with r input LI vectors of dimension c
+         * @param out_path file for the orthogonalised vectors, created or
+         * truncated to r * c doubles
+         * @param r number of vectors
+         * @param c dimension of vectors
+         * @param opt memory budget of one panel
+         *
+         * @returns true on success, false if a file could not be mapped
+         */
+        inline bool gram_schmidt_mmap(const char* in_path, const char* out_path,
+            int r, int c, const mmap_options& opt = mmap_options()) {
+            if (c < r) {  /// same rule as the dense version
+                r = c;
+            }
+            const size_t vec_bytes = size_t(c) * sizeof(double);
+            const size_t bytes = size_t(r) * vec_bytes;
+            if (bytes == 0)
+                return true;
+
+            int in_fd = open(in_path, O_RDONLY);
+            if (in_fd < 0) {
+                std::cerr << "Cannot open " << in_path << '\n';
+                return false;
+            }
+            struct stat st;
+            if (fstat(in_fd, &st) != 0 || size_t(st.st_size) < bytes) {
+                std::cerr << in_path << " is smaller than " << r << " x " << c
+                    << " doubles\n";
+                close(in_fd);
+                return false;
+            }
+            int out_fd = open(out_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (out_fd < 0 || ftruncate(out_fd, bytes) != 0) {
+                std::cerr << "Cannot create " << out_path << '\n';
+                close(in_fd);
+                if (out_fd >= 0)
+                    close(out_fd);
+                return false;
+            }
+            void* in_map = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, in_fd, 0);
+            void* out_map = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                MAP_SHARED, out_fd, 0);
+            if (in_map == MAP_FAILED || out_map == MAP_FAILED) {
+                std::cerr << "mmap failed\n";
+                if (in_map != MAP_FAILED)
+                    munmap(in_map, bytes);
+                if (out_map != MAP_FAILED)
+                    munmap(out_map, bytes);
+                close(in_fd);
+                close(out_fd);
+                return false;
+            }
+            const double* A = static_cast<const double*>(in_map);
+            double* B = static_cast<double*>(out_map);
+            advise(A, bytes, MADV_SEQUENTIAL);
+
+            /// input and output copy of a panel must fit in the budget
+            const int panel = static_cast<int>(std::max<size_t>(1,
+                std::min<size_t>(r, opt.memory_budget / (2 * vec_bytes))));
+            std::vector<double> norm(r, 0.0);  /// cached B[l] . B[l]
+
+            for (int k0 = 0; k0 < r; k0 += panel) {
+                const int k1 = std::min(r, k0 + panel);
+                if (k1 < r)  /// read-ahead of the next input panel
+                    advise(A + size_t(k1) * c,
+                        size_t(std::min(panel, r - k1)) * vec_bytes,
+                        MADV_WILLNEED);
+
+                for (int k = k0; k < k1; ++k)
+                    std::copy(A + size_t(k) * c, A + size_t(k + 1) * c,
+                        B + size_t(k) * c);  /// panel starts as the input vectors
+
+                /// stream every finished vector once for the whole panel
+                for (int l = 0; l < k0; ++l) {
+                    const double* b = B + size_t(l) * c;
+                    if (l + 1 < k0)
+                        advise(b + c, vec_bytes, MADV_WILLNEED);
+                    if (norm[l] == 0)
+                        continue;
+                    for (int k = k0; k < k1; ++k) {
+                        double factor = dot(A + size_t(k) * c, b, c) / norm[l];
+                        double* w = B + size_t(k) * c;
+                        for (int i = 0; i < c; ++i)
+                            w[i] -= factor * b[i];
+                    }
+                }
+
+                /// projections inside the panel
+                for (int k = k0; k < k1; ++k) {
+                    double* w = B + size_t(k) * c;
+                    for (int l = k0; l < k; ++l) {
+                        if (norm[l] == 0)
+                            continue;
+                        const double* b = B + size_t(l) * c;
+                        double factor = dot(A + size_t(k) * c, b, c) / norm[l];
+                        for (int i = 0; i < c; ++i)
+                            w[i] -= factor * b[i];
+                    }
+                    norm[k] = dot(w, w, c);
+                }
+
+                /// the input panel is not needed again, the output is flushed
+                advise(A + size_t(k0) * c, size_t(k1 - k0) * vec_bytes,
+                    MADV_DONTNEED);
+                write_back(B + size_t(k0) * c, size_t(k1 - k0) * vec_bytes);
+            }
+
+            munmap(in_map, bytes);
+            munmap(out_map, bytes);
+            close(in_fd);
+            close(out_fd);
+            return true;
+        }
+    }  // namespace gram_schmidt
+}  // namespace linear_algebra
@@ -0,0 +1,224 @@
+#pragma once
+/**
+ * @file
+ * @brief Gram Schmidt process over sparse (CSR) input vectors
+ *
+ * @details
+ * Vectors with a very large dimension and only a few non-zero elements can
+ * not be stored in the fixed `std::array` rows used by `gram_schmidt`.
+ * Input is given as a CSR matrix (one row per vector) and every orthogonal
+ * vector is kept in a hybrid form: sparse (index, value) pairs while the
+ * fill-in is low, dense once the number of non-zeros passes
+ * `density_threshold * dim`. Dot products dispatch to sparse-sparse,
+ * sparse-dense or dense-dense kernels, so work and memory stay proportional
+ * to the number of non-zeros as long as the basis stays sparse.
+ */
+
+#include <algorithm>  /// for std::sort
+#include <cmath>      /// for fabs
+#include <cstddef>    /// for size_t
+#include <vector>     /// for std::vector
+
+namespace linear_algebra {
+    namespace gram_schmidt {
+        /**
+         * Input vectors in compressed sparse row format.
+         * Row `i` holds non-zeros `values[row_ptr[i] .. row_ptr[i + 1])` at
+         * columns `col_idx[...]`, columns sorted in increasing order.
+         */
+        struct csr_matrix {
+            int rows = 0;                 /// number of vectors
+            int cols = 0;                 /// dimension of vectors
+            std::vector<int> row_ptr{0};  /// start of every row, size rows + 1
+            std::vector<int> col_idx;     /// column of every non-zero
+            std::vector<double> values;   /// value of every non-zero
+
+            /**
+             * Appends a row given as (column, value) pairs in any order.
+             * Zero values are dropped.
+             */
+            void add_row(std::vector<std::pair<int, double>> row) {
+                std::sort(row.begin(), row.end());
+                for (const auto& e : row) {
+                    if (e.second != 0) {
+                        col_idx.push_back(e.first);
+                        values.push_back(e.second);
+                    }
+                }
+                row_ptr.push_back(static_cast<int>(col_idx.size()));
+                rows++;
+            }
+        };
+
+        /**
+         * Orthogonal vector stored sparse or dense depending on its fill-in.
+         */
+        struct hybrid_vector {
+            bool dense = false;
+            std::vector<int> index;     /// sorted indices (sparse form only)
+            std::vector<double> value;  /// values, or all `dim` values if dense
+
+            size_t nnz() const { return dense ? value.size() : index.size(); }
+        };
+
+        /**
+         * Sparse-sparse dot product, merge of two sorted index lists.
+         */
+        inline double dot_sparse_sparse(const int* xi, const double* xv, int xn,
+            const int* yi, const double* yv, int yn) {
+            double sum = 0;
+            int a = 0, b = 0;
+            while (a < xn && b < yn) {
+                if (xi[a] == yi[b]) {
+                    sum += xv[a++] * yv[b++];
+                }
+                else if (xi[a] < yi[b]) {
+                    a++;
+                }
+                else {
+                    b++;
+                }
+            }
+            return sum;
+        }
+
+        /**
+         * Sparse-dense dot product, gathers the dense vector at the sparse
+         * indices only.
+         */
+        inline double dot_sparse_dense(const int* xi, const double* xv, int xn,
+            const double* y) {
+            double sum = 0;
+            for (int a = 0; a < xn; ++a) {
+                sum += xv[a] * y[xi[a]];
+            }
+            return sum;
+        }
+
+        /**
+         * Dot product of a CSR row with a hybrid vector.
+         */
+        inline double dot_product(const csr_matrix& A, int row,
+            const hybrid_vector& y) {
+            const int begin = A.row_ptr[row];
+            const int n = A.row_ptr[row + 1] - begin;
+            /// data() + begin: an empty last row begins at the end
+            const int* xi = A.col_idx.data() + begin;
+            const double* xv = A.values.data() + begin;
+            if (y.dense)
+                return dot_sparse_dense(xi, xv, n, y.value.data());
+            return dot_sparse_sparse(xi, xv, n, y.index.data(), y.value.data(),
+                static_cast<int>(y.index.size()));
+        }
+
+        /**
+         * Sparse accumulator: dense scratch of size `dim` that remembers which
+         * entries were touched, so it can be read out and reset in time
+         * proportional to the number of touched entries.
+         */
+        class sparse_accumulator {
+         public:
+            explicit sparse_accumulator(int dim)
+                : values_(dim, 0.0), used_(dim, 0) {}
+
+            void add(int i, double v) {
+                if (!used_[i]) {
+                    used_[i] = 1;
+                    touched_.push_back(i);
+                }
+                values_[i] += v;
+            }
+
+            /// adds `factor * y` for a hybrid vector `y`
+            void axpy(double factor, const hybrid_vector& y) {
+                if (y.dense) {
+                    for (int i = 0; i < static_cast<int>(y.value.size()); ++i)
+                        if (y.value[i] != 0)
+                            add(i, factor * y.value[i]);
+                }
+                else {
+                    for (size_t a = 0; a < y.index.size(); ++a)
+                        add(y.index[a], factor * y.value[a]);
+                }
+            }
+
+            size_t nnz() const { return touched_.size(); }
+
+            /**
+             * Moves the accumulated vector into `out` and clears the
+             * accumulator. Stored dense when the fill-in passes `limit`.
+             */
+            void flush(hybrid_vector& out, size_t limit) {
+                const int dim = static_cast<int>(values_.size());
+                out.index.clear();
+                out.value.clear();
+                out.dense = touched_.size() > limit;
+                if (out.dense) {
+                    out.value.assign(dim, 0.0);
+                    for (int i : touched_)
+                        out.value[i] = values_[i];
+                }
+                else {
+                    std::sort(touched_.begin(), touched_.end());
+                    for (int i : touched_) {
+                        if (values_[i] != 0) {
+                            out.index.push_back(i);
+                            out.value.push_back(values_[i]);
+                        }
+                    }
+                }
+                for (int i : touched_) {
+                    values_[i] = 0;
+                    used_[i] = 0;
+                }
+                touched_.clear();
+            }
+
+         private:
+            std::vector<double> values_;
+            std::vector<char> used_;
+            std::vector<int> touched_;
+        };
+
+        /**
+         * Gram Schmidt process over sparse input vectors.
+         * @param A input LI vectors, one per CSR row
+         * @param density_threshold fraction of `A.cols` above which an
+         * orthogonal vector is stored dense
+         *
+         * @returns orthogonalised vectors, in the same order as the rows of A
+         */
+        inline std::vector<hybrid_vector> gram_schmidt_sparse(
+            const csr_matrix& A, double density_threshold = 0.1) {
+            int r = A.rows;
+            if (A.cols < r) {  /// same rule as the dense version
+                r = A.cols;
+            }
+            const size_t limit =
+                static_cast<size_t>(density_threshold * A.cols);
+
+            std::vector<hybrid_vector> B(r);
+            std::vector<double> norm(r, 0.0);  /// cached B[l] . B[l]
+            sparse_accumulator acc(A.cols);
+
+            for (int k = 0; k < r; ++k) {
+                for (int p = A.row_ptr[k]; p < A.row_ptr[k + 1]; ++p)
+                    acc.add(A.col_idx[p], A.values[p]);
+
+                for (int l = 0; l < k; ++l) {
+                    if (norm[l] == 0)
+                        continue;
+                    /// projection factor of the input vector on B[l]
+                    double factor = dot_product(A, k, B[l]) / norm[l];
+                    if (factor != 0)
+                        acc.axpy(-factor, B[l]);
+                }
+                acc.flush(B[k], limit);
+
+                for (double v : B[k].value)
+                    norm[k] += v * v;  /// same loop for sparse and dense form
+            }
+            return B;
+        }
+    }  // namespace gram_schmidt
+}  // namespace linear_algebra
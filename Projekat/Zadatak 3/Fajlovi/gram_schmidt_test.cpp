@@ -0,0 +1,274 @@
+/**
+ * @file
+ * @brief Tests of the sparse, TSQR and out-of-core Gram Schmidt modes
+ *
+ * @details
+ * Every mode is compared with the dense `gram_schmidt` of gram_schmidt.cpp
+ * on the same vectors; they do the same arithmetic in another order, so the
+ * results agree up to rounding. Build together with gram_schmidt.cpp, with
+ * AOR2_BENCHMARK defined so its own `main` is left out:
+ *
+ *     g++ -O2 -mavx2 -mfma -DAOR2_BENCHMARK gram_schmidt_test.cpp
+ *         gram_schmidt.cpp -o gram_schmidt_test
+ *
+ * POSIX only, like `gram_schmidt_mmap.h`; its files are made in $TMPDIR
+ * (default /tmp) and removed.
+ */
+
+#include <algorithm> /// for std::sort, std::unique
+#include <array>     /// for std::array
+#include <cassert>   /// for assert
+#include <cmath>     /// for fabs, sqrt
+#include <cstdio>    /// for remove
+#include <cstdlib>   /// for rand, getenv, mkstemp
+#include <fstream>   /// for std::ofstream, std::ifstream
+#include <iostream>  /// for io operations
+#include <string>    /// for std::string
+#include <unistd.h>  /// for close
+#include <vector>    /// for std::vector
+
+#include "gram_schmidt_mmap.h"
+#include "gram_schmidt_sparse.h"
+#include "gram_schmidt_tsqr.h"
+
+namespace linear_algebra {
+    namespace gram_schmidt {
+        /// gram_schmidt without the output, from gram_schmidt.cpp
+        void orthogonalise(int r, const int& c,
+            const std::array<std::array<double, 30>, 30>& A,
+            std::array<std::array<double, 30>, 30>& B);
+    }  // namespace gram_schmidt
+}  // namespace linear_algebra
+
+namespace {
+    typedef std::array<std::array<double, 30>, 30> matrix;
+
+    /// r x c random vectors with about `fill` of the elements non-zero
+    matrix random_vectors(int r, int c, double fill) {
+        matrix A{};
+        for (int i = 0; i < r; i++) {
+            for (int j = 0; j < c; j++)
+                if (rand() % 1000 < fill * 1000)
+                    A[i][j] = rand() % 100 - 50;
+            A[i][i % c] += 100;  /// keeps them independent
+        }
+        return A;
+    }
+
+    /// the dense result for the first r vectors of A
+    matrix reference(int r, int c, const matrix& A) {
+        matrix B{};
+        linear_algebra::gram_schmidt::orthogonalise(r, c, A, B);
+        return B;
+    }
+
+    /// vector k of `out` equals B[k] up to rounding of the largest element
+    bool same_vector(const double* out, const std::array<double, 30>& ref, int c) {
+        double scale = 1;
+        for (int i = 0; i < c; i++)
+            scale = std::max(scale, fabs(ref[i]));
+        for (int i = 0; i < c; i++)
+            if (!(fabs(out[i] - ref[i]) <= 1e-9 * scale))
+                return false;
+        return true;
+    }
+
+    /**
+     * Sparse input: the vectors of Test Case 1 of gram_schmidt.cpp, then
+     * random ones staying sparse, switching to dense, and dense from the
+     * start. Then an all-zero vector after a non-zero one, and vectors of
+     * a million elements with 0.1% of them non-zero: the basis has to
+     * stay sparse, no larger than the non-zeros of the input, and
+     * orthogonal.
+     */
+    void test_sparse() {
+        using linear_algebra::gram_schmidt::csr_matrix;
+        using linear_algebra::gram_schmidt::hybrid_vector;
+        const int sizes[][2] = { {3, 4}, {20, 30}, {30, 30} };
+        const double fills[] = { 0.05, 0.3 };
+        const double thresholds[] = { 0.0, 0.5, 1.0 };
+        for (const auto& size : sizes) {
+            for (double fill : fills) {
+                const int r = size[0], c = size[1];
+                matrix A = r == 3 ? matrix{ {{1, 0, 1, 0}, {1, 1, 1, 1}, {0, 1, 2, 1}} }
+                    : random_vectors(r, c, fill);
+                csr_matrix S;
+                S.cols = c;
+                for (int i = 0; i < r; i++) {
+                    std::vector<std::pair<int, double>> row;
+                    for (int j = 0; j < c; j++)
+                        row.push_back({j, A[i][j]});
+                    S.add_row(row);
+                }
+                matrix B = reference(r, c, A);
+                for (double threshold : thresholds) {
+                    std::vector<hybrid_vector> out =
+                        linear_algebra::gram_schmidt::gram_schmidt_sparse(S, threshold);
+                    assert((int)out.size() == r);
+                    for (int k = 0; k < r; k++) {
+                        std::vector<double> v(c, 0.0);
+                        for (size_t p = 0; p < out[k].nnz(); ++p)
+                            v[out[k].dense ? p : out[k].index[p]] = out[k].value[p];
+                        assert(same_vector(v.data(), B[k], c));
+                    }
+                }
+            }
+        }
+
+        csr_matrix Z;
+        Z.cols = 2;
+        Z.add_row({{0, 1.0}});
+        Z.add_row({});
+        std::vector<hybrid_vector> z = linear_algebra::gram_schmidt::gram_schmidt_sparse(Z, 1.0);
+        assert(z.size() == 2 && z[0].nnz() == 1 && z[1].nnz() == 0);
+
+        const int r = 20, c = 1000000, per_row = c / 1000;
+        csr_matrix S;
+        S.cols = c;
+        for (int i = 0; i < r; i++) {
+            std::vector<std::pair<int, double>> row;
+            for (int p = 0; p < per_row; p++)
+                row.push_back({rand() % 1000 * 1000 + rand() % 1000, rand() % 100 + 1.0});
+            std::sort(row.begin(), row.end());
+            row.erase(std::unique(row.begin(), row.end(),
+                [](const std::pair<int, double>& x, const std::pair<int, double>& y) {
+                    return x.first == y.first;
+                }), row.end());
+            S.add_row(row);
+        }
+        std::vector<hybrid_vector> out = linear_algebra::gram_schmidt::gram_schmidt_sparse(S);
+        assert((int)out.size() == r);
+        for (int k = 0; k < r; k++) {
+            assert(!out[k].dense);
+            assert(out[k].nnz() <= static_cast<size_t>(S.row_ptr[k + 1]));
+            for (int l = 0; l < k; l++) {
+                double dot = linear_algebra::gram_schmidt::dot_sparse_sparse(
+                    out[k].index.data(), out[k].value.data(), (int)out[k].nnz(),
+                    out[l].index.data(), out[l].value.data(), (int)out[l].nnz());
+                double nk = 0, nl = 0;
+                for (double v : out[k].value)
+                    nk += v * v;
+                for (double v : out[l].value)
+                    nl += v * v;
+                assert(fabs(dot) / sqrt(nk * nl) <= 1e-9);
+            }
+        }
+        std::cout << "Passed sparse\n";
+    }
+
+    /**
+     * TSQR: small inputs against the dense result with 1 to 3 threads and
+     * several block sizes, then a tall-skinny input that the dense version
+     * can not hold, checked for orthogonality.
+     */
+    void test_tsqr() {
+        using linear_algebra::gram_schmidt::tsqr_options;
+        const int sizes[][2] = { {2, 2}, {3, 4}, {8, 30}, {10, 30} };
+        const int blocks[] = { 0, 1, 4 };
+        for (const auto& size : sizes) {
+            const int r = size[0], c = size[1];
+            matrix A = random_vectors(r, c, 1.0);
+            matrix B = reference(r, c, A);
+            std::vector<double> a(r * c), b(r * c);
+            for (int k = 0; k < r; k++)
+                std::copy(A[k].begin(), A[k].begin() + c, a.begin() + k * c);
+            for (int threads = 1; threads <= 3; threads++) {
+                for (int block : blocks) {
+                    tsqr_options opt;
+                    opt.threads = threads;
+                    opt.block_rows = block;
+                    linear_algebra::gram_schmidt::gram_schmidt_tsqr(r, c, a.data(),
+                        b.data(), opt);
+                    for (int k = 0; k < r; k++)
+                        assert(same_vector(&b[k * c], B[k], c));
+                }
+            }
+        }
+
+        const int r = 8, c = 100000;
+        std::vector<double> a(r * c), b(r * c);
+        for (double& x : a)
+            x = rand() % 1000;
+        linear_algebra::gram_schmidt::gram_schmidt_tsqr(r, c, a.data(), b.data());
+        for (int i = 0; i < r - 1; ++i) {
+            for (int j = i + 1; j < r; ++j) {
+                double dot = 0, ni = 0, nj = 0;
+                for (int q = 0; q < c; ++q) {
+                    dot += b[i * c + q] * b[j * c + q];
+                    ni += b[i * c + q] * b[i * c + q];
+                    nj += b[j * c + q] * b[j * c + q];
+                }
+                assert(fabs(dot) / sqrt(ni * nj) <= 1e-9);  /// relative, vectors are long
+            }
+        }
+        std::cout << "Passed TSQR\n";
+    }
+
+    /// a new empty file in $TMPDIR
+    std::string temporary_file() {
+        const char* dir = getenv("TMPDIR");
+        std::string path = std::string(dir && *dir ? dir : "/tmp") + "/gram_schmidt_XXXXXX";
+        std::vector<char> name(path.begin(), path.end());
+        name.push_back('\0');
+        const int fd = mkstemp(name.data());
+        assert(fd >= 0);
+        close(fd);
+        return name.data();
+    }
+
+    /**
+     * Out-of-core: the vectors go through files, with memory budgets of one
+     * vector per panel, a few vectors per panel and all of them in one
+     * panel, so projections of finished panels and inside a panel are both
+     * covered. Then the errors: missing and too small input.
+     */
+    void test_mmap() {
+        using linear_algebra::gram_schmidt::mmap_options;
+        const std::string in_path = temporary_file(), out_path = temporary_file();
+        const int sizes[][2] = { {1, 5}, {3, 4}, {12, 30}, {30, 30} };
+        const int panels[] = { 1, 3, 30 };
+        for (const auto& size : sizes) {
+            const int r = size[0], c = size[1];
+            matrix A = random_vectors(r, c, 1.0);
+            matrix B = reference(r, c, A);
+            {
+                std::ofstream in(in_path, std::ios::binary | std::ios::trunc);
+                for (int k = 0; k < r; k++)
+                    in.write(reinterpret_cast<const char*>(A[k].data()), c * sizeof(double));
+            }
+            for (int panel : panels) {
+                mmap_options opt;
+                opt.memory_budget = 2 * panel * c * sizeof(double);
+                const bool ok = linear_algebra::gram_schmidt::gram_schmidt_mmap(
+                    in_path.c_str(), out_path.c_str(), r, c, opt);
+                assert(ok);
+                std::vector<double> b(r * c);
+                std::ifstream out(out_path, std::ios::binary);
+                out.read(reinterpret_cast<char*>(b.data()), b.size() * sizeof(double));
+                assert(out.gcount() == static_cast<std::streamsize>(b.size() * sizeof(double)));
+                for (int k = 0; k < r; k++)
+                    assert(same_vector(&b[k * c], B[k], c));
+            }
+        }
+
+        std::cerr << "(two expected errors follow)\n";
+        const bool too_small = linear_algebra::gram_schmidt::gram_schmidt_mmap(
+            in_path.c_str(), out_path.c_str(), 31, 31);
+        assert(!too_small);
+        remove(in_path.c_str());
+        const bool missing = linear_algebra::gram_schmidt::gram_schmidt_mmap(
+            in_path.c_str(), out_path.c_str(), 2, 2);
+        assert(!missing);
+        remove(out_path.c_str());
+        std::cout << "Passed mmap\n";
+    }
+}  // Unnamed namespace
+
+/** Driver Code */
+int main() {
+    srand(1);
+    test_sparse();
+    test_tsqr();
+    test_mmap();
+    return 0;
+}
@@ -0,0 +1,209 @@
+#pragma once
+/**
+ * @file
+ * @brief Tall-skinny QR (TSQR) variant of the Gram Schmidt process
+ *
+ * @details
+ * Meant for a small number of very long vectors (r << c). The classic
+ * process streams every long vector once per projection, which is purely
+ * memory bound. Here the dimension range [0, c) is split between threads,
+ * every thread factors its row blocks with Householder reflections and
+ * keeps only the small r x r R factor, and the R factors of the threads are
+ * combined pairwise in a reduction tree. The orthogonal vectors are then
+ * B = A * R^-1 * diag(R), computed block by block in a second parallel
+ * pass, so every input element is read from memory twice in total.
+ *
+ * B is the same (up to rounding) as the output of `gram_schmidt`: vector k
+ * is A[k] minus its projections on the previous vectors.
+ */
+
+#include <algorithm>     /// for std::min
+#include <cmath>         /// for sqrt, fabs
+#include <system_error>  /// for std::system_error
+#include <thread>        /// for std::thread
+#include <vector>        /// for std::vector
+
+namespace linear_algebra {
+    namespace gram_schmidt {
+        /**
+         * Options of the TSQR mode.
+         */
+        struct tsqr_options {
+            int threads = 0;     /// number of worker threads, 0 = all cores
+            int block_rows = 0;  /// rows per local factorization, 0 = auto
+        };
+
+        namespace {
+            /**
+             * Householder QR of an m x n row-major matrix W (m >= n), in
+             * place. Afterwards the upper n x n triangle of W holds R.
+             * Vectors that are (numerically) zero are skipped.
+             */
+            inline void householder_r(double* W, int m, int n) {
+                std::vector<double> v(m);
+                for (int k = 0; k < n && k < m; ++k) {
+                    double norm = 0;
+                    for (int i = k; i < m; ++i)
+                        norm += W[i * n + k] * W[i * n + k];
+                    norm = sqrt(norm);
+                    if (norm == 0)
+                        continue;
+                    double alpha = W[k * n + k] > 0 ? -norm : norm;
+                    /// v = x - alpha * e1, H = I - 2 v v^T / (v^T v)
+                    double vv = 0;
+                    for (int i = k; i < m; ++i) {
+                        v[i] = W[i * n + k];
+                        if (i == k)
+                            v[i] -= alpha;
+                        vv += v[i] * v[i];
+                    }
+                    if (vv == 0)
+                        continue;
+                    for (int j = k; j < n; ++j) {
+                        double s = 0;
+                        for (int i = k; i < m; ++i)
+                            s += v[i] * W[i * n + j];
+                        s = 2 * s / vv;
+                        for (int i = k; i < m; ++i)
+                            W[i * n + j] -= s * v[i];
+                    }
+                    for (int i = k + 1; i < m; ++i)
+                        W[i * n + k] = 0;
+                }
+            }
+
+            /**
+             * Combines two n x n upper triangular factors into the R factor
+             * of the stacked 2n x n matrix, result stored in `top`.
+             */
+            inline void combine_r(std::vector<double>& top,
+                const std::vector<double>& bottom, int n) {
+                std::vector<double> W(2 * n * n);
+                std::copy(top.begin(), top.end(), W.begin());
+                std::copy(bottom.begin(), bottom.end(), W.begin() + n * n);
+                householder_r(W.data(), 2 * n, n);
+                std::copy(W.begin(), W.begin() + n * n, top.begin());
+            }
+
+            /**
+             * R factor of rows [begin, end) of the tall matrix whose column
+             * k is the vector A + k * c. Blocks of `block` rows are stacked
+             * under the running R factor and factored again.
+             */
+            inline void local_r(const double* A, int r, int c, int begin,
+                int end, int block, std::vector<double>& R) {
+                std::vector<double> W((r + block) * r);
+                R.assign(r * r, 0.0);
+                for (int j0 = begin; j0 < end; j0 += block) {
+                    int rows = std::min(block, end - j0);
+                    std::copy(R.begin(), R.end(), W.begin());
+                    for (int i = 0; i < rows; ++i)
+                        for (int k = 0; k < r; ++k)
+                            W[(r + i) * r + k] = A[k * c + j0 + i];
+                    householder_r(W.data(), r + rows, r);
+                    std::copy(W.begin(), W.begin() + r * r, R.begin());
+                }
+            }
+
+            /**
+             * Runs task(0) .. task(n - 1), each on its own thread, and waits
+             * for all of them. If a thread can not be started, the calling
+             * thread runs that task and the ones after it.
+             */
+            template <typename F>
+            void run_all(int n, F task) {
+                std::vector<std::thread> pool;
+                pool.reserve(n);
+                int t = 0;
+                try {
+                    for (; t < n; ++t)
+                        pool.emplace_back(task, t);
+                }
+                catch (const std::system_error&) {
+                    for (; t < n; ++t)
+                        task(t);
+                }
+                for (std::thread& th : pool)
+                    th.join();
+            }
+        }  // Unnamed namespace
+
+        /**
+         * Gram Schmidt process for tall-skinny inputs.
+         * @param r number of vectors
+         * @param c dimension of vectors
+         * @param A r input LI vectors, vector k stored at A + k * c
+         * @param B orthogonalised vectors, same layout as A
+         * @param opt number of threads and block size
+         *
+         * @returns void
+         */
+        inline void gram_schmidt_tsqr(int r, int c, const double* A, double* B,
+            const tsqr_options& opt = tsqr_options()) {
+            if (c < r) {  /// same rule as the dense version
+                r = c;
+            }
+            if (r <= 0)
+                return;
+
+            int threads = opt.threads > 0
+                ? opt.threads
+                : static_cast<int>(std::thread::hardware_concurrency());
+            threads = std::max(1, std::min(threads, c / r));
+            /// by default a block of r x block_rows doubles fills ~256 KB
+            int block = opt.block_rows > 0
+                ? opt.block_rows
+                : std::max(r, 32768 / r);
+
+            std::vector<int> bound(threads + 1);
+            for (int t = 0; t <= threads; ++t)
+                bound[t] = static_cast<int>(static_cast<long long>(c) * t / threads);
+
+            /// first pass: one R factor per thread
+            std::vector<std::vector<double>> R(threads);
+            run_all(threads, [&](int t) {
+                local_r(A, r, c, bound[t], bound[t + 1], block, R[t]);
+            });
+
+            /// reduction tree over the R factors, R[t] takes in R[t + step]
+            for (int step = 1; step < threads; step *= 2) {
+                run_all((threads - step - 1) / (2 * step) + 1, [&](int i) {
+                    combine_r(R[2 * step * i], R[2 * step * i + step], r);
+                });
+            }
+
+            /// T = R^-1 * diag(R), upper triangular, so that B = A * T
+            const std::vector<double>& F = R[0];
+            std::vector<double> T(r * r, 0.0);
+            for (int k = 0; k < r; ++k) {
+                if (F[k * r + k] == 0)
+                    continue;  /// dependent vector, left as zero
+                T[k * r + k] = 1;
+                for (int i = k - 1; i >= 0; --i) {
+                    if (F[i * r + i] == 0)
+                        continue;
+                    double s = 0;
+                    for (int j = i + 1; j <= k; ++j)
+                        s += F[i * r + j] * T[j * r + k];
+                    T[i * r + k] = -s / F[i * r + i];
+                }
+            }
+
+            /// second pass: B = A * T, block by block
+            auto apply = [&](int begin, int end) {
+                std::vector<double> a(r);
+                for (int j = begin; j < end; ++j) {
+                    for (int k = 0; k < r; ++k)
+                        a[k] = A[k * c + j];
+                    for (int k = 0; k < r; ++k) {
+                        double s = 0;
+                        for (int i = 0; i <= k; ++i)
+                            s += a[i] * T[i * r + k];
+                        B[k * c + j] = s;
+                    }
+                }
+            };
+            run_all(threads, [&](int t) { apply(bound[t], bound[t + 1]); });
+        }
+    }  // namespace gram_schmidt
+}  // namespace linear_algebra
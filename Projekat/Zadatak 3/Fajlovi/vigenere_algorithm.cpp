@@ -37,6 +37,9 @@
 
 #include "emmintrin.h"
 #include "_Timer.h"
+#include "_PerfCounters.h"
+#include "_Prefetch.h"
+#include "_Trace.h"
 
 using namespace std;
 
@@ -77,6 +80,7 @@ namespace ciphers {
          * @return new encrypted text
          */
         std::string encrypt(const std::string& text, const std::string& key) {
+            TraceScope(encrypt)
             std::string encrypted_text = ""; // Empty string to store encrypted text
             // Going through each character of text and key
             // Note that key is visited in circular way hence  j = (j + 1) % |key|
@@ -91,34 +95,31 @@ namespace ciphers {
         }
 
         /*OPTIMIZOVANO*/
-        std::string encryptO(const std::string& text, const std::string& key) {
-            std::string encrypted_text = ""; 
-
-            _mm_prefetch((char*)(&text[0]), _MM_HINT_T1);
-            _mm_prefetch((char*)(&text[1]), _MM_HINT_T1);
-            _mm_prefetch((char*)(&text[2]), _MM_HINT_T1);
-            _mm_prefetch((char*)(&text[3]), _MM_HINT_T1);
-
-            size_t i = 4, j = 0;
-            for (; i < text.length(); i++, j = (j + 1) % key.length()) {
-                _mm_prefetch((char*)(&text[i]), _MM_HINT_T1);
-                int place_value_text = get_value(text[i-4]); 
-                int place_value_key = get_value(key[j]); 
-                place_value_text = (place_value_text + place_value_key) % 26; 
-                char encrypted_char = get_char(place_value_text); 
-                encrypted_text += encrypted_char; 
-            }
-            for (i = 0; i < 4; i++)
-            {
-                int place_value_text = get_value(text[text.length() - 4 + i]);
+        std::string encryptO(const std::string& text, const std::string& key,
+            const prefetch::settings& s) {
+            std::string encrypted_text = "";
+            prefetch::stream ahead(text.data(), text.data() + text.length(), s);
+            for (size_t i = 0, j = 0; i < text.length(); i++, j = (j + 1) % key.length()) {
+                ahead.advance(&text[i]);
+                int place_value_text = get_value(text[i]);
                 int place_value_key = get_value(key[j]);
                 place_value_text = (place_value_text + place_value_key) % 26;
                 char encrypted_char = get_char(place_value_text);
-                encrypted_text += encrypted_char;
-                j = (j + 1) % key.length();
+                encrypted_text += encrypted_char;
             }
+            return encrypted_text;
+        }
 
-            return encrypted_text; 
+        /**
+         * encryptO with the prefetch settings of this machine and text length
+         */
+        std::string encryptO(const std::string& text, const std::string& key) {
+            static prefetch::kernel tuning("encrypt");
+            const prefetch::settings s = tuning.get(text.length(),
+                [&](const prefetch::settings& t) {
+                    benchmark::do_not_optimize(encryptO(text, key, t)); });
+            TraceScope(encryptO)  /// after calibration, which calls the overload above
+            return encryptO(text, key, s);
         }
         /**
          * Decrypt given text using vigenere cipher.
@@ -127,6 +128,7 @@ namespace ciphers {
          * @return new decrypted text
          */
         std::string decrypt(const std::string& text, const std::string& key) {
+            TraceScope(decrypt)
             // Going through each character of text and key
             // Note that key is visited in circular way hence  j = (j + 1) % |key|
             std::string decrypted_text = ""; // Empty string to store decrypted text
@@ -141,39 +143,78 @@ namespace ciphers {
         }
 
         /*OPTIMIZOVANO PREFETCH*/
-        std::string decryptO(const std::string& text, const std::string& key) {
-
-            _mm_prefetch((char*)(&text[0]), _MM_HINT_T1);
-            _mm_prefetch((char*)(&text[1]), _MM_HINT_T1);
-            _mm_prefetch((char*)(&text[2]), _MM_HINT_T1);
-            _mm_prefetch((char*)(&text[3]), _MM_HINT_T1);
-
+        std::string decryptO(const std::string& text, const std::string& key,
+            const prefetch::settings& s) {
             std::string decrypted_text = ""; // Empty string to store decrypted text
-
-            size_t i = 4, j = 0;
-            for (; i < text.length(); i++, j = (j + 1) % key.length()) {
-                _mm_prefetch((char*)(&text[i]), _MM_HINT_T1);
-                int place_value_text = get_value(text[i-4]);
-                int place_value_key = get_value(key[j]); 
-                place_value_text = (place_value_text - place_value_key + 26) % 26; 
-                char decrypted_char = get_char(place_value_text); 
-                decrypted_text += decrypted_char; 
-            }
-            for (i = 0; i < 4; i++)
-            {
-                int place_value_text = get_value(text[text.length() - 4 + i]);
+            prefetch::stream ahead(text.data(), text.data() + text.length(), s);
+            for (size_t i = 0, j = 0; i < text.length(); i++, j = (j + 1) % key.length()) {
+                ahead.advance(&text[i]);
+                int place_value_text = get_value(text[i]);
                 int place_value_key = get_value(key[j]);
                 place_value_text = (place_value_text - place_value_key + 26) % 26;
                 char decrypted_char = get_char(place_value_text);
-                decrypted_text += decrypted_char;
-                j = (j + 1) % key.length();
+                decrypted_text += decrypted_char;
             }
-            
-            return decrypted_text; 
+            return decrypted_text;
+        }
+
+        /**
+         * decryptO with the prefetch settings of this machine and text length
+         */
+        std::string decryptO(const std::string& text, const std::string& key) {
+            static prefetch::kernel tuning("decrypt");
+            const prefetch::settings s = tuning.get(text.length(),
+                [&](const prefetch::settings& t) {
+                    benchmark::do_not_optimize(decryptO(text, key, t)); });
+            TraceScope(decryptO)  /// after calibration, which calls the overload above
+            return decryptO(text, key, s);
         }
     } // namespace vigenere
 } // namespace ciphers
 
+#ifdef AOR2_BENCHMARK
+#include "_Registry.h"
+
+namespace {
+    typedef std::pair<std::string, std::string> text_and_key;
+
+    /// random A-Z text of the given length, key "REALLY"
+    text_and_key generate_text(size_t size, unsigned seed) {
+        srand(seed);
+        std::string text;
+        for (size_t i = 0; i < size; i++)
+            text += ciphers::vigenere::get_char(rand() % 26);
+        return text_and_key(text, "REALLY");
+    }
+
+    /// same as generate_text, but the text is the encryption of it
+    text_and_key generate_cipher(size_t size, unsigned seed) {
+        text_and_key in = generate_text(size, seed);
+        in.first = ciphers::vigenere::encrypt(in.first, in.second);
+        return in;
+    }
+
+    registry::kernel<text_and_key, std::string> encrypt_kernel(
+        "encrypt", { 16, 1024, 65536, 1048576 }, generate_text,
+        std::equal_to<std::string>());
+    registry::variant<text_and_key, std::string> encrypt_original(
+        encrypt_kernel, "ORIGINAL", [](const text_and_key& in) {
+            return ciphers::vigenere::encrypt(in.first, in.second); });
+    registry::variant<text_and_key, std::string> encrypt_prefetch(
+        encrypt_kernel, "OPTIMIZOVANOPREFETCH", [](const text_and_key& in) {
+            return ciphers::vigenere::encryptO(in.first, in.second); });
+
+    registry::kernel<text_and_key, std::string> decrypt_kernel(
+        "decrypt", { 16, 1024, 65536, 1048576 }, generate_cipher,
+        std::equal_to<std::string>());
+    registry::variant<text_and_key, std::string> decrypt_original(
+        decrypt_kernel, "ORIGINAL", [](const text_and_key& in) {
+            return ciphers::vigenere::decrypt(in.first, in.second); });
+    registry::variant<text_and_key, std::string> decrypt_prefetch(
+        decrypt_kernel, "OPTIMIZOVANOPREFETCH", [](const text_and_key& in) {
+            return ciphers::vigenere::decryptO(in.first, in.second); });
+}  // Unnamed namespace
+#else
 /**
  * Function to test above algorithm
  */
@@ -182,9 +223,12 @@ void test() {
     std::string text1 = "NIKOLATESLA";
     std::string encrypted1, decrypted1;
     StartTimer(ORIGINAL)
+    StartCounters
     encrypted1 = ciphers::vigenere::encrypt(text1, "TESLA");
     decrypted1 = ciphers::vigenere::decrypt(encrypted1, "TESLA");
+    EndCounters
     EndTimer
+    PrintCounters(ORIGINAL)
     assert(text1 == decrypted1);
     std::cout << "Original text : " << text1;
     std::cout << " , Encrypted text (with key = TESLA) : " << encrypted1;
@@ -194,10 +238,13 @@ void test() {
     //OPTIMIZOVANOPREFETCH
     text1 = "NIKOLATESLA";
     StartTimer(OPTIMIZOVANOPREFETCH)
+    StartCounters
     encrypted1 = ciphers::vigenere::encryptO(text1, "TESLA");
     decrypted1 = ciphers::vigenere::decryptO(encrypted1, "TESLA");
+    EndCounters
     EndTimer
-    //assert(text1 == decrypted1);
+    PrintCounters(OPTIMIZOVANOPREFETCH)
+    assert(text1 == decrypted1);
     std::cout << "Original text : " << text1;
     std::cout << " , Encrypted text (with key = TESLA) : " << encrypted1;
     std::cout << " , Decrypted text : " << decrypted1 << std::endl;
@@ -211,19 +258,25 @@ void test() {
     }
     std::string encrypted2, decrypted2;
     StartTimer(ORIGINAL)
+    StartCounters
     encrypted2 = ciphers::vigenere::encrypt(text2, "REALLY");
     decrypted2 = ciphers::vigenere::decrypt(encrypted2, "REALLY");
+    EndCounters
     EndTimer
-    //assert(text2 == decrypted2);
+    PrintCounters(ORIGINAL)
+    assert(text2 == decrypted2);
     std::cout << "Original text : " << text2;
     std::cout << " ,\n Encrypted text (with key = REALLY) : " << encrypted2;
     std::cout << " ,\n Decrypted text : " << decrypted2 << std::endl;
 
     StartTimer(OPTIMIZOVANOPREFETCH)
-    encrypted2 = ciphers::vigenere::encrypt(text2, "REALLY");
-    decrypted2 = ciphers::vigenere::decrypt(encrypted2, "REALLY");
+    StartCounters
+    encrypted2 = ciphers::vigenere::encryptO(text2, "REALLY");
+    decrypted2 = ciphers::vigenere::decryptO(encrypted2, "REALLY");
+    EndCounters
     EndTimer
-    //assert(text2 == decrypted2);
+    PrintCounters(OPTIMIZOVANOPREFETCH)
+    assert(text2 == decrypted2);
     std::cout << "Original text : " << text2;
     std::cout << " ,\n Encrypted text (with key = REALLY) : " << encrypted2;
     std::cout << " ,\n Decrypted text : " << decrypted2 << std::endl;
@@ -231,7 +284,15 @@ void test() {
 
 /** Driver Code */
 int main() {
+    perf::thread_counters();  // opened here, not in the first timed region
+    if (prefetch::calibrating()) {
+        // tune for the sizes of test() before anything is timed
+        std::string small(11, 'A'), large(10000, 'A');
+        ciphers::vigenere::decryptO(ciphers::vigenere::encryptO(small, "TESLA"), "TESLA");
+        ciphers::vigenere::decryptO(ciphers::vigenere::encryptO(large, "REALLY"), "REALLY");
+    }
     // Testing
     test();
     return 0;
 }
+#endif  // AOR2_BENCHMARK